@@ -24,6 +24,9 @@
 #ifndef STRINGS_H
 #define STRINGS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <avl.h>
 
   /**
@@ -36,7 +39,8 @@ typedef enum
 {
   string_found,       /**<  string was found in lookup operation      */
   string_not_found,   /**<  string was NOT found in lookup operation  */
-  string_failed       /**<  lookup operation failed for other reason  */
+  string_failed,      /**<  lookup operation failed for other reason  */
+  string_inserted     /**<  string was new and has been added         */
 } string_result;
 
   /**
@@ -51,6 +55,42 @@ typedef enum
   string_text  /**<  specific to avl index of string text  */
 } string_key;
 
+  /**
+   *  @typedef string_walk_action
+   *
+   *  @brief function called at each entry by strings_walk_with_context()
+   *
+   *  Receives the entry and the context pointer given to the walk, and
+   *  returns non-zero to stop the walk.
+   */
+
+typedef int (*string_walk_action)(avl_node *n, void *ctx);
+
+  /**
+   *  @typedef enum string_order
+   *
+   *  @brief libstrings ordered text index type
+   */
+
+typedef enum
+{
+  string_order_avl,    /**<  binary AVL tree of entries (libavl)  */
+  string_order_btree,  /**<  B+ tree with prefix compressed keys  */
+  string_order_art     /**<  adaptive radix tree over text bytes  */
+} string_order;
+
+  /**
+   *  @typedef enum string_direction
+   *
+   *  @brief libstrings direction of a scan in text order
+   */
+
+typedef enum
+{
+  string_forward,   /**<  from lowest text to highest  */
+  string_reverse    /**<  from highest text to lowest  */
+} string_direction;
+
   /**
    *  @typedef struct string string
    *
@@ -70,8 +110,21 @@ struct string
   unsigned int ref_cnt;  /**<  number of times string has been referenced in application  */
   unsigned int id;       /**<  unique id of string entry in AVL tree                      */
   char *text;            /**<  string                              e                      */
+  size_t len;            /**<  length of text in bytes, not counting terminating NUL     */
+  uint64_t hash;         /**<  strings_hash() of text, computed once                     */
 };
 
+  /**
+   *  @def STRING_NODE_INLINE_SIZE
+   *
+   *  @brief size of inline key of a @a string_node
+   *
+   *  Text shorter than this is stored, NUL terminated, in the key itself
+   *  and value.text points there, so it needs no storage of its own.
+   */
+
+#define STRING_NODE_INLINE_SIZE 16
+
   /**
    *  @typedef struct string_node string_node
    *
@@ -88,12 +141,142 @@ typedef struct string_node string_node;
 
 struct string_node
 {
-  avl_node *left;   /**<  points to left (lesser) node    */
-  avl_node *right;  /**<  points to right (greater) node  */
-  int height;       /**<  current height of node          */
-  string value;
+  avl_node *left;                              /**<   points to left (lesser) node                    */
+  avl_node *right;                             /**<   points to right (greater) node                  */
+  int height;                                  /**<   current height of node                          */
+  string value;                                /**<   entry payload                                   */
+  unsigned char key[STRING_NODE_INLINE_SIZE];  /**<   text prefix, zero padded, all of a short text   */
+};
+
+  /**
+   *  @typedef struct string_slot string_slot
+   *
+   *  @brief create a type for @a string_slot struct
+   */
+
+typedef struct string_slot string_slot;
+
+  /**
+   *  @struct string_slot
+   *
+   *  @brief one slot of the open addressing hash index of string text
+   */
+
+struct string_slot
+{
+  uint64_t hash;      /**<  cached hash of text of @a node                   */
+  string_node *node;  /**<  entry in text AVL tree, NULL if slot is empty  */
+};
+
+  /**
+   *  @typedef struct string_chunk string_chunk
+   *
+   *  @brief create a type for @a string_chunk struct
+   */
+
+typedef struct string_chunk string_chunk;
+
+  /**
+   *  @struct string_chunk
+   *
+   *  @brief one chunk of the arena holding text of all entries in @a strings
+   */
+
+struct string_chunk
+{
+  string_chunk *next;  /**<  next (older) chunk in arena  */
+  size_t size;         /**<  bytes of text space          */
+  size_t used;         /**<  bytes of text space in use   */
+  char text[];         /**<  text space                   */
 };
 
+  /**
+   *  @typedef struct string_slab string_slab
+   *
+   *  @brief create a type for @a string_slab struct
+   */
+
+typedef struct string_slab string_slab;
+
+  /**
+   *  @struct string_slab
+   *
+   *  @brief one block of the slab holding all entries in @a strings
+   */
+
+struct string_slab
+{
+  string_slab *next;     /**<  next (older) block in slab            */
+  unsigned int size;     /**<  number of entries in block            */
+  unsigned int used;     /**<  entries carved out of block so far    */
+  string_node nodes[];   /**<  entries                               */
+};
+
+  /**
+   *  @typedef struct string_cursor string_cursor
+   *
+   *  @brief create a type for @a string_cursor struct
+   */
+
+typedef struct string_cursor string_cursor;
+
+  /**
+   *  @struct string_cursor
+   *
+   *  @brief position of a query in the ordered text index of a @a strings struct
+   *
+   *  The cursor keeps a copy of the text of the last entry returned, not a
+   *  pointer into the index, so a query can be resumed after the table has
+   *  changed, even if that entry was removed.  A range scan also keeps
+   *  copies of its bounds.
+   */
+
+struct string_cursor
+{
+  char *text;                  /**<  text of last entry returned           */
+  size_t len;                  /**<  length of text in bytes               */
+  size_t size;                 /**<  bytes allocated at text               */
+  unsigned int started;        /**<  non-zero once an entry returned       */
+  unsigned int done;           /**<  non-zero once query is exhausted      */
+  string_direction direction;  /**<  direction of range scan               */
+  char *lower;                 /**<  inclusive lower bound, NULL for none  */
+  size_t lower_len;            /**<  length of lower in bytes              */
+  char *upper;                 /**<  exclusive upper bound, NULL for none  */
+  size_t upper_len;            /**<  length of upper in bytes              */
+};
+
+  /**
+   *  @typedef struct string_btree string_btree
+   *
+   *  @brief create a type for the B+ tree text index, private to libstrings
+   */
+
+typedef struct string_btree string_btree;
+
+  /**
+   *  @typedef struct string_art string_art
+   *
+   *  @brief create a type for the adaptive radix tree text index, private to libstrings
+   */
+
+typedef struct string_art string_art;
+
+  /**
+   *  @typedef struct string_snapshot string_snapshot
+   *
+   *  @brief create a type for a mapped snapshot file, private to libstrings
+   */
+
+typedef struct string_snapshot string_snapshot;
+
+  /**
+   *  @typedef struct string_log string_log
+   *
+   *  @brief create a type for a write-ahead log, private to libstrings
+   */
+
+typedef struct string_log string_log;
+
   /**
    *  @typedef struct strings strings
    *
@@ -102,6 +285,30 @@ struct string_node
 
 typedef struct strings strings;
 
+  /**
+   *  @typedef struct string_shard string_shard
+   *
+   *  @brief create a type for a shard of a concurrent table, private to libstrings
+   */
+
+typedef struct string_shard string_shard;
+
+  /**
+   *  @typedef struct string_epoch string_epoch
+   *
+   *  @brief create a type for the reclamation state of a read-mostly table, private to libstrings
+   */
+
+typedef struct string_epoch string_epoch;
+
+  /**
+   *  @typedef struct string_lockfree string_lockfree
+   *
+   *  @brief create a type for the lock-free hash index, private to libstrings
+   */
+
+typedef struct string_lockfree string_lockfree;
+
   /**
    *  @struct strings
    *
@@ -110,9 +317,73 @@ typedef struct strings strings;
 
 struct strings
 {
-  unsigned int last_id;  /**<   last string id used so far  */
-  avl *id_root;          /**<   root of ID AVL tree         */
-  avl *text_root;        /**<   root of text AVL tree       */
+  unsigned int last_id;             /**<   last string id used so far             */
+  string_node **id_index;           /**<   entries by id, NULL for removed ids    */
+  unsigned int id_index_size;       /**<   number of slots in id_index            */
+  unsigned int id_index_used;       /**<   number of non-NULL slots in id_index   */
+  string_order order;               /**<   type of ordered text index             */
+  avl *text_root;                   /**<   root of text AVL tree                  */
+  string_btree *text_btree;         /**<   text B+ tree                           */
+  string_art *text_art;             /**<   text adaptive radix tree               */
+  string_slot *text_index;          /**<   hash index of text (linear probing)    */
+  unsigned int text_index_size;     /**<   number of slots, always a power of 2   */
+  unsigned int text_index_used;     /**<   number of occupied slots               */
+  string_chunk *text_arena;         /**<   newest chunk of text arena             */
+  string_slab *node_slab;           /**<   newest block of entry slab             */
+  string_node *node_free;           /**<   free list of released entries          */
+  unsigned int node_slab_used;      /**<   number of entries in use               */
+  unsigned int node_slab_capacity;  /**<   number of entries in slab blocks       */
+  string_shard *shards;             /**<   concurrent: hash index shards, or NULL */
+  unsigned int shard_count;         /**<   concurrent: number of shards           */
+  string_node ***id_dir;            /**<   concurrent: chunks of the id index     */
+  unsigned int order_stale;         /**<   ordered index out of date              */
+  string_epoch *epoch;              /**<   read-mostly: reclamation state, or NULL */
+  string_lockfree *lockfree;        /**<   lock-free: hash index, or NULL          */
+  string_snapshot *snapshot;        /**<   mapped: snapshot file, or NULL          */
+  unsigned int layered;             /**<   mapped: adds go to an in-memory overlay */
+  string_log *log;                  /**<   logged: write-ahead log, or NULL        */
+};
+
+  /**
+   *  @typedef struct string_reader string_reader
+   *
+   *  @brief create a type for a reader of a read-mostly table, private to libstrings
+   */
+
+typedef struct string_reader string_reader;
+
+  /**
+   *  @typedef struct string_local string_local
+   *
+   *  @brief create a type for a thread-local front interner, private to libstrings
+   */
+
+typedef struct string_local string_local;
+
+  /**
+   *  @typedef struct string_iterator string_iterator
+   *
+   *  @brief create a type for @a string_iterator struct
+   */
+
+typedef struct string_iterator string_iterator;
+
+  /**
+   *  @struct string_iterator
+   *
+   *  @brief position of an iteration over the entries of a @a strings struct
+   *
+   *  An iteration in id order holds the next id to look at, one in text
+   *  order holds a cursor, so neither is invalidated by changes to the
+   *  table.
+   */
+
+struct string_iterator
+{
+  strings *strs;          /**<   table being iterated                  */
+  string_key key;         /**<   order of iteration                    */
+  unsigned int id;        /**<   next id to look at, for string_id     */
+  string_cursor cursor;   /**<   position in text order, string_text   */
 };
 
 string *string_new(void);
@@ -120,6 +391,8 @@ string *string_new_with_values(char *text, unsigned int id);
 string *string_dup(string *str);
 void string_copy(string *dst, string *src);
 void string_free(string *str);
+uint64_t string_hash(string *str);
+int string_equal(string *a, string *b);
 
 avl_node *string_node_new(void);
 avl_node *string_node_new_with_values(char *text, unsigned int id);
@@ -129,16 +402,85 @@ int string_node_compare_text(avl_node *a, avl_node *b);
 int string_node_compare_id(avl_node *a, avl_node *b);
 void string_node_copy_data(avl_node *dst, avl_node *src);
 
+string_cursor *string_cursor_new(void);
+void string_cursor_reset(string_cursor *cursor);
+int string_cursor_set_range(string_cursor *cursor,
+                            const char *lower,
+                            size_t lower_len,
+                            const char *upper,
+                            size_t upper_len,
+                            string_direction direction);
+void string_cursor_free(string_cursor *cursor);
+
 strings *strings_new(void);
+strings *strings_new_with_order(string_order order);
+strings *strings_new_concurrent(string_order order, unsigned int shards);
+strings *strings_new_read_mostly(string_order order);
+strings *strings_new_lock_free(string_order order);
+strings *strings_open_mapped(const char *path);
+strings *strings_open_layered(const char *path);
 strings *strings_dup(strings *strs);
 void strings_free(strings *strs);
 
 string_result strings_add(strings *strs, string *str);
+string_result strings_add_n(strings *strs, const char *text, size_t len);
+string_result strings_intern(strings *strs,
+                             const char *text,
+                             size_t len,
+                             unsigned int *id);
+string_result strings_add_batch(strings *strs,
+                                const char **texts,
+                                const size_t *lens,
+                                unsigned int n,
+                                unsigned int *ids_out);
+string_result strings_add_batch_parallel(strings *strs,
+                                         const char **texts,
+                                         const size_t *lens,
+                                         unsigned int n,
+                                         unsigned int *ids_out,
+                                         unsigned int threads);
+string_reader *strings_reader_new(strings *strs);
+void strings_reader_free(string_reader *reader);
+void strings_read_begin(string_reader *reader);
+void strings_read_end(string_reader *reader);
+string_local *strings_local_new(strings *global);
+void strings_local_free(string_local *local);
+string_result strings_local_intern(string_local *local,
+                                   const char *text,
+                                   size_t len,
+                                   unsigned int *id);
+unsigned int strings_local_count(string_local *local);
+string_result strings_local_merge(string_local *local, unsigned int *remap);
 string_result strings_remove(strings *strs, char *text);
+string_result strings_remove_n(strings *strs, const char *text, size_t len);
 string *strings_find_by_text(strings *strs, char *text);
+string *strings_find_by_text_n(strings *strs, const char *text, size_t len);
 string *strings_find_by_id(strings *strs, unsigned int id);
+string *strings_find_prefix(strings *strs,
+                            const char *prefix,
+                            size_t len,
+                            string_cursor *cursor);
+unsigned int strings_scan(strings *strs,
+                          string_cursor *cursor,
+                          unsigned int limit,
+                          avl_action action);
+uint64_t strings_hash(const char *text, size_t len);
 void strings_walk(strings *strs, string_key key, avl_action action);
+int strings_walk_with_context(strings *strs,
+                              string_key key,
+                              string_walk_action action,
+                              void *ctx);
+string_iterator *strings_begin(strings *strs, string_key key);
+string *strings_next(string_iterator *it);
+void strings_end(string_iterator *it);
+void strings_slab_occupancy(strings *strs, unsigned int *used, unsigned int *capacity);
 void strings_renumber(strings *strs);
+int strings_save(strings *strs, const char *path);
+int strings_verify_mapped(strings *strs);
+int strings_merge_overlay(strings *strs, const char *path);
+int strings_log_open(strings *strs, const char *path, unsigned int group);
+int strings_log_sync(strings *strs);
+int strings_log_close(strings *strs);
 
 char *strings_result_to_str(string_result sr);
 string_result strings_str_to_result(char *s);
@@ -0,0 +1,507 @@
+/*
+ *  Copyright 2025 Patrick Head
+ */
+
+/*
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "libstrings.h"
+
+#define DEFAULT_COUNT 1000000
+#define PREFIX "https://host7.example.com/"
+#define HOT_KEYS 256
+#define LOCAL_MERGE 65536
+#define SNAPSHOT_PATH "bench-strings.snapshot"
+#define LOG_PATH "bench-strings.log"
+#define LOG_KEYS 10000
+
+typedef struct
+{
+  strings *strs;
+  pthread_mutex_t *lock;
+  int local;
+  char **keys;
+  unsigned int count;
+  unsigned int thread;
+  unsigned int threads;
+} intern_job;
+
+void count_node(avl_node *n);
+double now(void);
+char **make_keys(unsigned int count);
+void bench_order(string_order order, char **keys, unsigned int count);
+double bench_batch(string_order order, char **keys, unsigned int count, unsigned int threads);
+void bench_threads(char **keys, unsigned int count);
+void bench_mapped(char **keys, unsigned int count);
+void bench_logged(char **keys, unsigned int count);
+double bench_log_add(char **keys, unsigned int count, unsigned int group);
+double bench_intern(strings *strs, pthread_mutex_t *lock, int local, char **keys, unsigned int count, unsigned int threads);
+void *intern_worker(void *arg);
+
+unsigned int counted;
+unsigned int threads;
+
+int main(int argc, char **argv)
+{
+  unsigned int count = DEFAULT_COUNT;
+  char **keys;
+  unsigned int i;
+  long cpus;
+  int opt;
+
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  threads = cpus > 0 ? (unsigned int)cpus : 1;
+
+  while ((opt = getopt(argc, argv, "n:t:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n':
+        count = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        threads = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n count] [-t threads]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  keys = make_keys(count);
+  if (!keys)
+  {
+    fprintf(stderr, "make_keys() failed\n");
+    return 1;
+  }
+
+  printf("Bench:  strings, %u URL keys, %u threads\n", count, threads);
+  printf("%-6s %10s %10s %10s %10s %10s %10s %10s\n",
+         "order", "add", "batch", "parallel", "walk", "find", "prefix", "remove");
+
+  bench_order(string_order_avl, keys, count);
+  bench_order(string_order_btree, keys, count);
+  bench_order(string_order_art, keys, count);
+
+  bench_threads(keys, count);
+  bench_mapped(keys, count);
+  bench_logged(keys, count);
+
+  for (i = 0; i < count; i++) free(keys[i]);
+  free(keys);
+
+  return 0;
+}
+
+  /*
+   *  Times each ordered index operation over all keys, in seconds, through
+   *  the public calls, so every order is measured the same way
+   */
+
+void bench_order(string_order order, char **keys, unsigned int count)
+{
+  static const char *names[] = { "avl", "btree", "art" };
+  strings *strs;
+  string_cursor *cursor;
+  double t, t_add, t_batch, t_parallel, t_walk, t_find, t_prefix, t_remove;
+  unsigned int i, found = 0;
+
+  strs = strings_new_with_order(order);
+  if (!strs)
+  {
+    printf("%-6s strings_new_with_order() failed\n", names[order]);
+    return;
+  }
+
+  t = now();
+  for (i = 0; i < count; i++) strings_add_n(strs, keys[i], strlen(keys[i]));
+  t_add = now() - t;
+
+  t_batch = bench_batch(order, keys, count, 1);
+  t_parallel = bench_batch(order, keys, count, threads);
+
+  counted = 0;
+  t = now();
+  strings_walk(strs, string_text, count_node);
+  t_walk = now() - t;
+
+  t = now();
+  for (i = 0; i < count; i++)
+    if (strings_find_by_text_n(strs, keys[i], strlen(keys[i]))) ++found;
+  t_find = now() - t;
+
+    /*
+     *  One host's keys, as an autocomplete or namespace listing would ask
+     */
+
+  counted = 0;
+  t = now();
+  cursor = string_cursor_new();
+  while (cursor && strings_find_prefix(strs, PREFIX, strlen(PREFIX), cursor)) ++counted;
+  string_cursor_free(cursor);
+  t_prefix = now() - t;
+
+  t = now();
+  for (i = 0; i < count; i++) strings_remove(strs, keys[i]);
+  t_remove = now() - t;
+
+  printf("%-6s %10.4f %10.4f %10.4f %10.4f %10.4f %10.4f %10.4f\n",
+         names[order], t_add, t_batch, t_parallel, t_walk, t_find, t_prefix, t_remove);
+
+  if (counted != count / 16 + (count % 16 > 7))
+    printf("%-6s prefix matched %u keys\n", names[order], counted);
+  if (found != count) printf("%-6s found only %u keys\n", names[order], found);
+
+  strings_free(strs);
+}
+
+  /*
+   *  Times strings_add_batch_parallel() of all keys into an empty table, -1
+   *  on failure; one thread is plain strings_add_batch()
+   */
+
+double bench_batch(string_order order, char **keys, unsigned int count, unsigned int threads)
+{
+  strings *strs;
+  double t;
+  string_result sr;
+
+  strs = strings_new_with_order(order);
+  if (!strs) return -1;
+
+  t = now();
+  sr = strings_add_batch_parallel(strs, (const char **)keys, NULL, count, NULL, threads);
+  t = now() - t;
+
+  strings_free(strs);
+
+  return sr == string_found ? t : -1;
+}
+
+  /*
+   *  Times concurrent strings_intern() into an AVL ordered table behind one
+   *  mutex, a sharded concurrent table and a lock-free table, and through
+   *  thread-local interners merging into a lock-free table, at doubling
+   *  thread counts up to -t
+   */
+
+void bench_threads(char **keys, unsigned int count)
+{
+  pthread_mutex_t lock;
+  strings *strs;
+  double t_mutex, t_sharded, t_lockfree, t_local;
+  unsigned int t;
+
+  if (pthread_mutex_init(&lock, NULL)) return;
+
+  printf("\nThreads:  %u interns, every other one of %u hot keys\n", 2 * count, HOT_KEYS);
+  printf("%-7s %10s %10s %10s %10s\n", "threads", "mutex", "sharded", "lock-free", "local");
+
+  for (t = 1; t <= threads; t = t * 2 > threads && t < threads ? threads : t * 2)
+  {
+    strs = strings_new_with_order(string_order_avl);
+    t_mutex = bench_intern(strs, &lock, 0, keys, count, t);
+    strings_free(strs);
+
+    strs = strings_new_concurrent(string_order_avl, 0);
+    t_sharded = bench_intern(strs, NULL, 0, keys, count, t);
+    strings_free(strs);
+
+    strs = strings_new_lock_free(string_order_avl);
+    t_lockfree = bench_intern(strs, NULL, 0, keys, count, t);
+    strings_free(strs);
+
+    strs = strings_new_lock_free(string_order_avl);
+    t_local = bench_intern(strs, NULL, 1, keys, count, t);
+    strings_free(strs);
+
+    printf("%-7u %10.4f %10.4f %10.4f %10.4f\n", t, t_mutex, t_sharded, t_lockfree, t_local);
+  }
+
+  pthread_mutex_destroy(&lock);
+}
+
+  /*
+   *  Times strings_save() and strings_open_mapped() of a table of all keys,
+   *  and finding each key by text in the mapped table and in the table it
+   *  was saved from
+   */
+
+void bench_mapped(char **keys, unsigned int count)
+{
+  strings *strs;
+  strings *mapped = NULL;
+  double t_save, t_open = -1, t_find = -1, t_memory;
+  unsigned int i, found = 0;
+
+  strs = strings_new_with_order(string_order_avl);
+  if (!strs) return;
+
+  for (i = 0; i < count; i++) strings_add_n(strs, keys[i], strlen(keys[i]));
+
+  t_save = now();
+  if (strings_save(strs, SNAPSHOT_PATH)) t_save = -1;
+  else t_save = now() - t_save;
+
+  if (t_save >= 0)
+  {
+    t_open = now();
+    mapped = strings_open_mapped(SNAPSHOT_PATH);
+    t_open = mapped ? now() - t_open : -1;
+  }
+
+  if (mapped)
+  {
+    t_find = now();
+    for (i = 0; i < count; i++)
+      if (strings_find_by_text_n(mapped, keys[i], strlen(keys[i]))) ++found;
+    t_find = now() - t_find;
+  }
+
+  t_memory = now();
+  for (i = 0; i < count; i++) strings_find_by_text_n(strs, keys[i], strlen(keys[i]));
+  t_memory = now() - t_memory;
+
+  printf("\nMapped:  %u keys\n", count);
+  printf("%10s %10s %10s %10s\n", "save", "open", "find", "in memory");
+  printf("%10.4f %10.4f %10.4f %10.4f\n", t_save, t_open, t_find, t_memory);
+
+  if (mapped && found != count) printf("mapped found only %u keys\n", found);
+
+  strings_free(mapped);
+  strings_free(strs);
+  remove(SNAPSHOT_PATH);
+}
+
+  /*
+   *  Times adding up to LOG_KEYS keys with no write-ahead log, with a sync
+   *  per record and with one per 64 records, then replaying the log
+   */
+
+void bench_logged(char **keys, unsigned int count)
+{
+  strings *strs;
+  double t_none, t_one, t_group, t_replay = -1;
+
+  if (count > LOG_KEYS) count = LOG_KEYS;
+
+  t_none = bench_log_add(keys, count, 0);
+  t_one = bench_log_add(keys, count, 1);
+  t_group = bench_log_add(keys, count, 64);
+
+  strs = strings_new_with_order(string_order_avl);
+  if (strs && t_group >= 0)
+  {
+    t_replay = now();
+    if (strings_log_open(strs, LOG_PATH, 64)) t_replay = -1;
+    else t_replay = now() - t_replay;
+
+    if (t_replay >= 0 && strs->id_index_used != count)
+      printf("replay found only %u keys\n", strs->id_index_used);
+  }
+
+  printf("\nLogged:  %u keys\n", count);
+  printf("%10s %10s %10s %10s\n", "no log", "group 1", "group 64", "replay");
+  printf("%10.4f %10.4f %10.4f %10.4f\n", t_none, t_one, t_group, t_replay);
+
+  strings_free(strs);
+  remove(LOG_PATH);
+}
+
+  /*
+   *  Times adding @p count keys to a new table, -1 on failure; with @p group
+   *  set the table logs to a fresh write-ahead log syncing every @p group
+   *  records, and closes it in the time
+   */
+
+double bench_log_add(char **keys, unsigned int count, unsigned int group)
+{
+  strings *strs;
+  double t;
+  unsigned int i;
+
+  strs = strings_new_with_order(string_order_avl);
+  if (!strs) return -1;
+
+  remove(LOG_PATH);
+
+  t = now();
+
+  if (group && strings_log_open(strs, LOG_PATH, group)) t = -1;
+
+  if (t >= 0)
+  {
+    for (i = 0; i < count; i++) strings_add_n(strs, keys[i], strlen(keys[i]));
+    if (group && strings_log_close(strs)) t = -1;
+  }
+
+  if (t >= 0) t = now() - t;
+
+  strings_free(strs);
+
+  return t;
+}
+
+  /*
+   *  Times @p threads threads sharing 2 * @p count interns into @p strs, -1
+   *  on failure; each strings_intern() is under @p lock unless it is NULL,
+   *  and with @p local set each thread interns through its own
+   *  thread-local interner
+   */
+
+double bench_intern(strings *strs, pthread_mutex_t *lock, int local, char **keys, unsigned int count, unsigned int threads)
+{
+  intern_job *jobs;
+  pthread_t *tids;
+  double t = -1;
+  unsigned int i, started;
+
+  if (!strs) return -1;
+
+  jobs = calloc(threads, sizeof(intern_job));
+  tids = calloc(threads, sizeof(pthread_t));
+  if (!jobs || !tids) goto exit;
+
+  for (i = 0; i < threads; i++)
+  {
+    jobs[i].strs = strs;
+    jobs[i].lock = lock;
+    jobs[i].local = local;
+    jobs[i].keys = keys;
+    jobs[i].count = count;
+    jobs[i].thread = i;
+    jobs[i].threads = threads;
+  }
+
+  t = now();
+
+  for (started = 0; started < threads; started++)
+    if (pthread_create(&tids[started], NULL, intern_worker, &jobs[started])) break;
+
+  for (i = 0; i < started; i++) pthread_join(tids[i], NULL);
+
+  t = started == threads ? now() - t : -1;
+
+exit:
+  free(jobs);
+  free(tids);
+
+  return t;
+}
+
+  /*
+   *  One thread's share of the interns: the threads take turns along one
+   *  stream, so they meet on the hot keys and on each new key at once
+   */
+
+void *intern_worker(void *arg)
+{
+  intern_job *job = arg;
+  string_local *local = NULL;
+  unsigned int *remap;
+  const char *key;
+  unsigned int j, k;
+
+  if (job->local)
+  {
+    local = strings_local_new(job->strs);
+    if (!local) return NULL;
+  }
+
+  for (k = 0, j = job->thread; j < 2 * job->count; k++, j += job->threads)
+  {
+    key = job->keys[(k & 1) ? j % HOT_KEYS : (j / 2) % job->count];
+
+    if (local) strings_local_intern(local, key, strlen(key), NULL);
+    else
+    {
+      if (job->lock) pthread_mutex_lock(job->lock);
+      strings_intern(job->strs, key, strlen(key), NULL);
+      if (job->lock) pthread_mutex_unlock(job->lock);
+    }
+
+      /*
+       *  A real caller would translate the local ids it kept
+       */
+
+    if (local && (k % LOCAL_MERGE == LOCAL_MERGE - 1 || j + job->threads >= 2 * job->count))
+    {
+      remap = malloc((strings_local_count(local) + 1) * sizeof(unsigned int));
+      strings_local_merge(local, remap);
+      free(remap);
+    }
+  }
+
+  strings_local_free(local);
+
+  return NULL;
+}
+
+  /*
+   *  URL like keys: few hosts, deep shared paths, a varying tail
+   */
+
+char **make_keys(unsigned int count)
+{
+  char buf[128];
+  char **keys;
+  unsigned int i;
+
+  keys = malloc(count * sizeof(char *));
+  if (!keys) return NULL;
+
+  srand(1);
+
+  for (i = 0; i < count; i++)
+  {
+    snprintf(buf,
+             sizeof(buf),
+             "https://host%u.example.com/api/v2/resources/%u/items/%u",
+             i % 16,
+             (unsigned int)rand() % 1000,
+             i);
+    keys[i] = strdup(buf);
+    if (!keys[i])
+    {
+      while (i) free(keys[--i]);
+      free(keys);
+      return NULL;
+    }
+  }
+
+  return keys;
+}
+
+double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void count_node(avl_node *n)
+{
+  if (n) ++counted;
+}
@@ -0,0 +1,1314 @@
+/*
+ *  Copyright 2021,2022,2024,2025 Patrick T. Head
+ *
+ *  This program is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  @file strings-art.c
+ *
+ *  @brief adaptive radix tree ordered text index for libstrings
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "strings-art.h"
+
+  /**
+   *  @def ART_NODE256
+   *
+   *  @brief type of a 256 way node, which does not fit the type byte
+   */
+
+#define ART_NODE256 0
+
+  /**
+   *  @def IS_ENTRY
+   *
+   *  @brief non-zero if child pointer @p p is a tagged entry
+   */
+
+#define IS_ENTRY(p) ((uintptr_t)(p) & 1)
+
+  /**
+   *  @def TO_ENTRY
+   *
+   *  @brief entry of tagged child pointer @p p
+   */
+
+#define TO_ENTRY(p) ((string_node *)((uintptr_t)(p) & ~(uintptr_t)1))
+
+  /**
+   *  @def TAG_ENTRY
+   *
+   *  @brief tagged child pointer of entry @p sn
+   */
+
+#define TAG_ENTRY(sn) ((void *)((uintptr_t)(sn) | 1))
+
+  /**
+   *  @typedef struct art_node4 art_node4
+   *
+   *  @brief inner node with up to 4 children, keys sorted
+   */
+
+typedef struct
+{
+  string_art_node n;         /**<   node header          */
+  unsigned char key[4];      /**<   child key bytes      */
+  void *child[4];            /**<   children             */
+} art_node4;
+
+  /**
+   *  @typedef struct art_node16 art_node16
+   *
+   *  @brief inner node with up to 16 children, keys sorted
+   */
+
+typedef struct
+{
+  string_art_node n;         /**<   node header          */
+  unsigned char key[16];     /**<   child key bytes      */
+  void *child[16];           /**<   children             */
+} art_node16;
+
+  /**
+   *  @typedef struct art_node48 art_node48
+   *
+   *  @brief inner node with up to 48 children, indexed by key byte
+   */
+
+typedef struct
+{
+  string_art_node n;         /**<   node header                              */
+  unsigned char index[256];  /**<   child slot + 1 for each key byte, or 0   */
+  void *child[48];           /**<   children                                 */
+} art_node48;
+
+  /**
+   *  @typedef struct art_node256 art_node256
+   *
+   *  @brief inner node with a child slot for every key byte
+   */
+
+typedef struct
+{
+  string_art_node n;         /**<   node header          */
+  void *child[256];          /**<   children             */
+} art_node256;
+
+static string_art_node *node_new(unsigned char type);
+static void node_free(void *p);
+static void **node_find_child(string_art_node *n, unsigned char c);
+static int node_add_child(void **ref, unsigned char c, void *child);
+static void node_remove_child(string_art_node *n, unsigned char c);
+static void node_shrink(void **ref);
+static string_node *node_minimum(void *p);
+static string_node *node_maximum(void *p);
+static void *node_child_after(string_art_node *n, int c);
+static void *node_child_before(string_art_node *n, int c);
+static int node_prefix_compare(string_art_node *n,
+                               const char *text,
+                               size_t len,
+                               size_t depth);
+static size_t node_prefix_mismatch(string_art_node *n,
+                                   const char *text,
+                                   size_t len,
+                                   size_t depth);
+static int insert_rec(void **ref, string_node *sn, size_t depth);
+static int delete_rec(void **ref, string_node *sn, size_t depth);
+static int walk_rec(void *p, string_walk_action action, void *ctx);
+static string_node *seek_rec(void *p,
+                             const char *text,
+                             size_t len,
+                             size_t depth,
+                             int forward,
+                             int inclusive);
+static int entry_equal(string_node *sn, const char *text, size_t len);
+
+  /**
+   *  @fn string_art *string_art_new(void)
+   *
+   *  @brief create a new, empty @a string_art struct
+   *
+   *  @par Parameters
+   *  None.
+   *
+   *  @return pointer to new @a string_art struct
+   */
+
+string_art *string_art_new(void)
+{
+  string_art *art;
+
+  art = malloc(sizeof(string_art));
+  if (art) memset(art, 0, sizeof(string_art));
+
+  return art;
+}
+
+  /**
+   *  @fn void string_art_free(string_art *art)
+   *
+   *  @brief frees all nodes of @p art, but not the entries they index
+   *
+   *  @param art - pointer to existing @a string_art struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void string_art_free(string_art *art)
+{
+  if (!art) return;
+
+  node_free(art->root);
+
+  free(art);
+}
+
+  /**
+   *  @fn int string_art_insert(string_art *art, string_node *sn)
+   *
+   *  @brief adds entry @p sn to @p art
+   *
+   *  @param art - pointer to existing @a string_art struct
+   *  @param sn  - pointer to entry with text and len set
+   *
+   *  @return 0 on success, non-zero if @p sn is a duplicate or on failure
+   */
+
+int string_art_insert(string_art *art, string_node *sn)
+{
+  if (!art || !sn) return 1;
+
+  if (insert_rec(&art->root, sn, 0)) return 1;
+
+  ++art->n_entries;
+
+  return 0;
+}
+
+  /**
+   *  @fn int string_art_delete(string_art *art, string_node *sn)
+   *
+   *  @brief removes entry @p sn from @p art
+   *
+   *  Nodes left with too few children shrink to the next smaller type, and
+   *  a node left with one child and no entry is merged into that child.
+   *
+   *  @param art - pointer to existing @a string_art struct
+   *  @param sn  - pointer to entry in @p art
+   *
+   *  @return 0 on success, non-zero if @p sn was not found
+   */
+
+int string_art_delete(string_art *art, string_node *sn)
+{
+  if (!art || !sn || !art->root) return 1;
+
+  if (delete_rec(&art->root, sn, 0)) return 1;
+
+  --art->n_entries;
+
+  return 0;
+}
+
+  /**
+   *  @fn string_node *string_art_find(string_art *art, const char *text, size_t len)
+   *
+   *  @brief finds the entry with text @p text in @p art
+   *
+   *  Compressed path bytes beyond STRING_ART_PREFIX are skipped on the way
+   *  down and checked once against the entry found.
+   *
+   *  @param art  - pointer to existing @a string_art struct
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return pointer to entry, NULL if not found
+   */
+
+string_node *string_art_find(string_art *art, const char *text, size_t len)
+{
+  string_art_node *n;
+  void **child;
+  void *p;
+  size_t depth = 0;
+  size_t i, m;
+
+  if (!art || !text) return NULL;
+
+  p = art->root;
+
+  while (p)
+  {
+    if (IS_ENTRY(p))
+      return entry_equal(TO_ENTRY(p), text, len) ? TO_ENTRY(p) : NULL;
+
+    n = (string_art_node *)p;
+
+    if (n->plen)
+    {
+      m = n->plen < STRING_ART_PREFIX ? n->plen : STRING_ART_PREFIX;
+      for (i = 0; i < m; i++)
+        if (depth + i >= len || (unsigned char)text[depth + i] != n->prefix[i]) return NULL;
+      depth += n->plen;
+    }
+
+    if (depth > len) return NULL;
+
+    if (depth == len)
+      return n->value && entry_equal(n->value, text, len) ? n->value : NULL;
+
+    child = node_find_child(n, (unsigned char)text[depth]);
+    if (!child) return NULL;
+
+    p = *child;
+    ++depth;
+  }
+
+  return NULL;
+}
+
+  /**
+   *  @fn int string_art_walk(string_art *art, string_walk_action action, void *ctx)
+   *
+   *  @brief calls @p action for each entry of @p art in text order
+   *
+   *  @param art    - pointer to existing @a string_art struct
+   *  @param action - pointer to function to call at each entry, returning
+   *                  non-zero to stop the walk
+   *  @param ctx    - pointer passed to @p action
+   *
+   *  @return 0 if every entry was visited, else the value that stopped it
+   */
+
+int string_art_walk(string_art *art, string_walk_action action, void *ctx)
+{
+  if (!art || !action) return 0;
+
+  return walk_rec(art->root, action, ctx);
+}
+
+  /**
+   *  @fn string_node *string_art_seek(string_art *art, const char *text, size_t len, int forward, int inclusive)
+   *
+   *  @brief finds the entry of @p art nearest to @p text in one direction
+   *
+   *  @param art       - pointer to existing @a string_art struct
+   *  @param text      - pointer to text, NULL for the first (or last) entry
+   *  @param len       - length of @p text in bytes
+   *  @param forward   - non-zero for the first entry after @p text, zero for
+   *                     the last entry before it
+   *  @param inclusive - non-zero if an entry equal to @p text qualifies
+   *
+   *  @return pointer to entry, NULL if there is none
+   */
+
+string_node *string_art_seek(string_art *art,
+                             const char *text,
+                             size_t len,
+                             int forward,
+                             int inclusive)
+{
+  if (!art || !art->root) return NULL;
+
+  if (!text) return forward ? node_minimum(art->root) : node_maximum(art->root);
+
+  return seek_rec(art->root, text, len, 0, forward, inclusive);
+}
+
+  /**
+   *  @fn string_art_node *node_new(unsigned char type)
+   *
+   *  @brief create a new, empty inner node
+   *
+   *  @param type - 4, 16, 48 or ART_NODE256
+   *
+   *  @return pointer to new node, NULL on failure
+   */
+
+static string_art_node *node_new(unsigned char type)
+{
+  string_art_node *n;
+  size_t size;
+
+  switch (type)
+  {
+    case 4: size = sizeof(art_node4); break;
+    case 16: size = sizeof(art_node16); break;
+    case 48: size = sizeof(art_node48); break;
+    default: size = sizeof(art_node256); break;
+  }
+
+  n = malloc(size);
+  if (!n) return NULL;
+
+  memset(n, 0, size);
+  n->type = type;
+
+  return n;
+}
+
+  /**
+   *  @fn void node_free(void *p)
+   *
+   *  @brief frees inner node @p p and all inner nodes below it
+   *
+   *  @param p - child pointer, entries and NULL are ignored
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void node_free(void *p)
+{
+  string_art_node *n;
+  unsigned int i;
+
+  if (!p || IS_ENTRY(p)) return;
+
+  n = (string_art_node *)p;
+
+  switch (n->type)
+  {
+    case 4:
+      for (i = 0; i < n->count; i++) node_free(((art_node4 *)n)->child[i]);
+      break;
+    case 16:
+      for (i = 0; i < n->count; i++) node_free(((art_node16 *)n)->child[i]);
+      break;
+    case 48:
+      for (i = 0; i < 48; i++) node_free(((art_node48 *)n)->child[i]);
+      break;
+    default:
+      for (i = 0; i < 256; i++) node_free(((art_node256 *)n)->child[i]);
+      break;
+  }
+
+  free(n);
+}
+
+  /**
+   *  @fn void **node_find_child(string_art_node *n, unsigned char c)
+   *
+   *  @brief finds the child of @p n for key byte @p c
+   *
+   *  @param n - pointer to existing inner node
+   *  @param c - key byte
+   *
+   *  @return pointer to child slot, NULL if there is no such child
+   */
+
+static void **node_find_child(string_art_node *n, unsigned char c)
+{
+  art_node4 *n4;
+  art_node16 *n16;
+  art_node48 *n48;
+  art_node256 *n256;
+  unsigned int i;
+
+  switch (n->type)
+  {
+    case 4:
+      n4 = (art_node4 *)n;
+      for (i = 0; i < n->count; i++)
+        if (n4->key[i] == c) return &n4->child[i];
+      break;
+
+    case 16:
+      n16 = (art_node16 *)n;
+      for (i = 0; i < n->count && n16->key[i] <= c; i++)
+        if (n16->key[i] == c) return &n16->child[i];
+      break;
+
+    case 48:
+      n48 = (art_node48 *)n;
+      if (n48->index[c]) return &n48->child[n48->index[c] - 1];
+      break;
+
+    default:
+      n256 = (art_node256 *)n;
+      if (n256->child[c]) return &n256->child[c];
+      break;
+  }
+
+  return NULL;
+}
+
+  /**
+   *  @fn int node_add_child(void **ref, unsigned char c, void *child)
+   *
+   *  @brief adds @p child under key byte @p c to the node at @p ref
+   *
+   *  A full node is replaced by one of the next larger type.
+   *
+   *  @param ref   - pointer to slot holding existing inner node
+   *  @param c     - key byte, not already present
+   *  @param child - child pointer
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int node_add_child(void **ref, unsigned char c, void *child)
+{
+  string_art_node *n;
+  string_art_node *g;
+  art_node4 *n4;
+  art_node16 *n16;
+  art_node48 *n48;
+  unsigned int i;
+
+  n = (string_art_node *)*ref;
+
+  switch (n->type)
+  {
+    case 4:
+      n4 = (art_node4 *)n;
+      if (n->count < 4)
+      {
+        for (i = 0; i < n->count && n4->key[i] < c; i++)
+          ;
+        memmove(&n4->key[i + 1], &n4->key[i], n->count - i);
+        memmove(&n4->child[i + 1], &n4->child[i], (n->count - i) * sizeof(void *));
+        n4->key[i] = c;
+        n4->child[i] = child;
+        ++n->count;
+        return 0;
+      }
+
+      g = node_new(16);
+      if (!g) return 1;
+      memcpy(g, n, sizeof(string_art_node));
+      g->type = 16;
+      memcpy(((art_node16 *)g)->key, n4->key, 4);
+      memcpy(((art_node16 *)g)->child, n4->child, 4 * sizeof(void *));
+      break;
+
+    case 16:
+      n16 = (art_node16 *)n;
+      if (n->count < 16)
+      {
+        for (i = 0; i < n->count && n16->key[i] < c; i++)
+          ;
+        memmove(&n16->key[i + 1], &n16->key[i], n->count - i);
+        memmove(&n16->child[i + 1], &n16->child[i], (n->count - i) * sizeof(void *));
+        n16->key[i] = c;
+        n16->child[i] = child;
+        ++n->count;
+        return 0;
+      }
+
+      g = node_new(48);
+      if (!g) return 1;
+      memcpy(g, n, sizeof(string_art_node));
+      g->type = 48;
+      for (i = 0; i < 16; i++)
+      {
+        ((art_node48 *)g)->index[n16->key[i]] = i + 1;
+        ((art_node48 *)g)->child[i] = n16->child[i];
+      }
+      break;
+
+    case 48:
+      n48 = (art_node48 *)n;
+      if (n->count < 48)
+      {
+        for (i = 0; n48->child[i]; i++)
+          ;
+        n48->index[c] = i + 1;
+        n48->child[i] = child;
+        ++n->count;
+        return 0;
+      }
+
+      g = node_new(ART_NODE256);
+      if (!g) return 1;
+      memcpy(g, n, sizeof(string_art_node));
+      g->type = ART_NODE256;
+      for (i = 0; i < 256; i++)
+        if (n48->index[i]) ((art_node256 *)g)->child[i] = n48->child[n48->index[i] - 1];
+      break;
+
+    default:
+      ((art_node256 *)n)->child[c] = child;
+      ++n->count;
+      return 0;
+  }
+
+    /*
+     *  Grown node takes the place of the full one, then has room for @p child
+     */
+
+  free(n);
+  *ref = g;
+
+  return node_add_child(ref, c, child);
+}
+
+  /**
+   *  @fn void node_remove_child(string_art_node *n, unsigned char c)
+   *
+   *  @brief removes the child of @p n for key byte @p c
+   *
+   *  @param n - pointer to existing inner node
+   *  @param c - key byte, present in @p n
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void node_remove_child(string_art_node *n, unsigned char c)
+{
+  art_node4 *n4;
+  art_node16 *n16;
+  art_node48 *n48;
+  unsigned int i;
+
+  switch (n->type)
+  {
+    case 4:
+      n4 = (art_node4 *)n;
+      for (i = 0; n4->key[i] != c; i++)
+        ;
+      memmove(&n4->key[i], &n4->key[i + 1], n->count - i - 1);
+      memmove(&n4->child[i], &n4->child[i + 1], (n->count - i - 1) * sizeof(void *));
+      break;
+
+    case 16:
+      n16 = (art_node16 *)n;
+      for (i = 0; n16->key[i] != c; i++)
+        ;
+      memmove(&n16->key[i], &n16->key[i + 1], n->count - i - 1);
+      memmove(&n16->child[i], &n16->child[i + 1], (n->count - i - 1) * sizeof(void *));
+      break;
+
+    case 48:
+      n48 = (art_node48 *)n;
+      n48->child[n48->index[c] - 1] = NULL;
+      n48->index[c] = 0;
+      break;
+
+    default:
+      ((art_node256 *)n)->child[c] = NULL;
+      break;
+  }
+
+  --n->count;
+}
+
+  /**
+   *  @fn void node_shrink(void **ref)
+   *
+   *  @brief restores the shape of the node at @p ref after a removal
+   *
+   *  A node left with no children becomes its entry, one left with a single
+   *  child and no entry is merged into the child, and a node far below its
+   *  capacity is replaced by one of the next smaller type.
+   *
+   *  @param ref - pointer to slot holding existing inner node
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void node_shrink(void **ref)
+{
+  string_art_node *n;
+  string_art_node *s = NULL;
+  string_art_node *cn;
+  art_node48 *n48;
+  void *child = NULL;
+  unsigned char c = 0;
+  unsigned char prefix[STRING_ART_PREFIX];
+  size_t m, k;
+  unsigned int i, j;
+
+  n = (string_art_node *)*ref;
+
+  if (!n->count)
+  {
+    *ref = n->value ? TAG_ENTRY(n->value) : NULL;
+    free(n);
+    return;
+  }
+
+  if (n->count == 1 && !n->value)
+  {
+    switch (n->type)
+    {
+      case 4: c = ((art_node4 *)n)->key[0]; child = ((art_node4 *)n)->child[0]; break;
+      case 16: c = ((art_node16 *)n)->key[0]; child = ((art_node16 *)n)->child[0]; break;
+      case 48:
+        n48 = (art_node48 *)n;
+        for (i = 0; !n48->index[i]; i++)
+          ;
+        c = (unsigned char)i;
+        child = n48->child[n48->index[i] - 1];
+        break;
+      default:
+        for (i = 0; !((art_node256 *)n)->child[i]; i++)
+          ;
+        c = (unsigned char)i;
+        child = ((art_node256 *)n)->child[i];
+        break;
+    }
+
+      /*
+       *  Child inherits this node's path and key byte in front of its own
+       */
+
+    if (!IS_ENTRY(child))
+    {
+      cn = (string_art_node *)child;
+
+      m = n->plen < STRING_ART_PREFIX ? n->plen : STRING_ART_PREFIX;
+      memcpy(prefix, n->prefix, m);
+
+      if (m < STRING_ART_PREFIX) prefix[m++] = c;
+
+      k = cn->plen < STRING_ART_PREFIX - m ? cn->plen : STRING_ART_PREFIX - m;
+      memcpy(prefix + m, cn->prefix, k);
+
+      memcpy(cn->prefix, prefix, m + k);
+      cn->plen += n->plen + 1;
+    }
+
+    *ref = child;
+    free(n);
+    return;
+  }
+
+  switch (n->type)
+  {
+    case 16:
+      if (n->count > 3) return;
+      s = node_new(4);
+      if (!s) return;
+      memcpy(s, n, sizeof(string_art_node));
+      s->type = 4;
+      memcpy(((art_node4 *)s)->key, ((art_node16 *)n)->key, n->count);
+      memcpy(((art_node4 *)s)->child, ((art_node16 *)n)->child, n->count * sizeof(void *));
+      break;
+
+    case 48:
+      if (n->count > 12) return;
+      s = node_new(16);
+      if (!s) return;
+      memcpy(s, n, sizeof(string_art_node));
+      s->type = 16;
+      n48 = (art_node48 *)n;
+      for (i = 0, j = 0; i < 256; i++)
+        if (n48->index[i])
+        {
+          ((art_node16 *)s)->key[j] = (unsigned char)i;
+          ((art_node16 *)s)->child[j++] = n48->child[n48->index[i] - 1];
+        }
+      break;
+
+    case ART_NODE256:
+      if (n->count > 37) return;
+      s = node_new(48);
+      if (!s) return;
+      memcpy(s, n, sizeof(string_art_node));
+      s->type = 48;
+      for (i = 0, j = 0; i < 256; i++)
+        if (((art_node256 *)n)->child[i])
+        {
+          ((art_node48 *)s)->index[i] = j + 1;
+          ((art_node48 *)s)->child[j++] = ((art_node256 *)n)->child[i];
+        }
+      break;
+
+    default:
+      return;
+  }
+
+  free(n);
+  *ref = s;
+}
+
+  /**
+   *  @fn string_node *node_minimum(void *p)
+   *
+   *  @brief finds first entry in text order at or below @p p
+   *
+   *  @param p - non-NULL child pointer
+   *
+   *  @return pointer to entry
+   */
+
+static string_node *node_minimum(void *p)
+{
+  string_art_node *n;
+  art_node48 *n48;
+  unsigned int i;
+
+  while (!IS_ENTRY(p))
+  {
+    n = (string_art_node *)p;
+
+    if (n->value) return n->value;
+
+    switch (n->type)
+    {
+      case 4: p = ((art_node4 *)n)->child[0]; break;
+      case 16: p = ((art_node16 *)n)->child[0]; break;
+      case 48:
+        n48 = (art_node48 *)n;
+        for (i = 0; !n48->index[i]; i++)
+          ;
+        p = n48->child[n48->index[i] - 1];
+        break;
+      default:
+        for (i = 0; !((art_node256 *)n)->child[i]; i++)
+          ;
+        p = ((art_node256 *)n)->child[i];
+        break;
+    }
+  }
+
+  return TO_ENTRY(p);
+}
+
+  /**
+   *  @fn string_node *node_maximum(void *p)
+   *
+   *  @brief finds last entry in text order at or below @p p
+   *
+   *  @param p - non-NULL child pointer
+   *
+   *  @return pointer to entry
+   */
+
+static string_node *node_maximum(void *p)
+{
+  string_art_node *n;
+  void *child;
+
+  while (!IS_ENTRY(p))
+  {
+    n = (string_art_node *)p;
+
+    child = node_child_before(n, 256);
+    if (!child) return n->value;
+
+    p = child;
+  }
+
+  return TO_ENTRY(p);
+}
+
+  /**
+   *  @fn void *node_child_after(string_art_node *n, int c)
+   *
+   *  @brief finds the first child of @p n with key byte greater than @p c
+   *
+   *  @param n - pointer to existing inner node
+   *  @param c - key byte, -1 for the first child
+   *
+   *  @return child pointer, NULL if there is none
+   */
+
+static void *node_child_after(string_art_node *n, int c)
+{
+  art_node4 *n4;
+  art_node16 *n16;
+  art_node48 *n48;
+  unsigned int i;
+
+  switch (n->type)
+  {
+    case 4:
+      n4 = (art_node4 *)n;
+      for (i = 0; i < n->count; i++)
+        if (n4->key[i] > c) return n4->child[i];
+      break;
+
+    case 16:
+      n16 = (art_node16 *)n;
+      for (i = 0; i < n->count; i++)
+        if (n16->key[i] > c) return n16->child[i];
+      break;
+
+    case 48:
+      n48 = (art_node48 *)n;
+      for (i = c + 1; i < 256; i++)
+        if (n48->index[i]) return n48->child[n48->index[i] - 1];
+      break;
+
+    default:
+      for (i = c + 1; i < 256; i++)
+        if (((art_node256 *)n)->child[i]) return ((art_node256 *)n)->child[i];
+      break;
+  }
+
+  return NULL;
+}
+
+  /**
+   *  @fn void *node_child_before(string_art_node *n, int c)
+   *
+   *  @brief finds the last child of @p n with key byte less than @p c
+   *
+   *  @param n - pointer to existing inner node
+   *  @param c - key byte, 256 for the last child
+   *
+   *  @return child pointer, NULL if there is none
+   */
+
+static void *node_child_before(string_art_node *n, int c)
+{
+  art_node4 *n4;
+  art_node16 *n16;
+  art_node48 *n48;
+  int i;
+
+  switch (n->type)
+  {
+    case 4:
+      n4 = (art_node4 *)n;
+      for (i = n->count - 1; i >= 0; i--)
+        if (n4->key[i] < c) return n4->child[i];
+      break;
+
+    case 16:
+      n16 = (art_node16 *)n;
+      for (i = n->count - 1; i >= 0; i--)
+        if (n16->key[i] < c) return n16->child[i];
+      break;
+
+    case 48:
+      n48 = (art_node48 *)n;
+      for (i = c - 1; i >= 0; i--)
+        if (n48->index[i]) return n48->child[n48->index[i] - 1];
+      break;
+
+    default:
+      for (i = c - 1; i >= 0; i--)
+        if (((art_node256 *)n)->child[i]) return ((art_node256 *)n)->child[i];
+      break;
+  }
+
+  return NULL;
+}
+
+  /**
+   *  @fn int node_prefix_compare(string_art_node *n, const char *text, size_t len, size_t depth)
+   *
+   *  @brief compares @p text with the compressed path of @p n
+   *
+   *  Path bytes beyond STRING_ART_PREFIX are read from an entry below @p n.
+   *
+   *  @param n     - pointer to existing inner node
+   *  @param text  - pointer to text
+   *  @param len   - length of @p text in bytes
+   *  @param depth - offset in @p text of the compressed path
+   *
+   *  @return <0 if @p text sorts before every entry below @p n
+   *  @return >0 if @p text sorts after every entry below @p n
+   *  @return 0 if @p text continues through the whole path
+   */
+
+static int node_prefix_compare(string_art_node *n,
+                               const char *text,
+                               size_t len,
+                               size_t depth)
+{
+  string_node *sn = NULL;
+  unsigned char a, b;
+  size_t i;
+
+  for (i = 0; i < n->plen; i++)
+  {
+    if (depth + i >= len) return -1;
+
+    if (i < STRING_ART_PREFIX) b = n->prefix[i];
+    else
+    {
+      if (!sn) sn = node_minimum(n);
+      b = (unsigned char)sn->value.text[depth + i];
+    }
+
+    a = (unsigned char)text[depth + i];
+    if (a != b) return a < b ? -1 : 1;
+  }
+
+  return 0;
+}
+
+  /**
+   *  @fn size_t node_prefix_mismatch(string_art_node *n, const char *text, size_t len, size_t depth)
+   *
+   *  @brief finds how much of the compressed path of @p n @p text matches
+   *
+   *  Path bytes beyond STRING_ART_PREFIX are read from an entry below @p n.
+   *
+   *  @param n     - pointer to existing inner node
+   *  @param text  - pointer to text
+   *  @param len   - length of @p text in bytes
+   *  @param depth - offset in @p text of the compressed path
+   *
+   *  @return number of matching bytes, plen of @p n if the whole path matches
+   */
+
+static size_t node_prefix_mismatch(string_art_node *n,
+                                   const char *text,
+                                   size_t len,
+                                   size_t depth)
+{
+  string_node *sn;
+  size_t i, m;
+
+  m = n->plen < STRING_ART_PREFIX ? n->plen : STRING_ART_PREFIX;
+
+  for (i = 0; i < m; i++)
+    if (depth + i >= len || (unsigned char)text[depth + i] != n->prefix[i]) return i;
+
+  if (n->plen > STRING_ART_PREFIX)
+  {
+    sn = node_minimum(n);
+    for ( ; i < n->plen; i++)
+      if (depth + i >= len || text[depth + i] != sn->value.text[depth + i]) return i;
+  }
+
+  return n->plen;
+}
+
+  /**
+   *  @fn int insert_rec(void **ref, string_node *sn, size_t depth)
+   *
+   *  @brief inserts @p sn into the subtree at @p ref
+   *
+   *  @param ref   - pointer to slot holding child pointer, possibly NULL
+   *  @param sn    - pointer to entry to insert
+   *  @param depth - number of bytes of text of @p sn consumed above @p ref
+   *
+   *  @return 0 on success, non-zero if @p sn is a duplicate or on failure
+   */
+
+static int insert_rec(void **ref, string_node *sn, size_t depth)
+{
+  string_art_node *n;
+  string_art_node *nn;
+  string_node *e;
+  const char *text;
+  size_t len, i, m;
+  void **child;
+  unsigned char c;
+
+  text = sn->value.text;
+  len = sn->value.len;
+
+  if (!*ref)
+  {
+    *ref = TAG_ENTRY(sn);
+    return 0;
+  }
+
+    /*
+     *  An entry meets @p sn: a new node takes the path both share and
+     *  holds both below it
+     */
+
+  if (IS_ENTRY(*ref))
+  {
+    e = TO_ENTRY(*ref);
+    if (entry_equal(e, text, len)) return 1;
+
+    nn = node_new(4);
+    if (!nn) return 1;
+
+    m = e->value.len < len ? e->value.len : len;
+    for (i = depth; i < m && e->value.text[i] == text[i]; i++)
+      ;
+
+    nn->plen = i - depth;
+    memcpy(nn->prefix,
+           text + depth,
+           nn->plen < STRING_ART_PREFIX ? nn->plen : STRING_ART_PREFIX);
+
+    if (e->value.len == i) nn->value = e;
+    else node_add_child((void **)&nn, (unsigned char)e->value.text[i], TAG_ENTRY(e));
+
+    if (len == i) nn->value = sn;
+    else node_add_child((void **)&nn, (unsigned char)text[i], TAG_ENTRY(sn));
+
+    *ref = nn;
+    return 0;
+  }
+
+  n = (string_art_node *)*ref;
+
+  if (n->plen)
+  {
+    i = node_prefix_mismatch(n, text, len, depth);
+
+      /*
+       *  @p sn leaves the compressed path part way: split the path at the
+       *  first differing byte
+       */
+
+    if (i < n->plen)
+    {
+      nn = node_new(4);
+      if (!nn) return 1;
+
+      nn->plen = i;
+      memcpy(nn->prefix, n->prefix, i < STRING_ART_PREFIX ? i : STRING_ART_PREFIX);
+
+      if (n->plen <= STRING_ART_PREFIX)
+      {
+        c = n->prefix[i];
+        n->plen -= i + 1;
+        memmove(n->prefix, n->prefix + i + 1, n->plen);
+      }
+      else
+      {
+        e = node_minimum(n);
+        c = (unsigned char)e->value.text[depth + i];
+        n->plen -= i + 1;
+        memcpy(n->prefix,
+               e->value.text + depth + i + 1,
+               n->plen < STRING_ART_PREFIX ? n->plen : STRING_ART_PREFIX);
+      }
+
+      node_add_child((void **)&nn, c, n);
+
+      if (len == depth + i) nn->value = sn;
+      else node_add_child((void **)&nn, (unsigned char)text[depth + i], TAG_ENTRY(sn));
+
+      *ref = nn;
+      return 0;
+    }
+
+    depth += n->plen;
+  }
+
+  if (len == depth)
+  {
+    if (n->value) return 1;
+    n->value = sn;
+    return 0;
+  }
+
+  child = node_find_child(n, (unsigned char)text[depth]);
+  if (child) return insert_rec(child, sn, depth + 1);
+
+  return node_add_child(ref, (unsigned char)text[depth], TAG_ENTRY(sn));
+}
+
+  /**
+   *  @fn int delete_rec(void **ref, string_node *sn, size_t depth)
+   *
+   *  @brief removes @p sn from the subtree at @p ref
+   *
+   *  @param ref   - pointer to slot holding non-NULL child pointer
+   *  @param sn    - pointer to entry to remove
+   *  @param depth - number of bytes of text of @p sn consumed above @p ref
+   *
+   *  @return 0 on success, non-zero if @p sn was not found
+   */
+
+static int delete_rec(void **ref, string_node *sn, size_t depth)
+{
+  string_art_node *n;
+  void **child;
+  unsigned char c;
+
+  if (IS_ENTRY(*ref))
+  {
+    if (TO_ENTRY(*ref) != sn) return 1;
+    *ref = NULL;
+    return 0;
+  }
+
+  n = (string_art_node *)*ref;
+
+  depth += n->plen;
+  if (depth > sn->value.len) return 1;
+
+  if (depth == sn->value.len)
+  {
+    if (n->value != sn) return 1;
+    n->value = NULL;
+  }
+  else
+  {
+    c = (unsigned char)sn->value.text[depth];
+
+    child = node_find_child(n, c);
+    if (!child) return 1;
+
+    if (delete_rec(child, sn, depth + 1)) return 1;
+
+    if (!*child) node_remove_child(n, c);
+  }
+
+  node_shrink(ref);
+
+  return 0;
+}
+
+  /**
+   *  @fn int walk_rec(void *p, string_walk_action action, void *ctx)
+   *
+   *  @brief calls @p action for each entry at or below @p p in text order
+   *
+   *  A node's own entry is a prefix of every text below it, so it comes
+   *  first.
+   *
+   *  @param p      - child pointer, possibly NULL
+   *  @param action - pointer to function to call at each entry
+   *  @param ctx    - pointer passed to @p action
+   *
+   *  @return 0 if every entry was visited, else the value that stopped it
+   */
+
+static int walk_rec(void *p, string_walk_action action, void *ctx)
+{
+  string_art_node *n;
+  art_node48 *n48;
+  unsigned int i;
+  int r = 0;
+
+  if (!p) return 0;
+
+  if (IS_ENTRY(p)) return action((avl_node *)TO_ENTRY(p), ctx);
+
+  n = (string_art_node *)p;
+
+  if (n->value && (r = action((avl_node *)n->value, ctx))) return r;
+
+  switch (n->type)
+  {
+    case 4:
+      for (i = 0; i < n->count && !r; i++) r = walk_rec(((art_node4 *)n)->child[i], action, ctx);
+      break;
+    case 16:
+      for (i = 0; i < n->count && !r; i++) r = walk_rec(((art_node16 *)n)->child[i], action, ctx);
+      break;
+    case 48:
+      n48 = (art_node48 *)n;
+      for (i = 0; i < 256 && !r; i++)
+        if (n48->index[i]) r = walk_rec(n48->child[n48->index[i] - 1], action, ctx);
+      break;
+    default:
+      for (i = 0; i < 256 && !r; i++) r = walk_rec(((art_node256 *)n)->child[i], action, ctx);
+      break;
+  }
+
+  return r;
+}
+
+  /**
+   *  @fn string_node *seek_rec(void *p, const char *text, size_t len, size_t depth, int forward, int inclusive)
+   *
+   *  @brief finds the entry at or below @p p nearest to @p text in one direction
+   *
+   *  A node's own entry sorts before its children, so going forward it is
+   *  the answer only for an exact match, and going backward it is the last
+   *  resort once no child qualifies.
+   *
+   *  @param p         - non-NULL child pointer
+   *  @param text      - pointer to text
+   *  @param len       - length of @p text in bytes
+   *  @param depth     - number of bytes of @p text consumed above @p p
+   *  @param forward   - non-zero for the first entry after @p text
+   *  @param inclusive - non-zero if an entry equal to @p text qualifies
+   *
+   *  @return pointer to entry, NULL if there is none below @p p
+   */
+
+static string_node *seek_rec(void *p,
+                             const char *text,
+                             size_t len,
+                             size_t depth,
+                             int forward,
+                             int inclusive)
+{
+  string_art_node *n;
+  string_node *sn;
+  void **child;
+  void *next;
+  size_t m;
+  int c;
+
+  if (IS_ENTRY(p))
+  {
+    sn = TO_ENTRY(p);
+
+    m = sn->value.len < len ? sn->value.len : len;
+    c = memcmp(sn->value.text, text, m);
+    if (!c) c = (sn->value.len > len) - (sn->value.len < len);
+
+    if (!c) return inclusive ? sn : NULL;
+    if (forward) return c > 0 ? sn : NULL;
+    return c < 0 ? sn : NULL;
+  }
+
+  n = (string_art_node *)p;
+
+  c = node_prefix_compare(n, text, len, depth);
+  if (c < 0) return forward ? node_minimum(n) : NULL;
+  if (c > 0) return forward ? NULL : node_maximum(n);
+
+  depth += n->plen;
+
+  if (depth == len)
+  {
+    if (inclusive && n->value) return n->value;
+    if (!forward) return NULL;
+
+    next = node_child_after(n, -1);
+    return next ? node_minimum(next) : NULL;
+  }
+
+  c = (unsigned char)text[depth];
+
+  child = node_find_child(n, (unsigned char)c);
+  if (child)
+  {
+    sn = seek_rec(*child, text, len, depth + 1, forward, inclusive);
+    if (sn) return sn;
+  }
+
+  if (forward)
+  {
+    next = node_child_after(n, c);
+    return next ? node_minimum(next) : NULL;
+  }
+
+  next = node_child_before(n, c);
+  return next ? node_maximum(next) : n->value;
+}
+
+  /**
+   *  @fn int entry_equal(string_node *sn, const char *text, size_t len)
+   *
+   *  @brief compares text of entry @p sn with @p text
+   *
+   *  @param sn   - pointer to existing entry
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return non-zero if equal, 0 otherwise
+   */
+
+static int entry_equal(string_node *sn, const char *text, size_t len)
+{
+  return sn->value.len == len && !memcmp(sn->value.text, text, len);
+}
@@ -0,0 +1,94 @@
+/*
+ *  Copyright 2021,2022,2024,2025 Patrick T. Head
+ *
+ *  This program is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  @file strings-art.h
+ *
+ *  @brief Internal header for the adaptive radix tree text index of libstrings
+ */
+
+#ifndef STRINGS_ART_H
+#define STRINGS_ART_H
+
+#include "libstrings.h"
+
+  /**
+   *  @def STRING_ART_PREFIX
+   *
+   *  @brief bytes of a compressed path kept in an inner node
+   *
+   *  Longer paths are checked against an entry below the node.
+   */
+
+#define STRING_ART_PREFIX 8
+
+  /**
+   *  @typedef struct string_art_node string_art_node
+   *
+   *  @brief create a type for @a string_art_node struct
+   */
+
+typedef struct string_art_node string_art_node;
+
+  /**
+   *  @struct string_art_node
+   *
+   *  @brief header shared by the 4, 16, 48 and 256 way inner nodes
+   *
+   *  A node consumes @a plen bytes of compressed path and then one byte per
+   *  child.  The entry whose text ends right after the path, if any, is
+   *  kept in @a value, so no terminator byte is needed and texts may hold
+   *  any byte.
+   */
+
+struct string_art_node
+{
+  unsigned char type;                        /**<   4, 16, 48 or 0 for 256 way node             */
+  unsigned int count;                        /**<   number of children                         */
+  size_t plen;                               /**<   length of compressed path                  */
+  unsigned char prefix[STRING_ART_PREFIX];   /**<   first bytes of compressed path             */
+  string_node *value;                        /**<   entry ending after compressed path         */
+};
+
+  /**
+   *  @struct string_art
+   *
+   *  @brief adaptive radix tree ordered index of the entries of a @a strings struct
+   *
+   *  Children are either inner nodes or entries, entries being tagged in the
+   *  low bit of the pointer.  The tree never owns entries.
+   */
+
+struct string_art
+{
+  void *root;                 /**<   root node or entry, NULL when empty   */
+  unsigned int n_entries;     /**<   number of entries in tree             */
+};
+
+string_art *string_art_new(void);
+void string_art_free(string_art *art);
+int string_art_insert(string_art *art, string_node *sn);
+int string_art_delete(string_art *art, string_node *sn);
+string_node *string_art_find(string_art *art, const char *text, size_t len);
+int string_art_walk(string_art *art, string_walk_action action, void *ctx);
+string_node *string_art_seek(string_art *art,
+                             const char *text,
+                             size_t len,
+                             int forward,
+                             int inclusive);
+
+#endif //STRINGS_ART_H
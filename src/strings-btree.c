@@ -0,0 +1,1078 @@
+/*
+ *  Copyright 2021,2022,2024,2025 Patrick T. Head
+ *
+ *  This program is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  @file strings-btree.c
+ *
+ *  @brief B+ tree ordered text index for libstrings
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "strings-btree.h"
+
+  /**
+   *  @def BTREE_MAX_DEPTH
+   *
+   *  @brief deepest B+ tree supported, far beyond 2^32 entries
+   */
+
+#define BTREE_MAX_DEPTH 32
+
+  /**
+   *  @def BTREE_BUILD_FILL
+   *
+   *  @brief keys per node when building bottom-up
+   *
+   *  Nodes are left with room to spare, so inserts right after a bulk load
+   *  do not split every node they touch.
+   */
+
+#define BTREE_BUILD_FILL (STRING_BTREE_ORDER * 7 / 8)
+
+  /**
+   *  @typedef struct node_pool node_pool
+   *
+   *  @brief nodes allocated before an insert, so a split never fails midway
+   */
+
+typedef struct
+{
+  string_btree_node *node[BTREE_MAX_DEPTH + 1];  /**<   spare nodes        */
+  unsigned int n;                                /**<   number of spares   */
+} node_pool;
+
+static string_btree_node *node_new(int leaf);
+static string_btree_node *pool_take(node_pool *pool, int leaf);
+static void node_free(string_btree_node *nd);
+static void node_refresh(string_btree_node *nd);
+static uint64_t key_slice(const char *text, size_t len, size_t off);
+static int node_prefix_cmp(string_btree_node *nd, const char *text, size_t len);
+static int node_key_cmp(string_btree_node *nd,
+                        unsigned int i,
+                        const char *text,
+                        size_t len,
+                        uint64_t ks);
+static unsigned int node_lower_bound(string_btree_node *nd,
+                                     const char *text,
+                                     size_t len);
+static unsigned int node_upper_bound(string_btree_node *nd,
+                                     const char *text,
+                                     size_t len);
+static int insert_rec(string_btree_node *nd,
+                      string_node *sn,
+                      node_pool *pool,
+                      string_btree_node **split,
+                      string_node **sep);
+static int delete_rec(string_btree_node *nd, string_node *sn);
+static string_node *leftmost(string_btree_node *nd);
+static int entry_cmp(string_node *a, string_node *b);
+static string_btree_node *build(string_node **sn, unsigned int n);
+static void free_level(string_btree_node **level, unsigned int n);
+
+  /**
+   *  @fn string_btree *string_btree_new(void)
+   *
+   *  @brief create a new, empty @a string_btree struct
+   *
+   *  @par Parameters
+   *  None.
+   *
+   *  @return pointer to new @a string_btree struct
+   */
+
+string_btree *string_btree_new(void)
+{
+  string_btree *bt;
+
+  bt = malloc(sizeof(string_btree));
+  if (bt) memset(bt, 0, sizeof(string_btree));
+
+  return bt;
+}
+
+  /**
+   *  @fn void string_btree_free(string_btree *bt)
+   *
+   *  @brief frees all nodes of @p bt, but not the entries they index
+   *
+   *  @param bt - pointer to existing @a string_btree struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void string_btree_free(string_btree *bt)
+{
+  if (!bt) return;
+
+  node_free(bt->root);
+
+  free(bt);
+}
+
+  /**
+   *  @fn int string_btree_insert(string_btree *bt, string_node *sn)
+   *
+   *  @brief adds entry @p sn to @p bt
+   *
+   *  @param bt - pointer to existing @a string_btree struct
+   *  @param sn - pointer to entry with text and len set
+   *
+   *  @return 0 on success, non-zero if @p sn is a duplicate or on failure
+   */
+
+int string_btree_insert(string_btree *bt, string_node *sn)
+{
+  string_btree_node *split = NULL;
+  string_btree_node *root;
+  string_btree_node *nd;
+  string_node *sep = NULL;
+  node_pool pool;
+  unsigned int need = 0;
+  int r = -1;
+
+  if (!bt || !sn) return 1;
+
+  if (!bt->root)
+  {
+    bt->root = node_new(1);
+    if (!bt->root) return 1;
+  }
+
+    /*
+     *  Only full nodes split, so reserve one node for each full node on the
+     *  path plus one for a new root.  Most inserts reserve nothing.
+     */
+
+  if (bt->root->count == STRING_BTREE_ORDER) ++need;
+
+  for (nd = bt->root; ; nd = nd->child[node_upper_bound(nd, sn->value.text, sn->value.len)])
+  {
+    if (nd->count == STRING_BTREE_ORDER) ++need;
+    if (nd->leaf) break;
+  }
+
+  for (pool.n = 0; pool.n < need; pool.n++)
+    if (!(pool.node[pool.n] = node_new(0))) goto exit;
+
+  r = insert_rec(bt->root, sn, &pool, &split, &sep);
+  if (r < 0) goto exit;
+
+    /*
+     *  A split root grows the tree by one level
+     */
+
+  if (r > 0)
+  {
+    root = pool_take(&pool, 0);
+
+    root->count = 1;
+    root->key[0] = sep;
+    root->child[0] = bt->root;
+    root->child[1] = split;
+    node_refresh(root);
+
+    bt->root = root;
+  }
+
+  ++bt->n_entries;
+
+exit:
+  while (pool.n) free(pool.node[--pool.n]);
+
+  return r < 0 ? 1 : 0;
+}
+
+  /**
+   *  @fn int string_btree_delete(string_btree *bt, string_node *sn)
+   *
+   *  @brief removes entry @p sn from @p bt
+   *
+   *  Leaves and inner nodes are freed once empty, underfull nodes are not
+   *  merged.  Separators naming @p sn are replaced by the new first entry
+   *  of their subtree.
+   *
+   *  @param bt - pointer to existing @a string_btree struct
+   *  @param sn - pointer to entry in @p bt
+   *
+   *  @return 0 on success, non-zero if @p sn was not found
+   */
+
+int string_btree_delete(string_btree *bt, string_node *sn)
+{
+  string_btree_node *root;
+  int r;
+
+  if (!bt || !sn || !bt->root) return 1;
+
+  r = delete_rec(bt->root, sn);
+  if (r < 0) return 1;
+
+  if (r > 0) bt->root = NULL;
+
+    /*
+     *  An inner root left with a single child is replaced by that child
+     */
+
+  while ((root = bt->root) && !root->leaf && !root->count)
+  {
+    bt->root = root->child[0];
+    free(root);
+  }
+
+  --bt->n_entries;
+
+  return 0;
+}
+
+  /**
+   *  @fn int string_btree_insert_sorted(string_btree *bt, string_node **sn, unsigned int n)
+   *
+   *  @brief adds @p n entries, sorted by text and not already in @p bt
+   *
+   *  A batch that is large next to the tree is merged with the existing
+   *  entries and the whole tree rebuilt bottom-up, in time linear in the
+   *  total.  A small batch is inserted one entry at a time.
+   *
+   *  @param bt - pointer to existing @a string_btree struct
+   *  @param sn - array of @p n pointers to entries, in text order
+   *  @param n  - number of entries
+   *
+   *  @return 0 on success, non-zero on failure with @p bt unchanged
+   */
+
+int string_btree_insert_sorted(string_btree *bt, string_node **sn, unsigned int n)
+{
+  string_btree_node *root;
+  string_btree_node *nd;
+  string_node **all;
+  unsigned int total, i, j, k;
+
+  if (!bt || (n && !sn)) return 1;
+  if (!n) return 0;
+
+  if ((unsigned long long)n * 8 < bt->n_entries)
+  {
+    for (i = 0; i < n; i++)
+      if (string_btree_insert(bt, sn[i]))
+      {
+        while (i) string_btree_delete(bt, sn[--i]);
+        return 1;
+      }
+    return 0;
+  }
+
+  total = bt->n_entries + n;
+  if (total < n) return 1;
+
+  all = malloc((size_t)total * sizeof(string_node *));
+  if (!all) return 1;
+
+    /*
+     *  Merge the leaf chain with the batch
+     */
+
+  for (nd = bt->root; nd && !nd->leaf; nd = nd->child[0])
+    ;
+
+  j = k = 0;
+
+  for ( ; nd; nd = nd->next)
+    for (i = 0; i < nd->count; i++)
+    {
+      while (j < n && entry_cmp(sn[j], nd->key[i]) < 0) all[k++] = sn[j++];
+      all[k++] = nd->key[i];
+    }
+
+  while (j < n) all[k++] = sn[j++];
+
+  root = build(all, total);
+
+  free(all);
+
+  if (!root) return 1;
+
+  node_free(bt->root);
+
+  bt->root = root;
+  bt->n_entries = total;
+
+  return 0;
+}
+
+  /**
+   *  @fn int string_btree_walk(string_btree *bt, string_walk_action action, void *ctx)
+   *
+   *  @brief calls @p action for each entry of @p bt in text order
+   *
+   *  Follows the leaf sibling links, so no inner node is visited after the
+   *  descent to the first leaf.
+   *
+   *  @param bt     - pointer to existing @a string_btree struct
+   *  @param action - pointer to function to call at each entry, returning
+   *                  non-zero to stop the walk
+   *  @param ctx    - pointer passed to @p action
+   *
+   *  @return 0 if every entry was visited, else the value that stopped it
+   */
+
+int string_btree_walk(string_btree *bt, string_walk_action action, void *ctx)
+{
+  string_btree_node *nd;
+  unsigned int i;
+  int r;
+
+  if (!bt || !action || !bt->root) return 0;
+
+  for (nd = bt->root; !nd->leaf; nd = nd->child[0])
+    ;
+
+  for ( ; nd; nd = nd->next)
+    for (i = 0; i < nd->count; i++)
+      if ((r = action((avl_node *)nd->key[i], ctx))) return r;
+
+  return 0;
+}
+
+  /**
+   *  @fn string_node *string_btree_seek(string_btree *bt, const char *text, size_t len, int forward, int inclusive)
+   *
+   *  @brief finds the entry of @p bt nearest to @p text in one direction
+   *
+   *  One descent to the leaf that would hold @p text, then at most one step
+   *  along a sibling link.
+   *
+   *  @param bt        - pointer to existing @a string_btree struct
+   *  @param text      - pointer to text, NULL for the first (or last) entry
+   *  @param len       - length of @p text in bytes
+   *  @param forward   - non-zero for the first entry after @p text, zero for
+   *                     the last entry before it
+   *  @param inclusive - non-zero if an entry equal to @p text qualifies
+   *
+   *  @return pointer to entry, NULL if there is none
+   */
+
+string_node *string_btree_seek(string_btree *bt,
+                               const char *text,
+                               size_t len,
+                               int forward,
+                               int inclusive)
+{
+  string_btree_node *nd;
+  unsigned int pos;
+
+  if (!bt || !bt->root) return NULL;
+
+  if (!text)
+  {
+    for (nd = bt->root; !nd->leaf; nd = nd->child[forward ? 0 : nd->count])
+      ;
+    return forward ? nd->key[0] : nd->key[nd->count - 1];
+  }
+
+  for (nd = bt->root; !nd->leaf; nd = nd->child[node_upper_bound(nd, text, len)])
+    ;
+
+  if (forward)
+  {
+    pos = inclusive ? node_lower_bound(nd, text, len) : node_upper_bound(nd, text, len);
+    if (pos < nd->count) return nd->key[pos];
+    return nd->next ? nd->next->key[0] : NULL;
+  }
+
+  pos = inclusive ? node_upper_bound(nd, text, len) : node_lower_bound(nd, text, len);
+  if (pos) return nd->key[pos - 1];
+  return nd->prev ? nd->prev->key[nd->prev->count - 1] : NULL;
+}
+
+  /**
+   *  @fn string_btree_node *node_new(int leaf)
+   *
+   *  @brief create a new, empty leaf or inner node
+   *
+   *  @param leaf - non-zero for a leaf
+   *
+   *  @return pointer to new @a string_btree_node struct
+   */
+
+static string_btree_node *node_new(int leaf)
+{
+  string_btree_node *nd;
+
+  nd = malloc(sizeof(string_btree_node));
+  if (!nd) return NULL;
+
+  memset(nd, 0, sizeof(string_btree_node));
+  nd->leaf = leaf ? 1 : 0;
+
+  return nd;
+}
+
+  /**
+   *  @fn string_btree_node *pool_take(node_pool *pool, int leaf)
+   *
+   *  @brief takes a spare node reserved by string_btree_insert()
+   *
+   *  @param pool - pointer to existing @a node_pool struct
+   *  @param leaf - non-zero for a leaf
+   *
+   *  @return pointer to empty @a string_btree_node struct
+   */
+
+static string_btree_node *pool_take(node_pool *pool, int leaf)
+{
+  string_btree_node *nd;
+
+  nd = pool->node[--pool->n];
+
+  memset(nd, 0, sizeof(string_btree_node));
+  nd->leaf = leaf ? 1 : 0;
+
+  return nd;
+}
+
+  /**
+   *  @fn void node_free(string_btree_node *nd)
+   *
+   *  @brief frees @p nd and all nodes below it
+   *
+   *  @param nd - pointer to existing @a string_btree_node struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void node_free(string_btree_node *nd)
+{
+  unsigned int i;
+
+  if (!nd) return;
+
+  if (!nd->leaf)
+    for (i = 0; i <= nd->count; i++)
+      node_free(nd->child[i]);
+
+  free(nd);
+}
+
+  /**
+   *  @fn void node_refresh(string_btree_node *nd)
+   *
+   *  @brief recomputes shared prefix and key slices of @p nd
+   *
+   *  Keys are sorted, so the prefix shared by all of them is the one shared
+   *  by the first and last.
+   *
+   *  @param nd - pointer to existing @a string_btree_node struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void node_refresh(string_btree_node *nd)
+{
+  string *first, *last;
+  size_t n, p;
+  unsigned int i;
+
+  if (!nd->count)
+  {
+    nd->plen = 0;
+    return;
+  }
+
+  first = &nd->key[0]->value;
+  last = &nd->key[nd->count - 1]->value;
+
+  n = first->len < last->len ? first->len : last->len;
+
+  for (p = 0; p < n && first->text[p] == last->text[p]; p++)
+    ;
+
+  nd->plen = p;
+
+  for (i = 0; i < nd->count; i++)
+    nd->slice[i] = key_slice(nd->key[i]->value.text, nd->key[i]->value.len, p);
+}
+
+  /**
+   *  @fn uint64_t key_slice(const char *text, size_t len, size_t off)
+   *
+   *  @brief loads 8 bytes of @p text from @p off as a big endian integer
+   *
+   *  Bytes past @p len read as zero.
+   *
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *  @param off  - offset of first byte of slice
+   *
+   *  @return slice of @p text at @p off
+   */
+
+static uint64_t key_slice(const char *text, size_t len, size_t off)
+{
+  const unsigned char *p;
+  uint64_t s = 0;
+  unsigned int i;
+
+  p = (const unsigned char *)text;
+
+  for (i = 0; i < 8; i++)
+  {
+    s <<= 8;
+    if (off + i < len) s |= p[off + i];
+  }
+
+  return s;
+}
+
+  /**
+   *  @fn int node_prefix_cmp(string_btree_node *nd, const char *text, size_t len)
+   *
+   *  @brief compares @p text with the prefix shared by all keys of @p nd
+   *
+   *  @param nd   - pointer to non-empty @a string_btree_node struct
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return <0 if @p text sorts before every key of @p nd
+   *  @return >0 if @p text sorts after every key of @p nd
+   *  @return 0 if @p text starts with the shared prefix
+   */
+
+static int node_prefix_cmp(string_btree_node *nd, const char *text, size_t len)
+{
+  size_t m;
+  int c;
+
+  m = len < nd->plen ? len : nd->plen;
+
+  c = memcmp(text, nd->key[0]->value.text, m);
+  if (c) return c;
+
+  return len < nd->plen ? -1 : 0;
+}
+
+  /**
+   *  @fn int node_key_cmp(string_btree_node *nd, unsigned int i, const char *text, size_t len, uint64_t ks)
+   *
+   *  @brief compares @p text with key @p i of @p nd
+   *
+   *  @p text must start with the shared prefix of @p nd.  Only when the
+   *  slices tie is the text of the key read.
+   *
+   *  @param nd   - pointer to existing @a string_btree_node struct
+   *  @param i    - index of key in @p nd
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *  @param ks   - slice of @p text after the shared prefix of @p nd
+   *
+   *  @return <0, 0 or >0 as @p text sorts before, equal to or after the key
+   */
+
+static int node_key_cmp(string_btree_node *nd,
+                        unsigned int i,
+                        const char *text,
+                        size_t len,
+                        uint64_t ks)
+{
+  string *k;
+  size_t m, off;
+  int c;
+
+  if (ks != nd->slice[i]) return ks < nd->slice[i] ? -1 : 1;
+
+  k = &nd->key[i]->value;
+
+  m = len < k->len ? len : k->len;
+
+  off = nd->plen + 8;
+  if (off > m) off = m;
+
+  c = memcmp(text + off, k->text + off, m - off);
+  if (c) return c;
+
+  return (len > k->len) - (len < k->len);
+}
+
+  /**
+   *  @fn unsigned int node_lower_bound(string_btree_node *nd, const char *text, size_t len)
+   *
+   *  @brief finds index of first key of @p nd not less than @p text
+   *
+   *  @param nd   - pointer to existing @a string_btree_node struct
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return index of key, count of @p nd if all keys are less
+   */
+
+static unsigned int node_lower_bound(string_btree_node *nd,
+                                     const char *text,
+                                     size_t len)
+{
+  unsigned int lo, hi, mid;
+  uint64_t ks;
+  int c;
+
+  if (!nd->count) return 0;
+
+  c = node_prefix_cmp(nd, text, len);
+  if (c < 0) return 0;
+  if (c > 0) return nd->count;
+
+  ks = key_slice(text, len, nd->plen);
+
+  lo = 0;
+  hi = nd->count;
+
+  while (lo < hi)
+  {
+    mid = (lo + hi) / 2;
+    if (node_key_cmp(nd, mid, text, len, ks) > 0) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return lo;
+}
+
+  /**
+   *  @fn unsigned int node_upper_bound(string_btree_node *nd, const char *text, size_t len)
+   *
+   *  @brief finds index of first key of @p nd greater than @p text
+   *
+   *  For an inner node this is the index of the child to descend into.
+   *
+   *  @param nd   - pointer to existing @a string_btree_node struct
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return index of key, count of @p nd if no key is greater
+   */
+
+static unsigned int node_upper_bound(string_btree_node *nd,
+                                     const char *text,
+                                     size_t len)
+{
+  unsigned int lo, hi, mid;
+  uint64_t ks;
+  int c;
+
+  if (!nd->count) return 0;
+
+  c = node_prefix_cmp(nd, text, len);
+  if (c < 0) return 0;
+  if (c > 0) return nd->count;
+
+  ks = key_slice(text, len, nd->plen);
+
+  lo = 0;
+  hi = nd->count;
+
+  while (lo < hi)
+  {
+    mid = (lo + hi) / 2;
+    if (node_key_cmp(nd, mid, text, len, ks) >= 0) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return lo;
+}
+
+  /**
+   *  @fn int insert_rec(string_btree_node *nd, string_node *sn, node_pool *pool, string_btree_node **split, string_node **sep)
+   *
+   *  @brief inserts @p sn below @p nd, splitting full nodes on the way up
+   *
+   *  @param nd    - pointer to existing @a string_btree_node struct
+   *  @param sn    - pointer to entry to insert
+   *  @param pool  - pointer to spare nodes for splits
+   *  @param split - pointer to receive new right sibling if @p nd split
+   *  @param sep   - pointer to receive separator of @p split
+   *
+   *  @return 0 if inserted, 1 if inserted and @p nd split, <0 on duplicate
+   */
+
+static int insert_rec(string_btree_node *nd,
+                      string_node *sn,
+                      node_pool *pool,
+                      string_btree_node **split,
+                      string_node **sep)
+{
+  string_node *keys[STRING_BTREE_ORDER + 1];
+  string_btree_node *children[STRING_BTREE_ORDER + 2];
+  string_btree_node *right;
+  string_btree_node *child_split = NULL;
+  string_node *child_sep = NULL;
+  unsigned int pos, n, half, i;
+  int r;
+
+  if (nd->leaf)
+  {
+    pos = node_lower_bound(nd, sn->value.text, sn->value.len);
+
+    if (pos < nd->count &&
+        nd->key[pos]->value.len == sn->value.len &&
+        !memcmp(nd->key[pos]->value.text, sn->value.text, sn->value.len))
+      return -1;
+
+    if (nd->count < STRING_BTREE_ORDER)
+    {
+      memmove(&nd->key[pos + 1], &nd->key[pos], (nd->count - pos) * sizeof(string_node *));
+      nd->key[pos] = sn;
+      ++nd->count;
+      node_refresh(nd);
+      return 0;
+    }
+
+      /*
+       *  Full leaf: split the ORDER + 1 keys between it and a new right leaf
+       */
+
+    right = pool_take(pool, 1);
+
+    memcpy(keys, nd->key, pos * sizeof(string_node *));
+    keys[pos] = sn;
+    memcpy(&keys[pos + 1], &nd->key[pos], (nd->count - pos) * sizeof(string_node *));
+
+    n = STRING_BTREE_ORDER + 1;
+    half = n / 2;
+
+    memcpy(nd->key, keys, half * sizeof(string_node *));
+    nd->count = half;
+
+    memcpy(right->key, &keys[half], (n - half) * sizeof(string_node *));
+    right->count = n - half;
+
+    right->next = nd->next;
+    right->prev = nd;
+    if (nd->next) nd->next->prev = right;
+    nd->next = right;
+
+    node_refresh(nd);
+    node_refresh(right);
+
+    *split = right;
+    *sep = right->key[0];
+
+    return 1;
+  }
+
+  pos = node_upper_bound(nd, sn->value.text, sn->value.len);
+
+  r = insert_rec(nd->child[pos], sn, pool, &child_split, &child_sep);
+  if (r <= 0) return r;
+
+    /*
+     *  Child split: its new right sibling goes in at pos + 1
+     */
+
+  if (nd->count < STRING_BTREE_ORDER)
+  {
+    memmove(&nd->key[pos + 1], &nd->key[pos], (nd->count - pos) * sizeof(string_node *));
+    memmove(&nd->child[pos + 2],
+            &nd->child[pos + 1],
+            (nd->count - pos) * sizeof(string_btree_node *));
+    nd->key[pos] = child_sep;
+    nd->child[pos + 1] = child_split;
+    ++nd->count;
+    node_refresh(nd);
+    return 0;
+  }
+
+  right = pool_take(pool, 0);
+
+  memcpy(keys, nd->key, pos * sizeof(string_node *));
+  keys[pos] = child_sep;
+  memcpy(&keys[pos + 1], &nd->key[pos], (nd->count - pos) * sizeof(string_node *));
+
+  memcpy(children, nd->child, (pos + 1) * sizeof(string_btree_node *));
+  children[pos + 1] = child_split;
+  memcpy(&children[pos + 2],
+         &nd->child[pos + 1],
+         (nd->count - pos) * sizeof(string_btree_node *));
+
+    /*
+     *  Middle key moves up, keys either side of it stay at this level
+     */
+
+  n = STRING_BTREE_ORDER + 1;
+  half = n / 2;
+
+  nd->count = half;
+  memcpy(nd->key, keys, half * sizeof(string_node *));
+  memcpy(nd->child, children, (half + 1) * sizeof(string_btree_node *));
+
+  right->count = n - half - 1;
+  memcpy(right->key, &keys[half + 1], right->count * sizeof(string_node *));
+  memcpy(right->child, &children[half + 1], (right->count + 1) * sizeof(string_btree_node *));
+
+  for (i = nd->count + 1; i <= STRING_BTREE_ORDER; i++) nd->child[i] = NULL;
+
+  node_refresh(nd);
+  node_refresh(right);
+
+  *split = right;
+  *sep = keys[half];
+
+  return 1;
+}
+
+  /**
+   *  @fn int delete_rec(string_btree_node *nd, string_node *sn)
+   *
+   *  @brief removes @p sn from below @p nd
+   *
+   *  @param nd - pointer to existing @a string_btree_node struct
+   *  @param sn - pointer to entry to remove
+   *
+   *  @return 0 if removed, 1 if removed and @p nd is now empty and freed,
+   *          <0 if @p sn was not found
+   */
+
+static int delete_rec(string_btree_node *nd, string_node *sn)
+{
+  unsigned int pos, i;
+  int r;
+
+  if (nd->leaf)
+  {
+    pos = node_lower_bound(nd, sn->value.text, sn->value.len);
+    if (pos >= nd->count || nd->key[pos] != sn) return -1;
+
+    --nd->count;
+    memmove(&nd->key[pos], &nd->key[pos + 1], (nd->count - pos) * sizeof(string_node *));
+
+    if (!nd->count)
+    {
+      if (nd->prev) nd->prev->next = nd->next;
+      if (nd->next) nd->next->prev = nd->prev;
+      free(nd);
+      return 1;
+    }
+
+    node_refresh(nd);
+    return 0;
+  }
+
+  pos = node_upper_bound(nd, sn->value.text, sn->value.len);
+
+  r = delete_rec(nd->child[pos], sn);
+  if (r < 0) return r;
+
+  if (r > 0)
+  {
+      /*
+       *  Drop the empty child and the separator bounding it
+       */
+
+    if (!nd->count)
+    {
+      free(nd);
+      return 1;
+    }
+
+    i = pos ? pos - 1 : 0;
+
+    --nd->count;
+    memmove(&nd->key[i], &nd->key[i + 1], (nd->count - i) * sizeof(string_node *));
+    memmove(&nd->child[pos],
+            &nd->child[pos + 1],
+            (nd->count + 1 - pos) * sizeof(string_btree_node *));
+    nd->child[nd->count + 1] = NULL;
+  }
+
+    /*
+     *  A separator naming @p sn now names the first entry of its subtree
+     */
+
+  for (i = 0; i < nd->count; i++)
+    if (nd->key[i] == sn) nd->key[i] = leftmost(nd->child[i + 1]);
+
+  node_refresh(nd);
+
+  return 0;
+}
+
+  /**
+   *  @fn string_node *leftmost(string_btree_node *nd)
+   *
+   *  @brief finds first entry below @p nd
+   *
+   *  @param nd - pointer to existing @a string_btree_node struct
+   *
+   *  @return pointer to first entry
+   */
+
+static string_node *leftmost(string_btree_node *nd)
+{
+  while (!nd->leaf) nd = nd->child[0];
+
+  return nd->key[0];
+}
+
+  /**
+   *  @fn int entry_cmp(string_node *a, string_node *b)
+   *
+   *  @brief compares the texts of entries @p a and @p b
+   *
+   *  @param a - pointer to existing entry
+   *  @param b - pointer to existing entry
+   *
+   *  @return <0, 0 or >0 as @p a sorts before, equal to or after @p b
+   */
+
+static int entry_cmp(string_node *a, string_node *b)
+{
+  size_t m;
+  int c;
+
+  m = a->value.len < b->value.len ? a->value.len : b->value.len;
+
+  c = memcmp(a->value.text, b->value.text, m);
+  if (c) return c;
+
+  return (a->value.len > b->value.len) - (a->value.len < b->value.len);
+}
+
+  /**
+   *  @fn string_btree_node *build(string_node **sn, unsigned int n)
+   *
+   *  @brief builds a B+ tree bottom-up from @p n sorted entries
+   *
+   *  Leaves are filled to BTREE_BUILD_FILL keys, evenly, and linked; then
+   *  each level of inner nodes is built over the one below until a single
+   *  root remains.
+   *
+   *  @param sn - array of @p n pointers to entries, in text order
+   *  @param n  - number of entries, at least 1
+   *
+   *  @return pointer to root node, NULL on failure
+   */
+
+static string_btree_node *build(string_node **sn, unsigned int n)
+{
+  string_btree_node **level;
+  string_btree_node **up;
+  string_btree_node *nd;
+  unsigned int m, p, i, j, k, c;
+
+  m = (n + BTREE_BUILD_FILL - 1) / BTREE_BUILD_FILL;
+
+  level = malloc(m * sizeof(string_btree_node *));
+  if (!level) return NULL;
+
+  for (i = 0, k = 0; i < m; i++)
+  {
+    level[i] = nd = node_new(1);
+    if (!nd)
+    {
+      free_level(level, i);
+      return NULL;
+    }
+
+    c = n / m + (i < n % m);
+
+    memcpy(nd->key, &sn[k], c * sizeof(string_node *));
+    nd->count = c;
+    k += c;
+
+    if (i)
+    {
+      nd->prev = level[i - 1];
+      level[i - 1]->next = nd;
+    }
+
+    node_refresh(nd);
+  }
+
+    /*
+     *  Each inner node takes up to BTREE_BUILD_FILL + 1 children, the
+     *  first entry below each child but the first becoming a separator
+     */
+
+  while (m > 1)
+  {
+    p = (m + BTREE_BUILD_FILL) / (BTREE_BUILD_FILL + 1);
+
+    up = malloc(p * sizeof(string_btree_node *));
+    if (!up)
+    {
+      free_level(level, m);
+      return NULL;
+    }
+
+    for (i = 0, k = 0; i < p; i++)
+    {
+      up[i] = nd = node_new(0);
+      if (!nd)
+      {
+        while (i) free(up[--i]);
+        free(up);
+        free_level(level, m);
+        return NULL;
+      }
+
+      c = m / p + (i < m % p);
+
+      for (j = 0; j < c; j++)
+      {
+        nd->child[j] = level[k + j];
+        if (j) nd->key[j - 1] = leftmost(level[k + j]);
+      }
+
+      nd->count = c - 1;
+      k += c;
+
+      node_refresh(nd);
+    }
+
+    free(level);
+
+    level = up;
+    m = p;
+  }
+
+  nd = level[0];
+
+  free(level);
+
+  return nd;
+}
+
+  /**
+   *  @fn void free_level(string_btree_node **level, unsigned int n)
+   *
+   *  @brief frees a level of nodes being built and everything below it
+   *
+   *  @param level - array of @p n pointers to nodes
+   *  @param n     - number of nodes
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void free_level(string_btree_node **level, unsigned int n)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; i++) node_free(level[i]);
+
+  free(level);
+}
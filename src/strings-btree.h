@@ -0,0 +1,98 @@
+/*
+ *  Copyright 2021,2022,2024,2025 Patrick T. Head
+ *
+ *  This program is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  @file strings-btree.h
+ *
+ *  @brief Internal header for the B+ tree ordered text index of libstrings
+ */
+
+#ifndef STRINGS_BTREE_H
+#define STRINGS_BTREE_H
+
+#include "libstrings.h"
+
+  /**
+   *  @def STRING_BTREE_ORDER
+   *
+   *  @brief maximum number of keys in one B+ tree node
+   *
+   *  32 keys keep the slice array of a node in 4 cache lines.
+   */
+
+#define STRING_BTREE_ORDER 32
+
+  /**
+   *  @typedef struct string_btree_node string_btree_node
+   *
+   *  @brief create a type for @a string_btree_node struct
+   */
+
+typedef struct string_btree_node string_btree_node;
+
+  /**
+   *  @struct string_btree_node
+   *
+   *  @brief one leaf or inner node of a @a string_btree
+   *
+   *  Keys are prefix compressed: the bytes every key in the node shares are
+   *  stored once, as the first @a plen bytes of the first key, and each key
+   *  keeps the next 8 bytes as a big endian @a slice.  Searching a node
+   *  touches the text of one key for the shared prefix and then, in most
+   *  cases, only the slices.
+   */
+
+struct string_btree_node
+{
+  unsigned int count;                                 /**<   number of keys in node                     */
+  unsigned int leaf;                                  /**<   non-zero for a leaf                        */
+  size_t plen;                                        /**<   length of prefix shared by all keys        */
+  uint64_t slice[STRING_BTREE_ORDER];                 /**<   8 bytes of each key after shared prefix    */
+  string_node *key[STRING_BTREE_ORDER];               /**<   leaf: entries, inner: separator entries    */
+  string_btree_node *child[STRING_BTREE_ORDER + 1];   /**<   inner: children                            */
+  string_btree_node *prev;                            /**<   leaf: previous leaf in text order          */
+  string_btree_node *next;                            /**<   leaf: next leaf in text order              */
+};
+
+  /**
+   *  @struct string_btree
+   *
+   *  @brief B+ tree ordered index of the entries of a @a strings struct
+   *
+   *  Separator keys in inner nodes are the first entry of the subtree to
+   *  their right.  The tree never owns entries.
+   */
+
+struct string_btree
+{
+  string_btree_node *root;  /**<   root node, NULL when empty   */
+  unsigned int n_entries;   /**<   number of entries in tree    */
+};
+
+string_btree *string_btree_new(void);
+void string_btree_free(string_btree *bt);
+int string_btree_insert(string_btree *bt, string_node *sn);
+int string_btree_delete(string_btree *bt, string_node *sn);
+int string_btree_insert_sorted(string_btree *bt, string_node **sn, unsigned int n);
+int string_btree_walk(string_btree *bt, string_walk_action action, void *ctx);
+string_node *string_btree_seek(string_btree *bt,
+                               const char *text,
+                               size_t len,
+                               int forward,
+                               int inclusive);
+
+#endif //STRINGS_BTREE_H
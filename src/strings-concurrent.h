@@ -0,0 +1,153 @@
+/*
+ *  Copyright 2021,2022,2024,2025 Patrick T. Head
+ *
+ *  This program is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  @file strings-concurrent.h
+ *
+ *  @brief Internal header for the thread-safe modes of libstrings
+ */
+
+#ifndef STRINGS_CONCURRENT_H
+#define STRINGS_CONCURRENT_H
+
+#include <pthread.h>
+
+#include "libstrings.h"
+
+  /**
+   *  @struct string_shard
+   *
+   *  @brief one lock-striped part of a concurrent @a strings struct
+   *
+   *  Holds the entries whose hash falls in the shard.  Only the hash index,
+   *  slab and arena of @a table are used; ids live in the id index of the
+   *  concurrent table.
+   */
+
+struct string_shard
+{
+  pthread_mutex_t lock;  /**<   guards table                            */
+  strings *table;        /**<   hash index and storage of shard entries */
+};
+
+  /**
+   *  @struct string_reader
+   *
+   *  @brief one reader thread of a read-mostly @a strings struct
+   */
+
+struct string_reader
+{
+  strings *strs;          /**<   table being read                               */
+  unsigned long state;    /**<   epoch seen << 1 | 1 while reading, else 0      */
+  string_reader *next;    /**<   next registered reader                         */
+};
+
+  /**
+   *  @typedef struct string_retired string_retired
+   *
+   *  @brief create a type for @a string_retired struct
+   */
+
+typedef struct string_retired string_retired;
+
+  /**
+   *  @struct string_retired
+   *
+   *  @brief memory unlinked from a read-mostly @a strings struct, waiting for readers to move on
+   */
+
+struct string_retired
+{
+  void *ptr;              /**<   entry or old hash index slots        */
+  int node;               /**<   non-zero if @a ptr is an entry       */
+  unsigned long epoch;    /**<   epoch it was unlinked in             */
+  string_retired *next;   /**<   next (older) retired item            */
+};
+
+  /**
+   *  @struct string_epoch
+   *
+   *  @brief epoch based reclamation state of a read-mostly @a strings struct
+   */
+
+struct string_epoch
+{
+  pthread_mutex_t write_lock;    /**<   serializes writers                           */
+  pthread_mutex_t reader_lock;   /**<   guards readers list                          */
+  unsigned long epoch;           /**<   global epoch                                 */
+  unsigned int seq;              /**<   odd while the hash index is being replaced   */
+  string_reader *readers;        /**<   registered readers                           */
+  string_retired *retired;       /**<   items waiting to be reclaimed                */
+};
+
+  /**
+   *  @typedef struct string_link string_link
+   *
+   *  @brief create a type for @a string_link struct
+   */
+
+typedef struct string_link string_link;
+
+  /**
+   *  @struct string_link
+   *
+   *  @brief one link of the split-ordered list of a lock-free hash index
+   *
+   *  The list holds every entry in order of bit reversed hash, so that each
+   *  bucket's entries follow one another, behind a dummy link starting the
+   *  bucket.  Links are never unlinked.
+   */
+
+struct string_link
+{
+  uint64_t key;         /**<   bit reversed hash, odd for an entry, even for a bucket   */
+  uint64_t hash;        /**<   strings_hash() of text of @a node                        */
+  string_node *node;    /**<   entry, NULL for a bucket or once removed                 */
+  string_link *next;    /**<   next link in list                                        */
+};
+
+  /**
+   *  @struct string_lockfree
+   *
+   *  @brief lock-free hash index of a @a strings struct
+   */
+
+struct string_lockfree
+{
+  string_link ***buckets;   /**<   segments of bucket dummy links           */
+  unsigned int size;        /**<   number of buckets in use                 */
+  unsigned int count;       /**<   number of entry links in list            */
+};
+
+  /**
+   *  @struct string_local
+   *
+   *  @brief thread-local front interner of a @a strings struct
+   *
+   *  Texts are interned into a private table under provisional local ids
+   *  and merged into the shared table now and then, so a repeated text
+   *  only touches memory of the thread that owns the interner.
+   */
+
+struct string_local
+{
+  strings *global;    /**<   table merged into                  */
+  strings *table;     /**<   entries since last merge, by local id */
+};
+
+#endif //STRINGS_CONCURRENT_H
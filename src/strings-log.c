@@ -0,0 +1,543 @@
+/*
+ *  Copyright 2021,2022,2024,2025 Patrick T. Head
+ *
+ *  This program is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  @file strings-log.c
+ *
+ *  @brief Write-ahead log for libstrings
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "strings-log.h"
+
+  /**
+   *  @def LOG_GROUP_DEFAULT
+   *
+   *  @brief records written per sync when none is asked for
+   */
+
+#define LOG_GROUP_DEFAULT 64
+
+static int buf_reserve(string_log *log, size_t size);
+static int log_start(string_log *log, uint64_t base);
+static int log_replay(string_log *log,
+                      uint64_t base,
+                      int applying,
+                      string_log_action action,
+                      void *ctx,
+                      long *end);
+static int log_sync(string_log *log);
+static int file_truncate(FILE *f, long size);
+
+  /**
+   *  @fn string_log *string_log_open(const char *path, unsigned int group, uint64_t base, string_log_action action, void *ctx)
+   *
+   *  @brief opens the log file at @p path, replaying its records, for appending
+   *
+   *  A missing file is created.  A log of another base than @p base is
+   *  only replayed from a checkpoint of @p base on, the records before it
+   *  being part of @p base already; with no such checkpoint it is someone
+   *  else's log, and the open fails unless it holds no records.  The
+   *  replay stops at the first record cut short or failing its checksum,
+   *  what a crash in the middle of a write leaves, and the log is cut back
+   *  to the records before it.
+   *
+   *  @param path   - pointer to path of file
+   *  @param group  - number of records written per sync, 0 for the default
+   *  @param base   - stamp of the base the records apply to
+   *  @param action - pointer to function to call at each record replayed
+   *  @param ctx    - pointer passed to @p action
+   *
+   *  @return pointer to new @a string_log struct, NULL on failure or if
+   *          @p action stopped the replay
+   */
+
+string_log *string_log_open(const char *path,
+                            unsigned int group,
+                            uint64_t base,
+                            string_log_action action,
+                            void *ctx)
+{
+  string_log *log = NULL;
+  string_log_header h;
+  size_t n;
+  long end = 0;
+  int r;
+
+  if (!path || !action) return NULL;
+
+  log = calloc(1, sizeof(string_log));
+  if (!log) return NULL;
+
+  if (pthread_mutex_init(&log->lock, NULL))
+  {
+    free(log);
+    return NULL;
+  }
+
+  if (pthread_rwlock_init(&log->order, NULL))
+  {
+    pthread_mutex_destroy(&log->lock);
+    free(log);
+    return NULL;
+  }
+
+  log->group = group ? group : LOG_GROUP_DEFAULT;
+
+  log->file = fopen(path, "r+b");
+  if (!log->file) log->file = fopen(path, "w+b");
+  if (!log->file) goto fail;
+
+  n = fread(&h, 1, sizeof(h), log->file);
+
+    /*
+     *  A header cut short is a log that never got a record
+     */
+
+  if (n == sizeof(h) &&
+      (memcmp(h.magic, STRING_LOG_MAGIC, sizeof(h.magic)) || h.version != STRING_LOG_VERSION))
+    goto fail;
+
+  if (n < sizeof(h))
+  {
+    if (log_start(log, base)) goto fail;
+    return log;
+  }
+
+  r = log_replay(log, base, h.base == base, action, ctx, &end);
+  if (r < 0) goto fail;
+
+    /*
+     *  A log of another base with nothing for this one
+     */
+
+  if (r > 0)
+  {
+    if (end > (long)sizeof(h) || log_start(log, base)) goto fail;
+    return log;
+  }
+
+  if (fseek(log->file, end, SEEK_SET)) goto fail;
+  if (file_truncate(log->file, end)) goto fail;
+
+  return log;
+
+fail:
+  if (log->file) fclose(log->file);
+  pthread_rwlock_destroy(&log->order);
+  pthread_mutex_destroy(&log->lock);
+  free(log->buf);
+  free(log);
+  return NULL;
+}
+
+  /**
+   *  @fn int string_log_close(string_log *log)
+   *
+   *  @brief syncs and closes @p log, freeing it
+   *
+   *  @param log - pointer to existing @a string_log struct
+   *
+   *  @return 0 if every record reached the disk, non-zero if not
+   */
+
+int string_log_close(string_log *log)
+{
+  int r;
+
+  if (!log) return 0;
+
+  r = string_log_sync(log);
+  if (fclose(log->file)) r = 1;
+
+  pthread_rwlock_destroy(&log->order);
+  pthread_mutex_destroy(&log->lock);
+  free(log->buf);
+  free(log);
+
+  return r;
+}
+
+  /**
+   *  @fn int string_log_append(string_log *log, unsigned int op, unsigned int id, unsigned int refs, const char *text, size_t len)
+   *
+   *  @brief appends a record to @p log
+   *
+   *  Each record goes to the file in one write.  Every @a group records
+   *  the file is synced, so the records written meanwhile, by any thread,
+   *  share one sync.
+   *
+   *  @param log  - pointer to existing @a string_log struct
+   *  @param op   - STRING_LOG_ADD, STRING_LOG_REF or STRING_LOG_REMOVE
+   *  @param id   - id of entry
+   *  @param refs - references taken by an add or ref, 0 for a remove
+   *  @param text - pointer to text of entry
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return 0 if every write and sync so far succeeded, non-zero if not
+   */
+
+int string_log_append(string_log *log,
+                      unsigned int op,
+                      unsigned int id,
+                      unsigned int refs,
+                      const char *text,
+                      size_t len)
+{
+  string_log_record rec;
+  size_t size;
+  int r;
+
+  if (!log) return 1;
+
+  size = sizeof(rec) + len;
+
+  pthread_mutex_lock(&log->lock);
+
+  if (buf_reserve(log, size))
+  {
+    log->failed = 1;
+    goto exit;
+  }
+
+  rec.sum = 0;
+  rec.op = op;
+  rec.id = id;
+  rec.refs = refs;
+  rec.pad = 0;
+  rec.len = len;
+
+  memcpy(log->buf, &rec, sizeof(rec));
+  memcpy(log->buf + sizeof(rec), text, len);
+
+  rec.sum = strings_hash(log->buf + sizeof(rec.sum), size - sizeof(rec.sum));
+  memcpy(log->buf, &rec.sum, sizeof(rec.sum));
+
+  if (fwrite(log->buf, size, 1, log->file) != 1) log->failed = 1;
+  else if (++log->pending >= log->group) log_sync(log);
+
+exit:
+  r = log->failed;
+  pthread_mutex_unlock(&log->lock);
+
+  return r;
+}
+
+  /**
+   *  @fn int string_log_sync(string_log *log)
+   *
+   *  @brief syncs the records written to @p log to the disk
+   *
+   *  @param log - pointer to existing @a string_log struct
+   *
+   *  @return 0 if every write and sync so far succeeded, non-zero if not
+   */
+
+int string_log_sync(string_log *log)
+{
+  int r;
+
+  if (!log) return 1;
+
+  pthread_mutex_lock(&log->lock);
+
+  if (log->pending) log_sync(log);
+  r = log->failed;
+
+  pthread_mutex_unlock(&log->lock);
+
+  return r;
+}
+
+  /**
+   *  @fn int string_log_checkpoint(string_log *log, uint64_t stamp)
+   *
+   *  @brief appends a checkpoint of the snapshot stamped @p stamp to @p log
+   *         and syncs it
+   *
+   *  Written after the new snapshot is synced and before it replaces the
+   *  old one, so whichever snapshot a crash leaves, the log tells which of
+   *  its records to replay onto it.
+   *
+   *  @param log   - pointer to existing @a string_log struct
+   *  @param stamp - header checksum of the new snapshot
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+int string_log_checkpoint(string_log *log, uint64_t stamp)
+{
+  if (string_log_append(log, STRING_LOG_CHECKPOINT, 0, 0, (const char *)&stamp, sizeof(stamp))) return 1;
+
+  return string_log_sync(log);
+}
+
+  /**
+   *  @fn int string_log_reset(string_log *log, uint64_t base)
+   *
+   *  @brief empties @p log, whose records are now part of base @p base
+   *
+   *  @param log  - pointer to existing @a string_log struct
+   *  @param base - stamp of the new base
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+int string_log_reset(string_log *log, uint64_t base)
+{
+  int r;
+
+  if (!log) return 1;
+
+  pthread_mutex_lock(&log->lock);
+
+  r = log_start(log, base);
+  if (r) log->failed = 1;
+
+  pthread_mutex_unlock(&log->lock);
+
+  return r;
+}
+
+  /**
+   *  @fn void string_log_hold(string_log *log, int exclusive)
+   *
+   *  @brief holds off changes that must not be logged out of order with
+   *         the one about to be made
+   *
+   *  Held from before a change until its record is appended.  References
+   *  taken to an existing entry may be logged in any order, so they hold
+   *  @p log shared; a new entry or a remove holds it exclusive, so no
+   *  other change sees the entry before its record is taken, and none of
+   *  the same text is logged on either side of it out of turn.
+   *
+   *  @param log       - pointer to existing @a string_log struct
+   *  @param exclusive - non-zero to hold off every other change
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void string_log_hold(string_log *log, int exclusive)
+{
+  if (exclusive) pthread_rwlock_wrlock(&log->order);
+  else pthread_rwlock_rdlock(&log->order);
+}
+
+  /**
+   *  @fn void string_log_release(string_log *log)
+   *
+   *  @brief ends a string_log_hold()
+   *
+   *  @param log - pointer to existing @a string_log struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void string_log_release(string_log *log)
+{
+  pthread_rwlock_unlock(&log->order);
+}
+
+  /**
+   *  @fn int buf_reserve(string_log *log, size_t size)
+   *
+   *  @brief grows the record buffer of @p log, by doubling, to @p size bytes
+   *
+   *  @param log  - pointer to existing @a string_log struct
+   *  @param size - bytes needed
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int buf_reserve(string_log *log, size_t size)
+{
+  char *buf;
+  size_t n;
+
+  if (size <= log->buf_size) return 0;
+
+  n = log->buf_size ? log->buf_size : 256;
+  while (n < size) n *= 2;
+
+  buf = realloc(log->buf, n);
+  if (!buf) return 1;
+
+  log->buf = buf;
+  log->buf_size = n;
+
+  return 0;
+}
+
+  /**
+   *  @fn int log_start(string_log *log, uint64_t base)
+   *
+   *  @brief empties the file of @p log and writes a header for base @p base
+   *
+   *  @param log  - pointer to existing @a string_log struct
+   *  @param base - stamp of the base
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int log_start(string_log *log, uint64_t base)
+{
+  string_log_header h;
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, STRING_LOG_MAGIC, sizeof(h.magic));
+  h.version = STRING_LOG_VERSION;
+  h.base = base;
+
+  if (fseek(log->file, 0, SEEK_SET)) return 1;
+  if (file_truncate(log->file, 0)) return 1;
+  if (fwrite(&h, sizeof(h), 1, log->file) != 1) return 1;
+
+  log->pending = 1;
+
+  return log_sync(log);
+}
+
+  /**
+   *  @fn int log_replay(string_log *log, uint64_t base, int applying, string_log_action action, void *ctx, long *end)
+   *
+   *  @brief calls @p action for each whole record of @p log that applies
+   *         to base @p base
+   *
+   *  The file is positioned just past its header.  Records are skipped
+   *  until @p applying is set, by a checkpoint of @p base if not at the
+   *  start.  A checkpoint of another base is of a merge that never
+   *  replaced the snapshot, the records after it still apply.
+   *
+   *  @param log      - pointer to existing @a string_log struct
+   *  @param base     - stamp of the base being replayed onto
+   *  @param applying - non-zero if the log starts at @p base
+   *  @param action   - pointer to function to call at each record
+   *  @param ctx      - pointer passed to @p action
+   *  @param end      - pointer to receive position just past the last whole
+   *                    record
+   *
+   *  @return 0 on success, greater than 0 if nothing in the log applies to
+   *          @p base, less than 0 on failure or if @p action stopped the
+   *          replay
+   */
+
+static int log_replay(string_log *log,
+                      uint64_t base,
+                      int applying,
+                      string_log_action action,
+                      void *ctx,
+                      long *end)
+{
+  string_log_record rec;
+  uint64_t stamp;
+  long pos, size;
+
+  pos = (long)sizeof(string_log_header);
+
+  if (fseek(log->file, 0, SEEK_END)) return -1;
+  size = ftell(log->file);
+  if (size < 0 || fseek(log->file, pos, SEEK_SET)) return -1;
+
+  while (size - pos >= (long)sizeof(rec))
+  {
+    if (fread(&rec, sizeof(rec), 1, log->file) != 1) return -1;
+    if (rec.len > (uint64_t)(size - pos) - sizeof(rec)) break;
+
+    if (buf_reserve(log, sizeof(rec) + (size_t)rec.len)) return -1;
+
+    memcpy(log->buf, &rec, sizeof(rec));
+    if (rec.len && fread(log->buf + sizeof(rec), (size_t)rec.len, 1, log->file) != 1) return -1;
+
+    if (rec.sum != strings_hash(log->buf + sizeof(rec.sum), sizeof(rec) - sizeof(rec.sum) + (size_t)rec.len))
+      break;
+
+    if (rec.op == STRING_LOG_CHECKPOINT)
+    {
+      if (rec.len != sizeof(stamp)) return -1;
+      memcpy(&stamp, log->buf + sizeof(rec), sizeof(stamp));
+      if (stamp == base) applying = 1;
+    }
+    else if (applying && action(rec.op, rec.id, rec.refs, log->buf + sizeof(rec), (size_t)rec.len, ctx))
+      return -1;
+
+    pos += (long)(sizeof(rec) + rec.len);
+  }
+
+  *end = pos;
+
+  return !applying;
+}
+
+  /**
+   *  @fn int log_sync(string_log *log)
+   *
+   *  @brief flushes the file of @p log through to the disk, lock held
+   *
+   *  @param log - pointer to existing @a string_log struct
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int log_sync(string_log *log)
+{
+  int r;
+
+  r = fflush(log->file) != 0;
+
+#ifdef _WIN32
+  if (!r) r = _commit(_fileno(log->file)) != 0;
+#else
+  if (!r) r = fsync(fileno(log->file)) != 0;
+#endif
+
+  if (r) log->failed = 1;
+  log->pending = 0;
+
+  return r;
+}
+
+  /**
+   *  @fn int file_truncate(FILE *f, long size)
+   *
+   *  @brief cuts @p f back to @p size bytes
+   *
+   *  @param f    - pointer to open file
+   *  @param size - new size of file
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int file_truncate(FILE *f, long size)
+{
+  if (fflush(f)) return 1;
+
+#ifdef _WIN32
+  return _chsize(_fileno(f), size) != 0;
+#else
+  return ftruncate(fileno(f), (off_t)size) != 0;
+#endif
+}
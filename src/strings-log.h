@@ -0,0 +1,191 @@
+/*
+ *  Copyright 2021,2022,2024,2025 Patrick T. Head
+ *
+ *  This program is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  @file strings-log.h
+ *
+ *  @brief Internal header for the write-ahead log of libstrings
+ *
+ *  A log file is a @a string_log_header followed by records, each a
+ *  @a string_log_record and then the text of the record, in the byte
+ *  order of the machine that wrote it.  A record cut short or failing its
+ *  checksum ends the log; it and anything after it are dropped.
+ *
+ *  A checkpoint record, written when a layered table is about to be
+ *  merged into a new snapshot, holds the header checksum of that snapshot
+ *  as its text.  The records before it are part of the new snapshot, the
+ *  ones after it apply to whichever snapshot the table goes on with.
+ */
+
+#ifndef STRINGS_LOG_H
+#define STRINGS_LOG_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "libstrings.h"
+
+  /**
+   *  @def STRING_LOG_MAGIC
+   *
+   *  @brief first 8 bytes of a log file
+   */
+
+#define STRING_LOG_MAGIC "LIBSTRL\n"
+
+  /**
+   *  @def STRING_LOG_VERSION
+   *
+   *  @brief version of the log file format written
+   */
+
+#define STRING_LOG_VERSION 2
+
+  /**
+   *  @def STRING_LOG_ADD
+   *
+   *  @brief op of a record of a new entry
+   */
+
+#define STRING_LOG_ADD 1
+
+  /**
+   *  @def STRING_LOG_REMOVE
+   *
+   *  @brief op of a record of a removed entry
+   */
+
+#define STRING_LOG_REMOVE 2
+
+  /**
+   *  @def STRING_LOG_CHECKPOINT
+   *
+   *  @brief op of a record of a merge into a new snapshot
+   */
+
+#define STRING_LOG_CHECKPOINT 3
+
+  /**
+   *  @def STRING_LOG_REF
+   *
+   *  @brief op of a record of references taken to an existing entry
+   */
+
+#define STRING_LOG_REF 4
+
+  /**
+   *  @typedef string_log_action
+   *
+   *  @brief function called at each record replayed by string_log_open()
+   *
+   *  Returns non-zero to stop the replay, which then fails.
+   */
+
+typedef int (*string_log_action)(unsigned int op,
+                                 unsigned int id,
+                                 unsigned int refs,
+                                 const char *text,
+                                 size_t len,
+                                 void *ctx);
+
+  /**
+   *  @typedef struct string_log_header string_log_header
+   *
+   *  @brief create a type for @a string_log_header struct
+   */
+
+typedef struct string_log_header string_log_header;
+
+  /**
+   *  @struct string_log_header
+   *
+   *  @brief header at the start of a log file
+   *
+   *  The base is what the records apply to: the header checksum of the
+   *  snapshot a mapped table was opened from, 0 for a table built in
+   *  memory.
+   */
+
+struct string_log_header
+{
+  char magic[8];      /**<   STRING_LOG_MAGIC               */
+  uint32_t version;   /**<   STRING_LOG_VERSION             */
+  uint32_t pad;       /**<   zero                           */
+  uint64_t base;      /**<   stamp of base of the records   */
+};
+
+  /**
+   *  @typedef struct string_log_record string_log_record
+   *
+   *  @brief create a type for @a string_log_record struct
+   */
+
+typedef struct string_log_record string_log_record;
+
+  /**
+   *  @struct string_log_record
+   *
+   *  @brief fixed part of one record of a log file
+   */
+
+struct string_log_record
+{
+  uint64_t sum;    /**<   strings_hash() of rest of record and its text   */
+  uint32_t op;     /**<   STRING_LOG_ADD, _REMOVE, _CHECKPOINT or _REF    */
+  uint32_t id;     /**<   id of entry                                     */
+  uint32_t refs;   /**<   references taken by an add or ref, else zero    */
+  uint32_t pad;    /**<   zero                                            */
+  uint64_t len;    /**<   length of text following in bytes               */
+};
+
+  /**
+   *  @struct string_log
+   *
+   *  @brief an open log file
+   */
+
+struct string_log
+{
+  FILE *file;              /**<   log file, positioned at its end          */
+  pthread_rwlock_t order;  /**<   keeps records in the order of changes    */
+  pthread_mutex_t lock;    /**<   guards everything below                  */
+  unsigned int group;      /**<   records written per sync                 */
+  unsigned int pending;    /**<   records written since the last sync      */
+  int failed;              /**<   non-zero once a write or sync failed     */
+  char *buf;               /**<   record being written                     */
+  size_t buf_size;         /**<   bytes allocated to buf                   */
+};
+
+string_log *string_log_open(const char *path,
+                            unsigned int group,
+                            uint64_t base,
+                            string_log_action action,
+                            void *ctx);
+int string_log_close(string_log *log);
+int string_log_append(string_log *log,
+                      unsigned int op,
+                      unsigned int id,
+                      unsigned int refs,
+                      const char *text,
+                      size_t len);
+int string_log_sync(string_log *log);
+int string_log_checkpoint(string_log *log, uint64_t stamp);
+int string_log_reset(string_log *log, uint64_t base);
+void string_log_hold(string_log *log, int exclusive);
+void string_log_release(string_log *log);
+
+#endif //STRINGS_LOG_H
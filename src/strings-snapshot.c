@@ -0,0 +1,1009 @@
+/*
+ *  Copyright 2021,2022,2024,2025 Patrick T. Head
+ *
+ *  This program is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  @file strings-snapshot.c
+ *
+ *  @brief Memory mapped snapshot files for libstrings
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "strings-snapshot.h"
+
+  /**
+   *  @def SNAPSHOT_ALIGN
+   *
+   *  @brief alignment of each section of a snapshot file
+   */
+
+#define SNAPSHOT_ALIGN 8
+
+  /**
+   *  @def SNAPSHOT_INDEX_MIN
+   *
+   *  @brief fewest hash index slots of a snapshot file
+   */
+
+#define SNAPSHOT_INDEX_MIN 8
+
+  /**
+   *  @def SNAPSHOT_RECORD_CHUNK
+   *
+   *  @brief number of ids whose entries are made at once, on the first
+   *         lookup of any of them
+   */
+
+#define SNAPSHOT_RECORD_CHUNK 256
+
+  /**
+   *  @typedef struct order_list order_list
+   *
+   *  @brief ids collected in text order while saving
+   */
+
+typedef struct
+{
+  uint32_t *id;         /**<   ids in text order   */
+  unsigned int n;       /**<   number of ids       */
+  unsigned int size;    /**<   slots in @a id      */
+} order_list;
+
+static int order_action(avl_node *n, void *ctx);
+static uint64_t checksum(uint64_t sum, const void *p, size_t len);
+static uint64_t align_up(uint64_t n);
+static int write_sum(FILE *f, const void *p, size_t len, uint64_t *sum);
+static int write_pad(FILE *f, uint64_t from, uint64_t to, uint64_t *sum);
+static int file_map(const char *path, void **base, size_t *size);
+static void file_unmap(void *base, size_t size);
+static int file_sync(FILE *f);
+static int file_replace(const char *from, const char *to);
+static int text_of(string_snapshot *ss, uint32_t id, const char **text, size_t *len);
+static int is_removed(string_snapshot *ss, uint32_t id);
+static string_node *record_of(string_snapshot *ss, uint32_t id);
+static string_node *record_chunk(string_snapshot *ss, unsigned int c);
+static int order_compare(string_snapshot *ss, unsigned int i, const char *text, size_t len);
+static unsigned int order_bound(string_snapshot *ss, const char *text, size_t len, int after);
+
+  /**
+   *  @fn int string_snapshot_save(strings *strs, const char *path, string_snapshot_commit commit, void *ctx)
+   *
+   *  @brief writes the entries of @p strs to a snapshot file at @p path
+   *
+   *  The file is written beside @p path and renamed over it once it is
+   *  complete and synced, so @p path always holds a whole snapshot.  Ids
+   *  and reference counts are kept.  @p strs must not change while it is
+   *  saved.
+   *
+   *  @param strs   - pointer to existing @a strings struct
+   *  @param path   - pointer to path of file
+   *  @param commit - pointer to function to call before the rename, may be
+   *                  NULL
+   *  @param ctx    - pointer passed to @p commit
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+int string_snapshot_save(strings *strs,
+                         const char *path,
+                         string_snapshot_commit commit,
+                         void *ctx)
+{
+  string_snapshot_header h;
+  string_snapshot_slot *index = NULL;
+  uint64_t *offsets = NULL;
+  uint32_t *counts = NULL;
+  order_list ol;
+  string *s;
+  char *tmp = NULL;
+  FILE *f = NULL;
+  uint64_t pos, sum;
+  unsigned int id_end, i, j, size;
+  int r = 1;
+
+  memset(&ol, 0, sizeof(ol));
+
+  if (!strs || !path) goto bail;
+
+  if (strings_walk_with_context(strs, string_text, order_action, &ol)) goto bail;
+
+  id_end = strs->last_id;
+
+  offsets = malloc(((size_t)id_end + 1) * sizeof(uint64_t));
+  counts = calloc((size_t)id_end + 1, sizeof(uint32_t));
+  if (!offsets || !counts) goto bail;
+
+  for (pos = 0, i = 0; i < id_end; i++)
+  {
+    offsets[i] = pos;
+    if ((s = strings_find_by_id(strs, i)))
+    {
+      pos += s->len + 1;
+      counts[i] = s->ref_cnt;
+    }
+  }
+  offsets[id_end] = pos;
+
+    /*
+     *  At most half full, so a probe for a missing text ends soon
+     */
+
+  size = SNAPSHOT_INDEX_MIN;
+  while (size < 2 * (uint64_t)ol.n) size *= 2;
+
+  index = calloc(size, sizeof(string_snapshot_slot));
+  if (!index) goto bail;
+
+  for (i = 0; i < ol.n; i++)
+  {
+    if (ol.id[i] >= id_end) goto bail;
+
+    s = strings_find_by_id(strs, ol.id[i]);
+    if (!s) goto bail;
+
+    for (j = s->hash & (size - 1); index[j].ref; j = (j + 1) & (size - 1))
+      ;
+
+    index[j].ref = ol.id[i] + 1;
+    index[j].tag = (uint32_t)(s->hash >> 32);
+  }
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, STRING_SNAPSHOT_MAGIC, sizeof(h.magic));
+  h.version = STRING_SNAPSHOT_VERSION;
+  h.endian = STRING_SNAPSHOT_ENDIAN;
+  h.order = strs->order;
+  h.id_end = id_end;
+  h.count = ol.n;
+  h.index_size = size;
+  h.text_size = pos;
+  h.offsets_at = align_up(sizeof(h));
+  h.counts_at = align_up(h.offsets_at + ((uint64_t)id_end + 1) * sizeof(uint64_t));
+  h.index_at = align_up(h.counts_at + (uint64_t)id_end * sizeof(uint32_t));
+  h.order_at = align_up(h.index_at + (uint64_t)size * sizeof(string_snapshot_slot));
+  h.text_at = align_up(h.order_at + (uint64_t)ol.n * sizeof(uint32_t));
+  h.size = h.text_at + h.text_size;
+
+  tmp = malloc(strlen(path) + 5);
+  if (!tmp) goto bail;
+  sprintf(tmp, "%s.tmp", path);
+
+  f = fopen(tmp, "wb");
+  if (!f) goto bail;
+
+    /*
+     *  The header goes in last, once the body checksum is known
+     */
+
+  sum = strings_hash(NULL, 0);
+
+  if (fwrite(&h, sizeof(h), 1, f) != 1) goto bail;
+  if (write_pad(f, sizeof(h), h.offsets_at, &sum)) goto bail;
+  if (write_sum(f, offsets, ((size_t)id_end + 1) * sizeof(uint64_t), &sum)) goto bail;
+  if (write_pad(f, h.offsets_at + ((uint64_t)id_end + 1) * sizeof(uint64_t), h.counts_at, &sum)) goto bail;
+  if (write_sum(f, counts, (size_t)id_end * sizeof(uint32_t), &sum)) goto bail;
+  if (write_pad(f, h.counts_at + (uint64_t)id_end * sizeof(uint32_t), h.index_at, &sum)) goto bail;
+  if (write_sum(f, index, (size_t)size * sizeof(string_snapshot_slot), &sum)) goto bail;
+  if (write_pad(f, h.index_at + (uint64_t)size * sizeof(string_snapshot_slot), h.order_at, &sum)) goto bail;
+  if (write_sum(f, ol.id, (size_t)ol.n * sizeof(uint32_t), &sum)) goto bail;
+  if (write_pad(f, h.order_at + (uint64_t)ol.n * sizeof(uint32_t), h.text_at, &sum)) goto bail;
+
+  for (i = 0; i < id_end; i++)
+  {
+    if (offsets[i] == offsets[i + 1]) continue;
+
+    s = strings_find_by_id(strs, i);
+    if (!s || s->len + 1 != offsets[i + 1] - offsets[i]) goto bail;
+    if (write_sum(f, s->text, s->len + 1, &sum)) goto bail;
+  }
+
+  h.body_sum = sum;
+  h.header_sum = checksum(strings_hash(NULL, 0), &h, offsetof(string_snapshot_header, header_sum));
+
+  if (fseek(f, 0, SEEK_SET)) goto bail;
+  if (fwrite(&h, sizeof(h), 1, f) != 1) goto bail;
+  if (file_sync(f)) goto bail;
+
+  r = fclose(f);
+  f = NULL;
+  if (r) goto bail;
+
+  r = commit ? commit(h.header_sum, ctx) : 0;
+  if (r) goto bail;
+
+  r = file_replace(tmp, path);
+
+bail:
+  if (f) fclose(f);
+  if (r && tmp) remove(tmp);
+  free(tmp);
+  free(index);
+  free(counts);
+  free(offsets);
+  free(ol.id);
+
+  return r;
+}
+
+  /**
+   *  @fn string_snapshot *string_snapshot_open(const char *path)
+   *
+   *  @brief maps the snapshot file at @p path
+   *
+   *  The header and the bounds of every section are checked, but not the
+   *  body checksum, so opening costs the same for any size of file;
+   *  string_snapshot_verify() checks the body.
+   *
+   *  @param path - pointer to path of file
+   *
+   *  @return pointer to new @a string_snapshot struct, NULL on failure
+   */
+
+string_snapshot *string_snapshot_open(const char *path)
+{
+  string_snapshot *ss = NULL;
+  const string_snapshot_header *h;
+  void *base = NULL;
+  size_t size = 0;
+
+  if (!path) goto fail;
+
+  if (file_map(path, &base, &size)) goto fail;
+  if (size < sizeof(string_snapshot_header)) goto fail;
+
+  h = base;
+
+  if (memcmp(h->magic, STRING_SNAPSHOT_MAGIC, sizeof(h->magic)) ||
+      h->version != STRING_SNAPSHOT_VERSION ||
+      h->endian != STRING_SNAPSHOT_ENDIAN ||
+      h->header_sum != checksum(strings_hash(NULL, 0), h, offsetof(string_snapshot_header, header_sum)))
+    goto fail;
+
+  if (h->order > string_order_art ||
+      h->size != size ||
+      h->count > h->id_end ||
+      h->index_size <= h->count ||
+      (h->index_size & (h->index_size - 1)) ||
+      h->offsets_at < sizeof(string_snapshot_header) ||
+      h->offsets_at % SNAPSHOT_ALIGN ||
+      h->counts_at % SNAPSHOT_ALIGN ||
+      h->index_at % SNAPSHOT_ALIGN ||
+      h->order_at % SNAPSHOT_ALIGN ||
+      h->offsets_at + ((uint64_t)h->id_end + 1) * sizeof(uint64_t) > h->counts_at ||
+      h->counts_at + (uint64_t)h->id_end * sizeof(uint32_t) > h->index_at ||
+      h->index_at + (uint64_t)h->index_size * sizeof(string_snapshot_slot) > h->order_at ||
+      h->order_at + (uint64_t)h->count * sizeof(uint32_t) > h->text_at ||
+      h->text_at > size ||
+      h->text_size != size - h->text_at)
+    goto fail;
+
+  ss = malloc(sizeof(string_snapshot));
+  if (!ss) goto fail;
+
+  ss->base = base;
+  ss->size = size;
+  ss->header = h;
+  ss->offsets = (const uint64_t *)((const char *)base + h->offsets_at);
+  ss->counts = (const uint32_t *)((const char *)base + h->counts_at);
+  ss->index = (const string_snapshot_slot *)((const char *)base + h->index_at);
+  ss->order = (const uint32_t *)((const char *)base + h->order_at);
+  ss->text = (const char *)base + h->text_at;
+  ss->removed = NULL;
+  ss->records = NULL;
+
+  if (ss->offsets[h->id_end] != h->text_size) goto fail;
+
+  return ss;
+
+fail:
+  free(ss);
+  if (base) file_unmap(base, size);
+  return NULL;
+}
+
+  /**
+   *  @fn void string_snapshot_free(string_snapshot *ss)
+   *
+   *  @brief unmaps the file of @p ss and frees @p ss
+   *
+   *  @param ss - pointer to existing @a string_snapshot struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void string_snapshot_free(string_snapshot *ss)
+{
+  unsigned int c;
+
+  if (!ss) return;
+
+  if (ss->records)
+  {
+    for (c = 0; c < (ss->header->id_end + SNAPSHOT_RECORD_CHUNK - 1) / SNAPSHOT_RECORD_CHUNK; c++)
+      free(ss->records[c]);
+    free(ss->records);
+  }
+
+  file_unmap(ss->base, ss->size);
+  free(ss->removed);
+  free(ss);
+}
+
+  /**
+   *  @fn int string_snapshot_verify(string_snapshot *ss)
+   *
+   *  @brief checks the body of the file of @p ss against its checksum
+   *
+   *  @param ss - pointer to existing @a string_snapshot struct
+   *
+   *  @return 0 if the body is intact, non-zero if not
+   */
+
+int string_snapshot_verify(string_snapshot *ss)
+{
+  uint64_t sum;
+
+  if (!ss) return 1;
+
+  sum = checksum(strings_hash(NULL, 0),
+                 (const char *)ss->base + sizeof(string_snapshot_header),
+                 ss->size - sizeof(string_snapshot_header));
+
+  return sum != ss->header->body_sum;
+}
+
+  /**
+   *  @fn string_node *string_snapshot_get(string_snapshot *ss, unsigned int id)
+   *
+   *  @brief returns entry with id @p id of @p ss
+   *
+   *  Every lookup of an id returns the same entry, whose text points into
+   *  the mapping; it stays valid until @p ss is freed.  The entries of
+   *  SNAPSHOT_RECORD_CHUNK ids are made together on the first lookup of
+   *  any of them, and published with a compare and swap, so any number of
+   *  threads may look up at once.
+   *
+   *  @param ss - pointer to existing @a string_snapshot struct
+   *  @param id - id of entry
+   *
+   *  @return pointer to entry, NULL if there is none
+   */
+
+string_node *string_snapshot_get(string_snapshot *ss, unsigned int id)
+{
+  if (!ss || id >= ss->header->id_end || is_removed(ss, id)) return NULL;
+
+  return record_of(ss, id);
+}
+
+  /**
+   *  @fn string_node *string_snapshot_find(string_snapshot *ss, const char *text, size_t len, uint64_t hash)
+   *
+   *  @brief returns entry of @p ss with the text of the @p len bytes at @p text
+   *
+   *  The high half of the hash kept in each slot rules out almost every
+   *  other entry without touching its text.  The entry is as from
+   *  string_snapshot_get().
+   *
+   *  @param ss   - pointer to existing @a string_snapshot struct
+   *  @param text - pointer to text to find
+   *  @param len  - length of @p text in bytes
+   *  @param hash - strings_hash() of @p text
+   *
+   *  @return pointer to entry, NULL if there is none
+   */
+
+string_node *string_snapshot_find(string_snapshot *ss,
+                                  const char *text,
+                                  size_t len,
+                                  uint64_t hash)
+{
+  const string_snapshot_slot *slot;
+  const char *t;
+  size_t l;
+  uint32_t mask, i, n;
+
+  if (!ss || !text) return NULL;
+
+  mask = ss->header->index_size - 1;
+
+  for (i = hash & mask, n = 0; n <= mask; i = (i + 1) & mask, n++)
+  {
+    slot = &ss->index[i];
+    if (!slot->ref) break;
+    if (slot->tag != (uint32_t)(hash >> 32)) continue;
+    if (text_of(ss, slot->ref - 1, &t, &l)) continue;
+    if (l != len || memcmp(t, text, len)) continue;
+    if (is_removed(ss, slot->ref - 1)) break;
+    return record_of(ss, slot->ref - 1);
+  }
+
+  return NULL;
+}
+
+  /**
+   *  @fn string_node *string_snapshot_at(string_snapshot *ss, unsigned int i)
+   *
+   *  @brief returns entry @p i of @p ss in text order
+   *
+   *  The entry is as from string_snapshot_get().
+   *
+   *  @param ss - pointer to existing @a string_snapshot struct
+   *  @param i  - position in text order, below the entry count of the file
+   *
+   *  @return pointer to entry, NULL if it was removed
+   */
+
+string_node *string_snapshot_at(string_snapshot *ss, unsigned int i)
+{
+  if (!ss || i >= ss->header->count) return NULL;
+
+  return string_snapshot_get(ss, ss->order[i]);
+}
+
+  /**
+   *  @fn int string_snapshot_remove(string_snapshot *ss, unsigned int id)
+   *
+   *  @brief hides the entry with id @p id of @p ss from every lookup
+   *
+   *  The file is not changed, removal only lasts while @p ss is mapped.
+   *
+   *  @param ss - pointer to existing @a string_snapshot struct
+   *  @param id - id of entry
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+int string_snapshot_remove(string_snapshot *ss, unsigned int id)
+{
+  if (!ss || id >= ss->header->id_end) return 1;
+
+  if (!ss->removed)
+  {
+    ss->removed = calloc(((size_t)ss->header->id_end + 63) / 64, sizeof(uint64_t));
+    if (!ss->removed) return 1;
+  }
+
+  ss->removed[id / 64] |= (uint64_t)1 << (id % 64);
+
+  return 0;
+}
+
+  /**
+   *  @fn void string_snapshot_restore(string_snapshot *ss, unsigned int id)
+   *
+   *  @brief undoes a string_snapshot_remove() of id @p id of @p ss
+   *
+   *  @param ss - pointer to existing @a string_snapshot struct
+   *  @param id - id of entry
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void string_snapshot_restore(string_snapshot *ss, unsigned int id)
+{
+  if (!ss || !ss->removed || id >= ss->header->id_end) return;
+
+  ss->removed[id / 64] &= ~((uint64_t)1 << (id % 64));
+}
+
+  /**
+   *  @fn string_node *string_snapshot_seek(string_snapshot *ss, const char *text, size_t len, int forward, int inclusive)
+   *
+   *  @brief finds the entry of @p ss nearest to @p text in one direction
+   *
+   *  A binary search of the order section, then a step past any removed
+   *  entries.
+   *
+   *  @param ss        - pointer to existing @a string_snapshot struct
+   *  @param text      - pointer to text, NULL for the first (or last) entry
+   *  @param len       - length of @p text in bytes
+   *  @param forward   - non-zero for the first entry after @p text, zero for
+   *                     the last entry before it
+   *  @param inclusive - non-zero if an entry equal to @p text qualifies
+   *
+   *  @return pointer to entry, NULL if there is none
+   */
+
+string_node *string_snapshot_seek(string_snapshot *ss,
+                                  const char *text,
+                                  size_t len,
+                                  int forward,
+                                  int inclusive)
+{
+  string_node *sn = NULL;
+  unsigned int i, count;
+
+  if (!ss) return NULL;
+
+  count = ss->header->count;
+
+  if (forward)
+  {
+    i = text ? order_bound(ss, text, len, !inclusive) : 0;
+    for ( ; i < count && !(sn = string_snapshot_at(ss, i)); i++)
+      ;
+    return sn;
+  }
+
+  i = text ? order_bound(ss, text, len, inclusive) : count;
+  for ( ; i > 0 && !(sn = string_snapshot_at(ss, i - 1)); i--)
+    ;
+  return sn;
+}
+
+  /**
+   *  @fn int order_action(avl_node *n, void *ctx)
+   *
+   *  @brief appends the id of entry @p n to the @a order_list at @p ctx
+   *
+   *  @param n   - pointer to entry
+   *  @param ctx - pointer to @a order_list
+   *
+   *  @return 0 on success, non-zero to stop the walk on failure
+   */
+
+static int order_action(avl_node *n, void *ctx)
+{
+  order_list *ol = ctx;
+  uint32_t *id;
+  unsigned int size;
+
+  if (ol->n == ol->size)
+  {
+    size = ol->size ? ol->size * 2 : 1024;
+    id = realloc(ol->id, (size_t)size * sizeof(uint32_t));
+    if (!id) return 1;
+    ol->id = id;
+    ol->size = size;
+  }
+
+  ol->id[ol->n++] = ((string_node *)n)->value.id;
+
+  return 0;
+}
+
+  /**
+   *  @fn uint64_t checksum(uint64_t sum, const void *p, size_t len)
+   *
+   *  @brief continues the strings_hash() @p sum over the @p len bytes at @p p
+   *
+   *  @param sum - checksum so far, strings_hash(NULL, 0) to start
+   *  @param p   - pointer to bytes
+   *  @param len - number of bytes
+   *
+   *  @return checksum including the bytes at @p p
+   */
+
+static uint64_t checksum(uint64_t sum, const void *p, size_t len)
+{
+  const unsigned char *b = p;
+
+  while (len--)
+  {
+    sum ^= *b++;
+    sum *= 0x100000001b3ULL;
+  }
+
+  return sum;
+}
+
+  /**
+   *  @fn uint64_t align_up(uint64_t n)
+   *
+   *  @brief rounds @p n up to a multiple of SNAPSHOT_ALIGN
+   *
+   *  @param n - position in file
+   *
+   *  @return rounded position
+   */
+
+static uint64_t align_up(uint64_t n)
+{
+  return (n + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+}
+
+  /**
+   *  @fn int write_sum(FILE *f, const void *p, size_t len, uint64_t *sum)
+   *
+   *  @brief writes the @p len bytes at @p p to @p f, adding them to @p sum
+   *
+   *  @param f   - pointer to open file
+   *  @param p   - pointer to bytes
+   *  @param len - number of bytes
+   *  @param sum - pointer to checksum so far
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int write_sum(FILE *f, const void *p, size_t len, uint64_t *sum)
+{
+  if (!len) return 0;
+
+  *sum = checksum(*sum, p, len);
+
+  return fwrite(p, len, 1, f) != 1;
+}
+
+  /**
+   *  @fn int write_pad(FILE *f, uint64_t from, uint64_t to, uint64_t *sum)
+   *
+   *  @brief writes zero bytes to @p f from position @p from up to @p to
+   *
+   *  @param f    - pointer to open file
+   *  @param from - position in file
+   *  @param to   - aligned position to pad to, less than SNAPSHOT_ALIGN past
+   *                @p from
+   *  @param sum  - pointer to checksum so far
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int write_pad(FILE *f, uint64_t from, uint64_t to, uint64_t *sum)
+{
+  static const char zero[SNAPSHOT_ALIGN];
+
+  return write_sum(f, zero, (size_t)(to - from), sum);
+}
+
+  /**
+   *  @fn int file_map(const char *path, void **base, size_t *size)
+   *
+   *  @brief maps the whole file at @p path read only
+   *
+   *  @param path - pointer to path of file
+   *  @param base - pointer to receive start of mapping
+   *  @param size - pointer to receive size of mapping
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int file_map(const char *path, void **base, size_t *size)
+{
+#ifdef _WIN32
+  HANDLE file, map;
+  LARGE_INTEGER li;
+
+  file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return 1;
+
+  if (!GetFileSizeEx(file, &li) || li.QuadPart <= 0 || (uint64_t)li.QuadPart > (size_t)-1)
+  {
+    CloseHandle(file);
+    return 1;
+  }
+
+  map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (!map) return 1;
+
+  *base = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(map);
+  if (!*base) return 1;
+
+  *size = (size_t)li.QuadPart;
+#else
+  struct stat st;
+  void *p;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return 1;
+
+  if (fstat(fd, &st) || st.st_size <= 0 || (uint64_t)st.st_size > (size_t)-1)
+  {
+    close(fd);
+    return 1;
+  }
+
+  p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return 1;
+
+  *base = p;
+  *size = (size_t)st.st_size;
+#endif
+
+  return 0;
+}
+
+  /**
+   *  @fn void file_unmap(void *base, size_t size)
+   *
+   *  @brief unmaps a mapping made by file_map()
+   *
+   *  @param base - start of mapping
+   *  @param size - size of mapping
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void file_unmap(void *base, size_t size)
+{
+#ifdef _WIN32
+  (void)size;
+  UnmapViewOfFile(base);
+#else
+  munmap(base, size);
+#endif
+}
+
+  /**
+   *  @fn int file_sync(FILE *f)
+   *
+   *  @brief flushes @p f through to the disk
+   *
+   *  @param f - pointer to open file
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int file_sync(FILE *f)
+{
+  if (fflush(f)) return 1;
+
+#ifdef _WIN32
+  return _commit(_fileno(f)) != 0;
+#else
+  return fsync(fileno(f)) != 0;
+#endif
+}
+
+  /**
+   *  @fn int file_replace(const char *from, const char *to)
+   *
+   *  @brief renames file @p from to @p to, replacing any file there
+   *
+   *  @param from - pointer to path of file
+   *  @param to   - pointer to new path of file
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int file_replace(const char *from, const char *to)
+{
+#ifdef _WIN32
+  return !MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+  return rename(from, to) != 0;
+#endif
+}
+
+  /**
+   *  @fn int text_of(string_snapshot *ss, uint32_t id, const char **text, size_t *len)
+   *
+   *  @brief finds the text of id @p id in @p ss
+   *
+   *  Offsets come from the file, so each is checked before it is used.
+   *
+   *  @param ss   - pointer to existing @a string_snapshot struct
+   *  @param id   - id of entry
+   *  @param text - pointer to receive pointer to text
+   *  @param len  - pointer to receive length of text
+   *
+   *  @return 0 on success, non-zero if @p id has no entry
+   */
+
+static int text_of(string_snapshot *ss, uint32_t id, const char **text, size_t *len)
+{
+  uint64_t a, b;
+
+  if (id >= ss->header->id_end) return 1;
+
+  a = ss->offsets[id];
+  b = ss->offsets[id + 1];
+  if (a >= b || b > ss->header->text_size || ss->text[b - 1]) return 1;
+
+  *text = ss->text + a;
+  *len = (size_t)(b - a - 1);
+
+  return 0;
+}
+
+  /**
+   *  @fn int is_removed(string_snapshot *ss, uint32_t id)
+   *
+   *  @brief tells if id @p id of @p ss was removed through a layered table
+   *
+   *  @param ss - pointer to existing @a string_snapshot struct
+   *  @param id - id below the id count of the file
+   *
+   *  @return non-zero if removed, 0 if not
+   */
+
+static int is_removed(string_snapshot *ss, uint32_t id)
+{
+  if (!ss->removed || id >= ss->header->id_end) return 0;
+
+  return (ss->removed[id / 64] >> (id % 64)) & 1;
+}
+
+  /**
+   *  @fn string_node *record_of(string_snapshot *ss, uint32_t id)
+   *
+   *  @brief returns the entry handed out for id @p id of @p ss
+   *
+   *  @param ss - pointer to existing @a string_snapshot struct
+   *  @param id - id below the id count of the file
+   *
+   *  @return pointer to entry, NULL if @p id has none or on failure
+   */
+
+static string_node *record_of(string_snapshot *ss, uint32_t id)
+{
+  string_node **dir, **expected_dir = NULL;
+  string_node *chunk, *expected = NULL, *sn;
+  unsigned int c;
+
+  dir = __atomic_load_n(&ss->records, __ATOMIC_ACQUIRE);
+
+  if (!dir)
+  {
+    dir = calloc((ss->header->id_end + SNAPSHOT_RECORD_CHUNK - 1) / SNAPSHOT_RECORD_CHUNK,
+                 sizeof(string_node *));
+    if (!dir) return NULL;
+
+    if (!__atomic_compare_exchange_n(&ss->records, &expected_dir, dir, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      free(dir);
+      dir = expected_dir;
+    }
+  }
+
+  c = id / SNAPSHOT_RECORD_CHUNK;
+
+  chunk = __atomic_load_n(&dir[c], __ATOMIC_ACQUIRE);
+
+  if (!chunk)
+  {
+    chunk = record_chunk(ss, c);
+    if (!chunk) return NULL;
+
+    if (!__atomic_compare_exchange_n(&dir[c], &expected, chunk, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      free(chunk);
+      chunk = expected;
+    }
+  }
+
+  sn = &chunk[id % SNAPSHOT_RECORD_CHUNK];
+
+  return sn->value.text ? sn : NULL;
+}
+
+  /**
+   *  @fn string_node *record_chunk(string_snapshot *ss, unsigned int c)
+   *
+   *  @brief makes the entries of the ids of chunk @p c of @p ss
+   *
+   *  An id with no entry is left zeroed, its text NULL.
+   *
+   *  @param ss - pointer to existing @a string_snapshot struct
+   *  @param c  - chunk number
+   *
+   *  @return pointer to SNAPSHOT_RECORD_CHUNK entries, NULL on failure
+   */
+
+static string_node *record_chunk(string_snapshot *ss, unsigned int c)
+{
+  string_node *chunk, *sn;
+  const char *text;
+  size_t len;
+  uint32_t id;
+  unsigned int i;
+
+  chunk = calloc(SNAPSHOT_RECORD_CHUNK, sizeof(string_node));
+  if (!chunk) return NULL;
+
+  for (i = 0; i < SNAPSHOT_RECORD_CHUNK; i++)
+  {
+    id = c * SNAPSHOT_RECORD_CHUNK + i;
+    if (text_of(ss, id, &text, &len)) continue;
+
+    sn = &chunk[i];
+    sn->value.ref_cnt = ss->counts[id];
+    sn->value.id = id;
+    sn->value.text = (char *)text;
+    sn->value.len = len;
+    sn->value.hash = strings_hash(text, len);
+    memcpy(sn->key, text, len < sizeof(sn->key) ? len : sizeof(sn->key));
+  }
+
+  return chunk;
+}
+
+  /**
+   *  @fn int order_compare(string_snapshot *ss, unsigned int i, const char *text, size_t len)
+   *
+   *  @brief compares entry @p i of the order section of @p ss with @p text
+   *
+   *  @param ss   - pointer to existing @a string_snapshot struct
+   *  @param i    - position in order section
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return less than, equal to or greater than 0 as the entry sorts
+   *          before, with or after @p text
+   */
+
+static int order_compare(string_snapshot *ss, unsigned int i, const char *text, size_t len)
+{
+  const char *t;
+  size_t l;
+  int c;
+
+  if (text_of(ss, ss->order[i], &t, &l))
+  {
+    t = "";
+    l = 0;
+  }
+
+  c = memcmp(t, text, l < len ? l : len);
+  if (c) return c;
+
+  return (l > len) - (l < len);
+}
+
+  /**
+   *  @fn unsigned int order_bound(string_snapshot *ss, const char *text, size_t len, int after)
+   *
+   *  @brief finds the first position in the order section of @p ss whose
+   *         entry sorts after @p text, or with it unless @p after is set
+   *
+   *  @param ss    - pointer to existing @a string_snapshot struct
+   *  @param text  - pointer to text
+   *  @param len   - length of @p text in bytes
+   *  @param after - non-zero to skip entries equal to @p text
+   *
+   *  @return position, the entry count if there is none
+   */
+
+static unsigned int order_bound(string_snapshot *ss, const char *text, size_t len, int after)
+{
+  unsigned int lo = 0, hi, mid;
+  int c;
+
+  hi = ss->header->count;
+
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    c = order_compare(ss, mid, text, len);
+    if (c < 0 || (after && !c)) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return lo;
+}
@@ -0,0 +1,175 @@
+/*
+ *  Copyright 2021,2022,2024,2025 Patrick T. Head
+ *
+ *  This program is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  @file strings-snapshot.h
+ *
+ *  @brief Internal header for the memory mapped snapshot files of libstrings
+ *
+ *  A snapshot file is a header followed by five sections, each starting
+ *  on an 8 byte boundary, in the byte order of the machine that wrote it:
+ *
+ *  - offsets: one uint64_t per id and one more, the text blob offset of
+ *    the text of each id; an id whose offset equals the next one's has no
+ *    entry
+ *  - counts:  the reference count of each id as uint32_t
+ *  - index:   open addressing hash index of @a string_snapshot_slot
+ *  - order:   the id of each entry as uint32_t, in text order
+ *  - text:    the text of each entry in id order, each NUL terminated
+ */
+
+#ifndef STRINGS_SNAPSHOT_H
+#define STRINGS_SNAPSHOT_H
+
+#include "libstrings.h"
+
+  /**
+   *  @def STRING_SNAPSHOT_MAGIC
+   *
+   *  @brief first 8 bytes of a snapshot file
+   */
+
+#define STRING_SNAPSHOT_MAGIC "LIBSTRS\n"
+
+  /**
+   *  @def STRING_SNAPSHOT_VERSION
+   *
+   *  @brief version of the snapshot file format written
+   */
+
+#define STRING_SNAPSHOT_VERSION 2
+
+  /**
+   *  @def STRING_SNAPSHOT_ENDIAN
+   *
+   *  @brief byte order mark of a snapshot file, reads back unchanged only in the same byte order
+   */
+
+#define STRING_SNAPSHOT_ENDIAN 0x01020304U
+
+  /**
+   *  @typedef string_snapshot_commit
+   *
+   *  @brief function called by string_snapshot_save() with the header
+   *         checksum of the new file, once it is synced and before it
+   *         replaces the old one
+   *
+   *  Returns non-zero to keep the old file, which makes the save fail.
+   */
+
+typedef int (*string_snapshot_commit)(uint64_t stamp, void *ctx);
+
+  /**
+   *  @typedef struct string_snapshot_header string_snapshot_header
+   *
+   *  @brief create a type for @a string_snapshot_header struct
+   */
+
+typedef struct string_snapshot_header string_snapshot_header;
+
+  /**
+   *  @struct string_snapshot_header
+   *
+   *  @brief header at the start of a snapshot file
+   *
+   *  Section positions are byte offsets from the start of the file.
+   */
+
+struct string_snapshot_header
+{
+  char magic[8];           /**<   STRING_SNAPSHOT_MAGIC                         */
+  uint32_t version;        /**<   STRING_SNAPSHOT_VERSION                       */
+  uint32_t endian;         /**<   STRING_SNAPSHOT_ENDIAN                        */
+  uint32_t order;          /**<   @a string_order of table saved                */
+  uint32_t id_end;         /**<   number of ids, an id above every one in use   */
+  uint32_t count;          /**<   number of entries                             */
+  uint32_t index_size;     /**<   number of hash index slots, a power of 2      */
+  uint64_t text_size;      /**<   bytes of text section                                  */
+  uint64_t offsets_at;     /**<   position of offsets section                            */
+  uint64_t counts_at;      /**<   position of counts section                             */
+  uint64_t index_at;       /**<   position of index section                              */
+  uint64_t order_at;       /**<   position of order section                              */
+  uint64_t text_at;        /**<   position of text section                               */
+  uint64_t size;           /**<   size of file                                  */
+  uint64_t body_sum;       /**<   checksum of everything after the header       */
+  uint64_t header_sum;     /**<   checksum of the header up to this field       */
+};
+
+  /**
+   *  @typedef struct string_snapshot_slot string_snapshot_slot
+   *
+   *  @brief create a type for @a string_snapshot_slot struct
+   */
+
+typedef struct string_snapshot_slot string_snapshot_slot;
+
+  /**
+   *  @struct string_snapshot_slot
+   *
+   *  @brief one slot of the hash index of a snapshot file
+   *
+   *  Probing starts at the slot picked by the low bits of the hash.
+   */
+
+struct string_snapshot_slot
+{
+  uint32_t ref;    /**<   id of entry + 1, 0 if slot is empty   */
+  uint32_t tag;    /**<   high half of hash of entry text       */
+};
+
+  /**
+   *  @struct string_snapshot
+   *
+   *  @brief a snapshot file mapped into memory
+   */
+
+struct string_snapshot
+{
+  void *base;                             /**<   start of mapping                                       */
+  size_t size;                            /**<   bytes mapped                                           */
+  const string_snapshot_header *header;   /**<   file header                                            */
+  const uint64_t *offsets;                /**<   offsets section                                        */
+  const uint32_t *counts;                 /**<   counts section                                         */
+  const string_snapshot_slot *index;      /**<   index section                                          */
+  const uint32_t *order;                  /**<   order section                                          */
+  const char *text;                       /**<   text section                                           */
+  uint64_t *removed;                      /**<   ids removed in a layered table, bit per id, or NULL    */
+  string_node **records;                  /**<   chunks of entries handed out, made on first lookup     */
+};
+
+int string_snapshot_save(strings *strs,
+                         const char *path,
+                         string_snapshot_commit commit,
+                         void *ctx);
+string_snapshot *string_snapshot_open(const char *path);
+void string_snapshot_free(string_snapshot *ss);
+int string_snapshot_verify(string_snapshot *ss);
+string_node *string_snapshot_get(string_snapshot *ss, unsigned int id);
+string_node *string_snapshot_find(string_snapshot *ss,
+                                  const char *text,
+                                  size_t len,
+                                  uint64_t hash);
+string_node *string_snapshot_at(string_snapshot *ss, unsigned int i);
+int string_snapshot_remove(string_snapshot *ss, unsigned int id);
+void string_snapshot_restore(string_snapshot *ss, unsigned int id);
+string_node *string_snapshot_seek(string_snapshot *ss,
+                                  const char *text,
+                                  size_t len,
+                                  int forward,
+                                  int inclusive);
+
+#endif //STRINGS_SNAPSHOT_H
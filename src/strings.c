@@ -24,11 +24,395 @@
 #include <stdlib.h>
 #include <string.h>
 #include <search.h>
+#include <pthread.h>
 
 #include "libstrings.h"
+#include "strings-btree.h"
+#include "strings-art.h"
+#include "strings-snapshot.h"
+#include "strings-log.h"
+#include "strings-concurrent.h"
 
-static void renumber_action(avl_node *n);
-static void duper_action(avl_node *n);
+  /**
+   *  @def TEXT_INDEX_MIN_SIZE
+   *
+   *  @brief initial number of slots in the text hash index
+   */
+
+#define TEXT_INDEX_MIN_SIZE 64
+
+  /**
+   *  @def ID_INDEX_MIN_SIZE
+   *
+   *  @brief initial number of slots in the id index
+   */
+
+#define ID_INDEX_MIN_SIZE 64
+
+  /**
+   *  @def TEXT_ARENA_CHUNK_SIZE
+   *
+   *  @brief bytes of text space in each chunk of the text arena
+   */
+
+#define TEXT_ARENA_CHUNK_SIZE 65536
+
+  /**
+   *  @def NODE_SLAB_SIZE
+   *
+   *  @brief number of entries in each block of the entry slab
+   */
+
+#define NODE_SLAB_SIZE 1024
+
+  /**
+   *  @def TEXT_TREE_MAX_HEIGHT
+   *
+   *  @brief deepest AVL tree walked, far beyond 2^32 entries
+   */
+
+#define TEXT_TREE_MAX_HEIGHT 64
+
+  /**
+   *  @typedef struct batch_item batch_item
+   *
+   *  @brief one string strings_add_batch() added to the table
+   */
+
+typedef struct
+{
+  const char *text;   /**<   text of input string       */
+  size_t len;         /**<   length of text in bytes    */
+  unsigned int index; /**<   order entry was made in    */
+} batch_item;
+
+  /**
+   *  @typedef struct batch_job batch_job
+   *
+   *  @brief state of strings_add_batch_parallel() shared by its threads
+   *
+   *  Inputs are split two ways: into contiguous ranges, one per thread, and
+   *  into partitions by hash, one per thread, so that every copy of a text
+   *  lands in the same partition.
+   */
+
+typedef struct
+{
+  strings *strs;               /**<   table being added to                           */
+  const char **texts;          /**<   input texts                                    */
+  const size_t *lens;          /**<   input lengths, NULL for NUL terminated texts   */
+  unsigned int *ids_out;       /**<   id of each input, may be NULL                  */
+  unsigned int n;              /**<   number of inputs                               */
+  unsigned int threads;        /**<   number of threads                              */
+  unsigned int base;           /**<   id of first new entry                          */
+  uint64_t *hash;              /**<   hash of each input                             */
+  string_node **ent;           /**<   entry of each input                            */
+  unsigned int *lead;          /**<   first input with same text, or BATCH_HIT       */
+  unsigned int *part;          /**<   inputs grouped by partition, in input order    */
+  unsigned int *part_start;    /**<   start of each partition in part, threads + 1   */
+  unsigned int *offset;        /**<   per range and partition: next slot in part     */
+  unsigned int *origin;        /**<   input of each new entry, by id - base          */
+  string_node **sorted;        /**<   new entries in text order                      */
+  string_node **spare;         /**<   merge buffer for sorted                        */
+} batch_job;
+
+  /**
+   *  @typedef struct batch_worker batch_worker
+   *
+   *  @brief state of one thread of strings_add_batch_parallel()
+   */
+
+typedef struct
+{
+  batch_job *job;              /**<   shared state                                   */
+  unsigned int t;              /**<   thread number, also its partition              */
+  unsigned int start;          /**<   first input of range                           */
+  unsigned int end;            /**<   one past last input of range                   */
+  unsigned int made;           /**<   new entries made from range                    */
+  unsigned int first;          /**<   position of range's first new entry in sorted  */
+  size_t bytes;                /**<   arena bytes needed by range's new entries      */
+  string_slab *slab;           /**<   block holding range's new entries              */
+  string_chunk *chunk;         /**<   chunk holding text of range's new entries      */
+  string_node **src;           /**<   merge: source runs                             */
+  string_node **dst;           /**<   merge: destination                             */
+  unsigned int lo;             /**<   merge: start of first run                      */
+  unsigned int mid;            /**<   merge: start of second run                     */
+  unsigned int hi;             /**<   merge: end of second run                       */
+  int failed;                  /**<   non-zero if thread failed                      */
+} batch_worker;
+
+  /**
+   *  @def ID_CHUNK_BITS
+   *
+   *  @brief log2 of number of slots in each chunk of a concurrent id index
+   */
+
+#define ID_CHUNK_BITS 16
+
+  /**
+   *  @def ID_CHUNK_SIZE
+   *
+   *  @brief number of slots in each chunk of a concurrent id index
+   */
+
+#define ID_CHUNK_SIZE (1U << ID_CHUNK_BITS)
+
+  /**
+   *  @def ID_DIR_SIZE
+   *
+   *  @brief number of chunks a concurrent id index can have, enough for every id
+   */
+
+#define ID_DIR_SIZE (1U << (32 - ID_CHUNK_BITS))
+
+  /**
+   *  @def SHARDS_DEFAULT
+   *
+   *  @brief number of shards of a concurrent @a strings struct if none is asked for
+   */
+
+#define SHARDS_DEFAULT 64
+
+  /**
+   *  @def SHARDS_MAX
+   *
+   *  @brief most shards a concurrent @a strings struct may have
+   */
+
+#define SHARDS_MAX 4096
+
+  /**
+   *  @def BATCH_THREAD_MIN
+   *
+   *  @brief fewest inputs worth giving a thread of strings_add_batch_parallel()
+   */
+
+#define BATCH_THREAD_MIN 4096
+
+  /**
+   *  @def BATCH_THREAD_MAX
+   *
+   *  @brief most threads strings_add_batch_parallel() will start
+   */
+
+#define BATCH_THREAD_MAX 256
+
+  /**
+   *  @def BATCH_HIT
+   *
+   *  @brief lead of an input of strings_add_batch_parallel() already in the table
+   */
+
+#define BATCH_HIT ((unsigned int)-1)
+
+  /**
+   *  @def TEXT_TOMBSTONE
+   *
+   *  @brief hash index slot marker of an entry removed from a read-mostly table
+   */
+
+#define TEXT_TOMBSTONE (&text_tombstone)
+
+  /**
+   *  @def LF_SEGMENT_BITS
+   *
+   *  @brief log2 of number of buckets in each segment of a lock-free hash index
+   */
+
+#define LF_SEGMENT_BITS 12
+
+  /**
+   *  @def LF_SEGMENT_SIZE
+   *
+   *  @brief number of buckets in each segment of a lock-free hash index
+   */
+
+#define LF_SEGMENT_SIZE (1U << LF_SEGMENT_BITS)
+
+  /**
+   *  @def LF_DIR_SIZE
+   *
+   *  @brief number of segments a lock-free hash index can have
+   */
+
+#define LF_DIR_SIZE 16384
+
+  /**
+   *  @def LF_MIN_SIZE
+   *
+   *  @brief number of buckets of a new lock-free hash index
+   */
+
+#define LF_MIN_SIZE 64
+
+  /**
+   *  @def LF_LOAD
+   *
+   *  @brief average number of entries per bucket at which a lock-free hash index doubles its buckets
+   */
+
+#define LF_LOAD 2
+
+  /**
+   *  @typedef struct renumber_ctx renumber_ctx
+   *
+   *  @brief state of strings_renumber() passed to renumber_action()
+   */
+
+typedef struct
+{
+  unsigned int new_id;     /**<   next id to give out      */
+  string_node **id_index;  /**<   id index being rebuilt   */
+} renumber_ctx;
+
+static string_result intern_refs(strings *strs,
+                                 const char *text,
+                                 size_t len,
+                                 unsigned int refs,
+                                 unsigned int *id);
+static string_result intern_text(strings *strs,
+                                 const char *text,
+                                 size_t len,
+                                 unsigned int refs,
+                                 unsigned int *id);
+static string_result intern_at(strings *strs,
+                               const char *text,
+                               size_t len,
+                               unsigned int id,
+                               unsigned int refs);
+static string_result remove_text(strings *strs, const char *text, size_t len);
+static int log_replay_action(unsigned int op,
+                             unsigned int id,
+                             unsigned int refs,
+                             const char *text,
+                             size_t len,
+                             void *ctx);
+static int merge_commit(uint64_t stamp, void *ctx);
+static int renumber_action(avl_node *n, void *ctx);
+static int duper_action(avl_node *n, void *ctx);
+static int avl_action_adapter(avl_node *n, void *ctx);
+static int batch_item_compare(const void *a, const void *b);
+static int batch_node_compare(const void *a, const void *b);
+static void batch_run(batch_worker *w, unsigned int threads, void *(*phase)(void *));
+static void *batch_hash_phase(void *arg);
+static void *batch_scatter_phase(void *arg);
+static void *batch_dedupe_phase(void *arg);
+static void *batch_count_phase(void *arg);
+static void *batch_make_phase(void *arg);
+static void *batch_merge_phase(void *arg);
+static void *batch_finish_phase(void *arg);
+static size_t batch_len(batch_job *job, unsigned int i);
+static unsigned int batch_partition(batch_job *job, uint64_t hash);
+static void text_index_insert_shared(strings *strs, string_node *sn);
+static int id_index_reserve(strings *strs, unsigned int id);
+
+static char *text_copy(const char *text, size_t len);
+static string_node *text_index_find(strings *strs,
+                                    const char *text,
+                                    size_t len,
+                                    uint64_t hash);
+static int text_index_insert(strings *strs, string_node *sn);
+static void text_index_delete(strings *strs, string_node *sn);
+static void text_index_replace(strings *strs, string_node *old, string_node *sn);
+static int text_index_grow(strings *strs);
+static void text_node_release(avl_node *n);
+static void text_node_move(avl_node *dst, avl_node *src);
+static int text_node_compare(avl_node *a, avl_node *b);
+static void text_node_set_prefix(string_node *sn, const char *text);
+static uint64_t prefix_load(const unsigned char *p);
+static int id_index_set(strings *strs, unsigned int id, string_node *sn);
+static string_node *id_index_get(strings *strs, unsigned int id);
+static unsigned int id_index_end(strings *strs);
+static int id_dir_set(strings *strs, unsigned int id, string_node *sn);
+static string_shard *shard_of(strings *strs, uint64_t hash);
+static string_result shard_intern(strings *strs,
+                                  const char *text,
+                                  size_t len,
+                                  uint64_t hash,
+                                  unsigned int refs,
+                                  unsigned int *id);
+static string_result shard_remove(strings *strs, const char *text, size_t len);
+static void order_mark_stale(strings *strs);
+static string_result epoch_intern(strings *strs,
+                                  const char *text,
+                                  size_t len,
+                                  uint64_t hash,
+                                  unsigned int refs,
+                                  unsigned int *id);
+static string_result epoch_remove(strings *strs, const char *text, size_t len);
+static string_node *epoch_index_find(strings *strs,
+                                     const char *text,
+                                     size_t len,
+                                     uint64_t hash);
+static int epoch_index_insert(strings *strs, string_node *sn);
+static void epoch_index_delete(strings *strs, string_node *sn);
+static int epoch_index_grow(strings *strs);
+static int epoch_retire(strings *strs, void *ptr, int node);
+static void epoch_reclaim(strings *strs);
+static string_result lockfree_intern(strings *strs,
+                                     const char *text,
+                                     size_t len,
+                                     uint64_t hash,
+                                     unsigned int refs,
+                                     unsigned int *id);
+static string_result lockfree_remove(strings *strs, const char *text, size_t len);
+static string_link *lockfree_find(strings *strs,
+                                  const char *text,
+                                  size_t len,
+                                  uint64_t hash);
+static string_link *lockfree_search(string_link **prev,
+                                    string_link **next,
+                                    const char *text,
+                                    size_t len,
+                                    uint64_t hash);
+static string_link *lockfree_bucket(strings *strs, unsigned int b);
+static string_link *lockfree_entry(strings *strs,
+                                   const char *text,
+                                   size_t len,
+                                   uint64_t hash,
+                                   unsigned int refs);
+static void *lockfree_alloc(strings *strs, size_t size);
+static uint64_t bit_reverse(uint64_t x);
+static strings *local_table_new(string_order order);
+static string_node *entry_new(strings *strs,
+                              const char *text,
+                              size_t len,
+                              uint64_t hash);
+static string_node *entry_alloc(strings *strs,
+                                const char *text,
+                                size_t len,
+                                uint64_t hash);
+static void entry_discard(strings *strs, string_node *sn);
+static int text_order_new(strings *strs);
+static void text_order_free(strings *strs);
+static int text_order_sync(strings *strs);
+static int text_order_insert(strings *strs, string_node *sn);
+static unsigned int text_order_insert_sorted(strings *strs, string_node **sn, unsigned int n);
+static int text_order_walk(strings *strs, string_walk_action action, void *ctx);
+static int layered_walk(strings *strs, string_walk_action action, void *ctx);
+static int text_tree_walk(strings *strs, string_walk_action action, void *ctx);
+static string_node *text_order_seek(strings *strs,
+                                    const char *text,
+                                    size_t len,
+                                    int forward,
+                                    int inclusive);
+static string_node *overlay_seek(strings *strs,
+                                 const char *text,
+                                 size_t len,
+                                 int forward,
+                                 int inclusive);
+static string_node *text_tree_seek(strings *strs,
+                                   const char *text,
+                                   size_t len,
+                                   int forward,
+                                   int inclusive);
+static int cursor_save(string_cursor *cursor, string_node *sn);
+static int text_compare(string_node *sn, const char *text, size_t len);
+static char *text_arena_dup(strings *strs, const char *text, size_t len);
+static string_node *node_slab_alloc(strings *strs);
+static void node_slab_release(strings *strs, string_node *sn);
+
+static string_node text_tombstone;
 
   /**
    *  @fn string *string_new(void)
@@ -71,6 +455,8 @@ string *string_new_with_values(char *text, unsigned int id)
   if (!(str = string_new())) goto exit;
 
   if (text) str->text = strdup(text);
+  str->len = strlen(text);
+  str->hash = strings_hash(text, str->len);
   str->id = id;
   str->ref_cnt = 0;
 
@@ -99,7 +485,7 @@ string *string_dup(string *str)
 
   memcpy(nstr, str, sizeof(string));
 
-  if (str->text) nstr->text = strdup(str->text);
+  if (str->text) nstr->text = text_copy(str->text, str->len);
 
 exit:
   return nstr;
@@ -123,7 +509,7 @@ void string_copy(string *dst, string *src)
 
   memcpy(dst, src, sizeof(string));
 
-  if (src->text) dst->text = strdup(src->text);
+  if (src->text) dst->text = text_copy(src->text, src->len);
 }
 
   /**
@@ -147,620 +533,5634 @@ void string_free(string *str)
 }
 
   /**
-   *  @fn strings *strings_new(void)
+   *  @fn uint64_t string_hash(string *str)
    *
-   *  @brief create a new @a strings struct
+   *  @brief returns the cached hash of text of @p str
    *
-   *  @par Parameters
-   *  None.
+   *  The hash is computed once, when @p str is created by
+   *  string_new_with_values() or when its text is interned, and equals
+   *  strings_hash() of the text.
    *
-   *  @return pointer to new @a strings struct
+   *  @param str - pointer to existing @a string struct
+   *
+   *  @return hash of text of @p str, 0 if @p str is NULL
    */
 
-strings *strings_new(void)
+uint64_t string_hash(string *str)
 {
-  strings *strs = NULL;
-
-  if (!(strs = malloc(sizeof(strings)))) goto exit;
-
-  memset(strs, 0, sizeof(strings));
-
-  strs->id_root = avl_new();
-  if (!strs->id_root) goto exit;
+  return str ? str->hash : 0;
+}
 
-  avl_set_free(strs->id_root, string_node_free);
-  avl_set_cmp(strs->id_root, string_node_compare_id);
-  avl_set_new(strs->id_root, string_node_new);
-  avl_set_dup(strs->id_root, string_node_dup);
-  avl_set_copy_data(strs->id_root, string_node_copy_data);
+  /**
+   *  @fn int string_equal(string *a, string *b)
+   *
+   *  @brief tests whether @p a and @p b have the same text
+   *
+   *  Cached hashes and lengths are compared first, so unequal strings
+   *  rarely need their text bytes examined.
+   *
+   *  @param a - pointer to existing @a string struct
+   *  @param b - pointer to existing @a string struct
+   *
+   *  @return non-zero if text of @p a equals text of @p b, 0 if not
+   */
 
-  strs->text_root = avl_new();
-  if (!strs->text_root) goto exit;
+int string_equal(string *a, string *b)
+{
+  if (!a || !b || !a->text || !b->text) return 0;
 
-  avl_set_free(strs->text_root, string_node_free);
-  avl_set_cmp(strs->text_root, string_node_compare_text);
-  avl_set_new(strs->text_root, string_node_new);
-  avl_set_dup(strs->text_root, string_node_dup);
-  avl_set_copy_data(strs->text_root, string_node_copy_data);
+  if (a->text == b->text) return 1;
+  if (a->hash != b->hash || a->len != b->len) return 0;
 
-exit:
-  return strs;
+  return !memcmp(a->text, b->text, a->len);
 }
 
-static strings *nstrs = NULL;  /**<  used by duper_action()  */
-
   /**
-   *  @fn strings *strings_dup(strings *strs)
+   *  @fn string_cursor *string_cursor_new(void)
    *
-   *  @brief create a deep copy of @p strs
+   *  @brief create a new @a string_cursor struct, positioned before the first entry
    *
-   *  @param strs - pointer to existing @a strings struct
+   *  @par Parameters
+   *  None.
    *
-   *  @return pointer to new @a strings struct
+   *  @return pointer to new @a string_cursor struct
    */
 
-strings *strings_dup(strings *strs)
+string_cursor *string_cursor_new(void)
 {
-  if (!strs) goto exit;
+  string_cursor *cursor;
 
-  nstrs = strings_new();
-  if (!nstrs) goto exit;
-
-  strings_walk(strs, string_id, duper_action);
+  cursor = malloc(sizeof(string_cursor));
+  if (cursor) memset(cursor, 0, sizeof(string_cursor));
 
-exit:
-  return nstrs;
+  return cursor;
 }
 
   /**
-   *  @fn void strings_free(strings *strs)
+   *  @fn void string_cursor_reset(string_cursor *cursor)
    *
-   *  @brief frees all memory allocated to @p strs
+   *  @brief positions @p cursor before the first entry again, for a new query
    *
-   *  @param strs - pointer to existing @a strings struct
+   *  @param cursor - pointer to existing @a string_cursor struct
    *
    *  @par Returns
    *  Nothing.
    */
 
-void strings_free(strings *strs)
+void string_cursor_reset(string_cursor *cursor)
 {
-  if (!strs) return;
-
-  if (strs->text_root) avl_free(strs->text_root);
-  if (strs->id_root) avl_free(strs->id_root);
+  if (!cursor) return;
 
-  free(strs);
+  cursor->len = 0;
+  cursor->started = 0;
+  cursor->done = 0;
 }
 
   /**
-   *  @fn string_result strings_add(strings *strs, string *str)
+   *  @fn int string_cursor_set_range(string_cursor *cursor, const char *lower, size_t lower_len, const char *upper, size_t upper_len, string_direction direction)
    *
-   *  @brief adds @p str to @p strs
+   *  @brief sets up @p cursor for a range scan with strings_scan()
    *
-   *  @param strs - pointer to existing @a strings struct
-   *  @param str  - pointer to existing @a string struct
+   *  The range holds every text t with lower <= t < upper.  The bounds are
+   *  copied, and @p cursor is reset to the start of the range.
    *
-   *  @return @a string_result indicating success or failure
+   *  @param cursor    - pointer to existing @a string_cursor struct
+   *  @param lower     - pointer to lower bound text, NULL for no lower bound
+   *  @param lower_len - length of @p lower in bytes
+   *  @param upper     - pointer to upper bound text, NULL for no upper bound
+   *  @param upper_len - length of @p upper in bytes
+   *  @param direction - @a string_direction of scan
+   *
+   *  @return 0 on success, non-zero on failure
    */
 
-string_result strings_add(strings *strs, string *str)
+int string_cursor_set_range(string_cursor *cursor,
+                            const char *lower,
+                            size_t lower_len,
+                            const char *upper,
+                            size_t upper_len,
+                            string_direction direction)
 {
-  string *s = NULL;
-  string_node *n = NULL;
-  avl_node *found = NULL;
-  string_result r = string_failed;
-
-  if (!strs || !str) goto bail;
-
-  n = (string_node *)string_node_new_with_values(str->text, str->id);
-  if (!n) goto bail;
-
-  n->value.ref_cnt = n->value.id = 0;
-
-    /*
-     * Does string already exist?
-     */
-
-  found = avl_find(strs->text_root, (avl_node *)n);
-  if (found)
-  {
-    avl_node_free(strs->text_root, (avl_node *)n);
-    s = (string *)&found->value;
-    ++s->ref_cnt;
-    return string_found;
-  }
-
-  n->value.ref_cnt = 1;
-  n->value.id = strs->last_id;
+  char *l = NULL;
+  char *u = NULL;
 
-  ++strs->last_id;
+  if (!cursor) return 1;
 
-  if (avl_insert(strs->text_root, (avl_node *)n))
-  {
-    avl_node_free(strs->text_root, (avl_node *)n);
-    goto bail;
-  }
+  if (lower && !(l = text_copy(lower, lower_len))) goto bail;
+  if (upper && !(u = text_copy(upper, upper_len))) goto bail;
 
-  n = (string_node *)string_node_dup((avl_node *)n);
+  if (cursor->lower) free(cursor->lower);
+  if (cursor->upper) free(cursor->upper);
 
-  n->left = n->right = NULL;
+  cursor->lower = l;
+  cursor->lower_len = lower_len;
+  cursor->upper = u;
+  cursor->upper_len = upper_len;
+  cursor->direction = direction;
 
-  if (avl_insert(strs->id_root, (avl_node *)n))
-  {
-    avl_node_free(strs->text_root, (avl_node *)n);
-    goto bail;
-  }
+  string_cursor_reset(cursor);
 
-  r = string_found;
+  return 0;
 
 bail:
-  switch (r)
-  {
-    case string_found: break;
-
-    case string_not_found:
-    case string_failed:
-      break;
-  }
-
-  return r;
+  if (l) free(l);
+  return 1;
 }
 
   /**
-   *  @fn string_result strings_remove(strings *strs, char *text)
+   *  @fn void string_cursor_free(string_cursor *cursor)
    *
-   *  @brief removes entry with text key of @p text from @p strs
+   *  @brief frees all memory used by @p cursor
    *
-   *  @param strs - pointer to existing @a strings struct
-   *  @param text - text value of @a string to remove
+   *  @param cursor - pointer to existing @a string_cursor struct
    *
-   *  @return @a string_result indicating success or failure
+   *  @par Returns
+   *  Nothing.
    */
 
-string_result strings_remove(strings *strs, char *text)
+void string_cursor_free(string_cursor *cursor)
 {
-  string_node sn;
-  string *fs;
-  avl_node *found = NULL;
-
-  if (!strs || !text) return string_failed;
+  if (!cursor) return;
 
-  memset(&sn, 0, sizeof(string_node));
-  sn.value.text = text;
-
-  found = avl_find(strs->text_root, (avl_node *)&sn);
-  if (!found) return string_failed;
-
-  fs = (string *)&found->value;
-  sn.value.id = fs->id;
+  if (cursor->text) free(cursor->text);
+  if (cursor->lower) free(cursor->lower);
+  if (cursor->upper) free(cursor->upper);
 
-  avl_delete(strs->text_root, (avl_node *)&sn);
-
-  avl_delete(strs->id_root, (avl_node *)&sn);
-
-  return string_found;
+  free(cursor);
 }
 
   /**
-   *  @fn string *strings_find_by_text(strings *strs, char *text)
+   *  @fn strings *strings_new(void)
    *
-   *  @brief searches @p strs for entry with text value of @p text
+   *  @brief create a new @a strings struct
    *
-   *  @param strs - pointer to existing @a strings struct
-   *  @param text - text value of @a string to remove
+   *  @par Parameters
+   *  None.
    *
-   *  @return pointer to @a string struct if found, NULL if not
+   *  @return pointer to new @a strings struct
    */
 
-string *strings_find_by_text(strings *strs, char *text)
+strings *strings_new(void)
 {
-  string_node n;
-  avl_node *found;
-
-  if (!strs || !text) return NULL;
-  if (!strs->text_root) return NULL;
-
-  memset(&n, 0, sizeof(string_node));
-  n.value.text = text;
-
-  found = avl_find(strs->text_root, (avl_node *)&n);
-
-  return found ? &((string_node *)found)->value : NULL;
+  return strings_new_with_order(string_order_avl);
 }
 
   /**
-   *  @fn string *strings_find_by_id(strings *strs, unsigned int id)
+   *  @fn strings *strings_new_with_order(string_order order)
    *
-   *  @brief searches @p strs for entry with id value of @p id
+   *  @brief create a new @a strings struct with a chosen ordered text index
    *
-   *  @param strs - pointer to existing @a strings struct
-   *  @param id - id value of @a string to remove
+   *  The ordered index serves strings_walk() in string_text order and
+   *  strings_renumber().  Lookups by text always use the hash index.
    *
-   *  @return pointer to @a string struct if found, NULL if not
+   *  @param order - @a string_order of text index to build
+   *
+   *  @return pointer to new @a strings struct, NULL on failure
    */
 
-string *strings_find_by_id(strings *strs, unsigned int id)
+strings *strings_new_with_order(string_order order)
 {
-  string_node n;
-  avl_node *found;
+  strings *strs = NULL;
 
-  if (!strs) return NULL;
-  if (!strs->id_root) return NULL;
+  if (!(strs = malloc(sizeof(strings)))) goto exit;
+
+  memset(strs, 0, sizeof(strings));
+
+  strs->order = order;
 
-  memset(&n, 0, sizeof(string_node));
-  n.value.id = id;
+  if (text_order_new(strs)) goto fail;
 
-  found = avl_find(strs->id_root, (avl_node *)&n);
+exit:
+  return strs;
 
-  return found ? &((string_node *)found)->value : NULL;
+fail:
+  strings_free(strs);
+  return NULL;
+}
+
+  /**
+   *  @fn strings *strings_new_concurrent(string_order order, unsigned int shards)
+   *
+   *  @brief create a new @a strings struct that many threads may use at once
+   *
+   *  strings_add(), strings_add_n(), strings_intern(), strings_remove(),
+   *  strings_remove_n(), strings_find_by_text(), strings_find_by_text_n()
+   *  and strings_find_by_id() may be called from any number of threads.
+   *  The hash index is split into @p shards shards by hash, each with its
+   *  own lock, entry slab and text arena, so threads working on different
+   *  texts rarely meet.  Ids come from an atomic counter and
+   *  strings_find_by_id() takes no lock at all.
+   *
+   *  Removed entries stay allocated until strings_free(), so an entry
+   *  found by one thread stays readable while another removes it.
+   *
+   *  The ordered text index is not kept up to date by those calls; it is
+   *  rebuilt when next needed.  Walks, scans, iterators, strings_dup(),
+   *  strings_renumber() and strings_free() need the table to themselves.
+   *
+   *  @param order  - @a string_order of text index to build
+   *  @param shards - number of shards, rounded up to a power of 2, 0 for
+   *                  the default
+   *
+   *  @return pointer to new @a strings struct, NULL on failure
+   */
+
+strings *strings_new_concurrent(string_order order, unsigned int shards)
+{
+  strings *strs = NULL;
+  string_shard *shard;
+  unsigned int count;
+
+  if (!shards) shards = SHARDS_DEFAULT;
+  if (shards > SHARDS_MAX) shards = SHARDS_MAX;
+
+  for (count = 1; count < shards; count *= 2)
+    ;
+
+  strs = strings_new_with_order(order);
+  if (!strs) goto exit;
+
+  strs->id_dir = calloc(ID_DIR_SIZE, sizeof(string_node **));
+  strs->shards = calloc(count, sizeof(string_shard));
+  if (!strs->id_dir || !strs->shards) goto fail;
+
+    /*
+     *  shard_count only ever counts fully set up shards, so strings_free()
+     *  can undo a partial setup
+     */
+
+  while (strs->shard_count < count)
+  {
+    shard = &strs->shards[strs->shard_count];
+
+    shard->table = calloc(1, sizeof(strings));
+    if (!shard->table) goto fail;
+
+    if (pthread_mutex_init(&shard->lock, NULL))
+    {
+      free(shard->table);
+      shard->table = NULL;
+      goto fail;
+    }
+
+    ++strs->shard_count;
+  }
+
+exit:
+  return strs;
+
+fail:
+  strings_free(strs);
+  return NULL;
+}
+
+  /**
+   *  @fn strings *strings_new_read_mostly(string_order order)
+   *
+   *  @brief create a new @a strings struct whose readers never wait
+   *
+   *  strings_find_by_text(), strings_find_by_text_n() and
+   *  strings_find_by_id() take no lock and may run in any number of
+   *  threads while another thread adds or removes strings.  Writers are
+   *  serialized by one lock.
+   *
+   *  Each reader thread registers once with strings_reader_new() and
+   *  brackets its lookups, and its use of what they return, with
+   *  strings_read_begin() and strings_read_end().  Removed entries, and
+   *  hash index slots left behind when the index grows, are only reused or
+   *  freed once every reader inside such a bracket at the time has left
+   *  it.
+   *
+   *  As for strings_new_concurrent(), the ordered text index is rebuilt
+   *  when next needed, and walks, scans, iterators, strings_dup(),
+   *  strings_renumber() and strings_free() need the table to themselves.
+   *
+   *  @param order - @a string_order of text index to build
+   *
+   *  @return pointer to new @a strings struct, NULL on failure
+   */
+
+strings *strings_new_read_mostly(string_order order)
+{
+  strings *strs = NULL;
+  string_epoch *e;
+
+  strs = strings_new_with_order(order);
+  if (!strs) goto exit;
+
+  strs->id_dir = calloc(ID_DIR_SIZE, sizeof(string_node **));
+  if (!strs->id_dir) goto fail;
+
+  e = calloc(1, sizeof(string_epoch));
+  if (!e) goto fail;
+
+  if (pthread_mutex_init(&e->write_lock, NULL))
+  {
+    free(e);
+    goto fail;
+  }
+
+  if (pthread_mutex_init(&e->reader_lock, NULL))
+  {
+    pthread_mutex_destroy(&e->write_lock);
+    free(e);
+    goto fail;
+  }
+
+    /*
+     *  Epoch 0 would read as an idle reader's state after the shift
+     */
+
+  e->epoch = 1;
+
+  strs->epoch = e;
+
+exit:
+  return strs;
+
+fail:
+  strings_free(strs);
+  return NULL;
+}
+
+  /**
+   *  @fn strings *strings_new_lock_free(string_order order)
+   *
+   *  @brief create a new @a strings struct that many threads may add to without locks
+   *
+   *  The same calls as for strings_new_concurrent() may be made from any
+   *  number of threads, but none of them waits for another.  The hash
+   *  index is a split-ordered list: one list of all entries, sorted so
+   *  that the entries of each bucket follow one another, which a thread
+   *  joins with a single compare-and-swap.  Threads adding the same new
+   *  text at once race for the same place in the list, so exactly one of
+   *  them adds it and the others find it and share its id.  Buckets double
+   *  without moving any entry.
+   *
+   *  An id taken by a thread that lost such a race stays unused, like the
+   *  id of a removed entry.  Removed entries stay allocated until
+   *  strings_free().  The ordered text index is rebuilt when next needed,
+   *  and walks, scans, iterators, strings_dup(), strings_renumber() and
+   *  strings_free() need the table to themselves.
+   *
+   *  @param order - @a string_order of text index to build
+   *
+   *  @return pointer to new @a strings struct, NULL on failure
+   */
+
+strings *strings_new_lock_free(string_order order)
+{
+  strings *strs = NULL;
+  string_lockfree *lf;
+  string_link *head;
+
+  strs = strings_new_with_order(order);
+  if (!strs) goto exit;
+
+  strs->id_dir = calloc(ID_DIR_SIZE, sizeof(string_node **));
+  if (!strs->id_dir) goto fail;
+
+  lf = calloc(1, sizeof(string_lockfree));
+  if (!lf) goto fail;
+
+  strs->lockfree = lf;
+
+  lf->buckets = calloc(LF_DIR_SIZE, sizeof(string_link **));
+  if (!lf->buckets) goto fail;
+
+  lf->buckets[0] = calloc(LF_SEGMENT_SIZE, sizeof(string_link *));
+  if (!lf->buckets[0]) goto fail;
+
+    /*
+     *  Bucket 0 starts the list, every other bucket is split off it
+     */
+
+  head = lockfree_alloc(strs, sizeof(string_link));
+  if (!head) goto fail;
+
+  memset(head, 0, sizeof(string_link));
+
+  lf->buckets[0][0] = head;
+  lf->size = LF_MIN_SIZE;
+
+exit:
+  return strs;
+
+fail:
+  strings_free(strs);
+  return NULL;
+}
+
+  /**
+   *  @fn strings *strings_open_mapped(const char *path)
+   *
+   *  @brief opens the snapshot file at @p path written by strings_save()
+   *
+   *  The file is mapped read only and looked up in place: strings_find_by_id()
+   *  and strings_find_by_text() use the offsets and the hash index stored
+   *  in it, and walks, scans and iterators its text order, so opening
+   *  allocates nothing per entry and costs the same for any size of file.
+   *  Only the header is checked; strings_verify_mapped() checks the rest.
+   *
+   *  The table is read only, adding or removing fails; strings_open_layered()
+   *  opens one that takes both.  The @a string of an id is made on its
+   *  first lookup and stays valid until the table is freed; its text
+   *  points into the mapping.  Any number of threads may look up at once.
+   *  Reference counts are those saved.
+   *
+   *  @param path - pointer to path of file
+   *
+   *  @return pointer to new @a strings struct, NULL on failure
+   */
+
+strings *strings_open_mapped(const char *path)
+{
+  strings *strs = NULL;
+  string_snapshot *ss;
+
+  ss = string_snapshot_open(path);
+  if (!ss) return NULL;
+
+  strs = strings_new_with_order((string_order)ss->header->order);
+  if (!strs)
+  {
+    string_snapshot_free(ss);
+    return NULL;
+  }
+
+  strs->snapshot = ss;
+  strs->last_id = ss->header->id_end;
+  strs->id_index_used = ss->header->count;
+
+  return strs;
+}
+
+  /**
+   *  @fn strings *strings_open_layered(const char *path)
+   *
+   *  @brief opens the snapshot file at @p path as a read only base under an
+   *         in-memory overlay that takes adds and removes
+   *
+   *  Opening costs what strings_open_mapped() does.  New strings go to the
+   *  overlay, an ordinary table of its own whose ids continue from the
+   *  highest id of the base, and lookups, walks, scans and iterators see
+   *  base and overlay as one table.  Removing a base entry hides it until
+   *  the table is freed; the file is never written.  strings_merge_overlay()
+   *  folds the overlay into a new base file.
+   *
+   *  Entries of the base are returned as from strings_open_mapped(), and
+   *  interning one adds to its reference count.  The overlay's id index spans
+   *  the ids of the base too, one pointer each, from the first add on.
+   *  Like a table from strings_new_with_order(), the table is for one
+   *  thread at a time, and ids are not renumbered.
+   *
+   *  @param path - pointer to path of file
+   *
+   *  @return pointer to new @a strings struct, NULL on failure
+   */
+
+strings *strings_open_layered(const char *path)
+{
+  strings *strs;
+
+  strs = strings_open_mapped(path);
+  if (strs) strs->layered = 1;
+
+  return strs;
+}
+
+  /**
+   *  @fn strings *strings_dup(strings *strs)
+   *
+   *  @brief create a deep copy of @p strs
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *
+   *  @return pointer to new @a strings struct
+   */
+
+strings *strings_dup(strings *strs)
+{
+  strings *nstrs = NULL;
+
+  if (!strs) goto exit;
+
+  if (strs->shards) nstrs = strings_new_concurrent(strs->order, strs->shard_count);
+  else if (strs->epoch) nstrs = strings_new_read_mostly(strs->order);
+  else if (strs->lockfree) nstrs = strings_new_lock_free(strs->order);
+  else nstrs = strings_new_with_order(strs->order);
+  if (!nstrs) goto exit;
+
+  if (strings_walk_with_context(strs, string_id, duper_action, nstrs))
+  {
+    strings_free(nstrs);
+    nstrs = NULL;
+  }
+
+exit:
+  return nstrs;
+}
+
+  /**
+   *  @fn void strings_free(strings *strs)
+   *
+   *  @brief frees all memory allocated to @p strs
+   *
+   *  Readers made by strings_reader_new() are left to their callers to
+   *  free with strings_reader_free().
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void strings_free(strings *strs)
+{
+  string_chunk *chunk;
+  string_slab *slab;
+  string_retired *retired;
+  string_reader *reader;
+  unsigned int i;
+
+  if (!strs) return;
+
+  text_order_free(strs);
+
+  if (strs->log) string_log_close(strs->log);
+  if (strs->snapshot) string_snapshot_free(strs->snapshot);
+
+  if (strs->epoch)
+  {
+    while ((retired = strs->epoch->retired))
+    {
+      strs->epoch->retired = retired->next;
+      if (!retired->node) free(retired->ptr);
+      free(retired);
+    }
+
+      /*
+       *  Readers belong to their callers, they are only cut loose
+       */
+
+    for (reader = strs->epoch->readers; reader; reader = reader->next)
+      reader->strs = NULL;
+
+    pthread_mutex_destroy(&strs->epoch->write_lock);
+    pthread_mutex_destroy(&strs->epoch->reader_lock);
+    free(strs->epoch);
+  }
+
+  if (strs->lockfree)
+  {
+    if (strs->lockfree->buckets)
+    {
+      for (i = 0; i < LF_DIR_SIZE; i++)
+        if (strs->lockfree->buckets[i]) free(strs->lockfree->buckets[i]);
+      free(strs->lockfree->buckets);
+    }
+    free(strs->lockfree);
+  }
+
+  if (strs->shards)
+  {
+    for (i = 0; i < strs->shard_count; i++)
+    {
+      strings_free(strs->shards[i].table);
+      pthread_mutex_destroy(&strs->shards[i].lock);
+    }
+    free(strs->shards);
+  }
+
+  if (strs->id_dir)
+  {
+    for (i = 0; i < ID_DIR_SIZE; i++)
+      if (strs->id_dir[i]) free(strs->id_dir[i]);
+    free(strs->id_dir);
+  }
+
+    /*
+     *  Entries live in the slab and their text in the arena, both are
+     *  released a block at a time.  A lock-free table keeps entries and
+     *  list links in the arena too.
+     */
+
+  if (strs->id_index) free(strs->id_index);
+  if (strs->text_index) free(strs->text_index);
+
+  while ((slab = strs->node_slab))
+  {
+    strs->node_slab = slab->next;
+    free(slab);
+  }
+
+  while ((chunk = strs->text_arena))
+  {
+    strs->text_arena = chunk->next;
+    free(chunk);
+  }
+
+  free(strs);
+}
+
+  /**
+   *  @fn string_result strings_add(strings *strs, string *str)
+   *
+   *  @brief adds @p str to @p strs
+   *
+   *  The text of @p str is copied, @p str itself still belongs to the
+   *  caller.  strings_intern() does the same without needing a @a string.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param str  - pointer to existing @a string struct
+   *
+   *  @return @a string_result indicating success or failure
+   */
+
+string_result strings_add(strings *strs, string *str)
+{
+  if (!strs || !str || !str->text) return string_failed;
+
+  return strings_add_n(strs, str->text, strlen(str->text));
+}
+
+  /**
+   *  @fn string_result strings_add_n(strings *strs, const char *text, size_t len)
+   *
+   *  @brief adds the @p len bytes at @p text to @p strs
+   *
+   *  @p text need not be NUL terminated and may contain NUL bytes.  The
+   *  stored copy is always NUL terminated.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text to add
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return @a string_result indicating success or failure
+   */
+
+string_result strings_add_n(strings *strs, const char *text, size_t len)
+{
+  string_result r;
+
+  r = strings_intern(strs, text, len, NULL);
+
+  return r == string_inserted ? string_found : r;
+}
+
+  /**
+   *  @fn string_result strings_intern(strings *strs, const char *text, size_t len, unsigned int *id)
+   *
+   *  @brief interns the @p len bytes at @p text in @p strs and reports its id
+   *
+   *  Does a single probe of the text index.  A new string is copied into
+   *  @p strs with a ref_cnt of 1, an existing string has its ref_cnt
+   *  incremented.  No @a string struct is needed from the caller.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text to intern
+   *  @param len  - length of @p text in bytes
+   *  @param id   - pointer to receive id of the entry, may be NULL
+   *
+   *  @return string_inserted if @p text was new
+   *  @return string_found if @p text was already in @p strs
+   *  @return string_failed on failure
+   */
+
+string_result strings_intern(strings *strs,
+                             const char *text,
+                             size_t len,
+                             unsigned int *id)
+{
+  return intern_refs(strs, text, len, 1, id);
+}
+
+  /**
+   *  @fn string_result intern_refs(strings *strs, const char *text, size_t len, unsigned int refs, unsigned int *id)
+   *
+   *  @brief strings_intern() taking @p refs references at once
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text to intern
+   *  @param len  - length of @p text in bytes
+   *  @param refs - number of references to add to ref_cnt
+   *  @param id   - pointer to receive id of the entry, may be NULL
+   *
+   *  @return as strings_intern()
+   */
+
+static string_result intern_refs(strings *strs,
+                                 const char *text,
+                                 size_t len,
+                                 unsigned int refs,
+                                 unsigned int *id)
+{
+  string_log *log = strs && text ? strs->log : NULL;
+  string *s;
+  unsigned int new_id = 0;
+  string_result r;
+
+  if (!log)
+  {
+    r = intern_text(strs, text, len, refs, &new_id);
+    goto exit;
+  }
+
+    /*
+     *  References to an entry already there are logged and then taken, as
+     *  nothing removes it while the log is held.  A new entry is made with
+     *  the log to itself, so no other change sees it before its record is
+     *  taken, and is removed again if the log does not take it.
+     */
+
+  string_log_hold(log, 0);
+
+  s = strings_find_by_text_n(strs, text, len);
+  if (!s)
+  {
+    string_log_release(log);
+    string_log_hold(log, 1);
+    s = strings_find_by_text_n(strs, text, len);
+  }
+
+  if (s)
+  {
+    new_id = s->id;
+    if (string_log_append(log, STRING_LOG_REF, new_id, refs, text, len)) r = string_failed;
+    else r = intern_text(strs, text, len, refs, NULL);
+  }
+  else
+  {
+    r = intern_text(strs, text, len, refs, &new_id);
+    if (r == string_inserted && string_log_append(log, STRING_LOG_ADD, new_id, refs, text, len))
+    {
+      remove_text(strs, text, len);
+      r = string_failed;
+    }
+  }
+
+  string_log_release(log);
+
+exit:
+  if (id && r != string_failed) *id = new_id;
+
+  return r;
+}
+
+  /**
+   *  @fn string_result intern_text(strings *strs, const char *text, size_t len, unsigned int refs, unsigned int *id)
+   *
+   *  @brief intern_refs() without the write-ahead log
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text to intern
+   *  @param len  - length of @p text in bytes
+   *  @param refs - number of references to add to ref_cnt
+   *  @param id   - pointer to receive id of the entry, may be NULL
+   *
+   *  @return as strings_intern()
+   */
+
+static string_result intern_text(strings *strs,
+                                 const char *text,
+                                 size_t len,
+                                 unsigned int refs,
+                                 unsigned int *id)
+{
+  string *s = NULL;
+  string_node *n = NULL;
+  string_node *found = NULL;
+  uint64_t hash;
+  string_result r = string_failed;
+
+  if (!strs || !text || (strs->snapshot && !strs->layered)) goto bail;
+
+    /*
+     * Does string already exist?  Probe with the caller's text, nothing is
+     * allocated or copied unless the string is new.
+     */
+
+  hash = strings_hash(text, len);
+
+  if (strs->snapshot && (found = string_snapshot_find(strs->snapshot, text, len, hash)))
+  {
+    found->value.ref_cnt += refs;
+    if (id) *id = found->value.id;
+    return string_found;
+  }
+
+  if (strs->shards) return shard_intern(strs, text, len, hash, refs, id);
+  if (strs->epoch) return epoch_intern(strs, text, len, hash, refs, id);
+  if (strs->lockfree) return lockfree_intern(strs, text, len, hash, refs, id);
+
+  found = text_index_find(strs, text, len, hash);
+  if (found)
+  {
+    s = &found->value;
+    s->ref_cnt += refs;
+    if (id) *id = s->id;
+    return string_found;
+  }
+
+  n = entry_new(strs, text, len, hash);
+  if (!n) goto bail;
+
+  if (!strs->order_stale && text_order_insert(strs, n))
+  {
+    entry_discard(strs, n);
+    goto bail;
+  }
+
+  n->value.ref_cnt = refs;
+
+  if (id) *id = n->value.id;
+
+  r = string_inserted;
+
+bail:
+  return r;
+}
+
+  /**
+   *  @fn string_result strings_add_batch(strings *strs, const char **texts, const size_t *lens, unsigned int n, unsigned int *ids_out)
+   *
+   *  @brief adds @p n strings to @p strs at once
+   *
+   *  Ids and reference counts come out as if strings_intern() had been
+   *  called for each input in turn, but the new entries are sorted and
+   *  added to the ordered text index in one pass, which for the B+ tree is
+   *  a bottom-up rebuild when the batch is large.  On failure @p strs is
+   *  left as it was, save that some ids may have been used up.
+   *
+   *  @param strs    - pointer to existing @a strings struct
+   *  @param texts   - array of @p n pointers to texts
+   *  @param lens    - array of @p n text lengths in bytes, NULL if the
+   *                   texts are NUL terminated
+   *  @param n       - number of strings
+   *  @param ids_out - array to receive the id of each input, may be NULL
+   *
+   *  @return @a string_found if all strings were added or found, @a
+   *          string_failed if not
+   */
+
+string_result strings_add_batch(strings *strs,
+                                const char **texts,
+                                const size_t *lens,
+                                unsigned int n,
+                                unsigned int *ids_out)
+{
+  string_node **hit = NULL;
+  unsigned char *made = NULL;
+  string_node **nodes = NULL;
+  string_node **sorted = NULL;
+  batch_item *items = NULL;
+  string_node *sn;
+  const char *text;
+  uint64_t hash;
+  size_t len;
+  unsigned int i, j, k = 0, done;
+  string_result r = string_failed;
+
+  if (!strs || (n && !texts) || (strs->snapshot && !strs->layered)) goto bail;
+
+    /*
+     *  Concurrent, read-mostly, lock-free, layered and logged tables, and
+     *  tables whose ordered index is out of date, take the strings one by
+     *  one; the ordered index is rebuilt later anyway
+     */
+
+  if (strs->shards || strs->epoch || strs->lockfree || strs->snapshot || strs->log || strs->order_stale)
+  {
+    for (i = 0; i < n; i++)
+    {
+      if (!texts[i]) goto bail;
+      len = lens ? lens[i] : strlen(texts[i]);
+      if (strings_intern(strs, texts[i], len, ids_out ? &ids_out[i] : NULL) == string_failed) goto bail;
+    }
+
+    r = string_found;
+    goto bail;
+  }
+
+  hit = malloc(((size_t)n + 1) * sizeof(string_node *));
+  made = calloc((size_t)n + 1, 1);
+  nodes = malloc(((size_t)n + 1) * sizeof(string_node *));
+  items = malloc(((size_t)n + 1) * sizeof(batch_item));
+  sorted = malloc(((size_t)n + 1) * sizeof(string_node *));
+  if (!hit || !made || !nodes || !items || !sorted) goto bail;
+
+    /*
+     *  New entries go into the hash index as they are made, so a repeat
+     *  later in the batch finds the first one there.  Reference counts are
+     *  left alone until nothing else can fail.
+     */
+
+  for (i = 0; i < n; i++)
+  {
+    text = texts[i];
+    if (!text) goto undo;
+
+    len = lens ? lens[i] : strlen(text);
+    hash = strings_hash(text, len);
+
+    hit[i] = text_index_find(strs, text, len, hash);
+    if (hit[i]) continue;
+
+    sn = entry_new(strs, text, len, hash);
+    if (!sn) goto undo;
+
+    hit[i] = sn;
+    made[i] = 1;
+
+    items[k].text = text;
+    items[k].len = len;
+    items[k].index = k;
+    nodes[k++] = sn;
+  }
+
+    /*
+     *  The radix tree takes keys in any order, and in input order its
+     *  descents follow whatever locality the caller's keys have
+     */
+
+  if (strs->order != string_order_art)
+    qsort(items, k, sizeof(batch_item), batch_item_compare);
+
+  for (j = 0; j < k; j++) sorted[j] = nodes[items[j].index];
+
+  done = text_order_insert_sorted(strs, sorted, k);
+  if (done < k)
+  {
+      /*
+       *  Entries already in the ordered index leave by the normal path,
+       *  which copes with the AVL tree moving entries about
+       */
+
+    for (j = 0; j < done; j++)
+    {
+      strings_remove_n(strs, items[j].text, items[j].len);
+      nodes[items[j].index] = NULL;
+    }
+
+    goto undo;
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    if (!made[i]) ++hit[i]->value.ref_cnt;
+    if (ids_out) ids_out[i] = hit[i]->value.id;
+  }
+
+  r = string_found;
+  goto bail;
+
+undo:
+  while (k)
+    if (nodes[--k]) entry_discard(strs, nodes[k]);
+
+bail:
+  if (hit) free(hit);
+  if (made) free(made);
+  if (nodes) free(nodes);
+  if (items) free(items);
+  if (sorted) free(sorted);
+  return r;
+}
+
+  /**
+   *  @fn string_result strings_add_batch_parallel(strings *strs, const char **texts, const size_t *lens, unsigned int n, unsigned int *ids_out, unsigned int threads)
+   *
+   *  @brief adds @p n strings to @p strs at once, using up to @p threads threads
+   *
+   *  Gives the same ids and reference counts as strings_add_batch().  The
+   *  inputs are hashed and looked up in ranges, one per thread, then
+   *  grouped by hash so each thread folds the duplicates of its own share
+   *  of the texts.  Ids are handed out in input order from counts of new
+   *  texts per range, so each thread can then make its entries, fill their
+   *  id and hash index slots and sort them without waiting on the others.
+   *  Only adding the sorted entries to the ordered text index is done by
+   *  one thread.
+   *
+   *  Small batches, or @p threads below 2, go to strings_add_batch().
+   *  Nothing else may use @p strs during the call.
+   *
+   *  @param strs    - pointer to existing @a strings struct
+   *  @param texts   - array of @p n pointers to texts
+   *  @param lens    - array of @p n text lengths in bytes, NULL if the
+   *                   texts are NUL terminated
+   *  @param n       - number of strings
+   *  @param ids_out - array to receive the id of each input, may be NULL
+   *  @param threads - most threads to use, counting the caller's
+   *
+   *  @return @a string_found if all strings were added or found, @a
+   *          string_failed if not
+   */
+
+string_result strings_add_batch_parallel(strings *strs,
+                                         const char **texts,
+                                         const size_t *lens,
+                                         unsigned int n,
+                                         unsigned int *ids_out,
+                                         unsigned int threads)
+{
+  batch_job job;
+  batch_worker *w = NULL;
+  string_slab *slab;
+  string_chunk *chunk;
+  string_node **swap;
+  unsigned int t, p, c, i, j, u, step, k, done;
+  int linked = 0;
+  string_result r = string_failed;
+
+  if (!strs || (n && !texts) || (strs->snapshot && !strs->layered)) return string_failed;
+
+  if (threads > BATCH_THREAD_MAX) threads = BATCH_THREAD_MAX;
+  if (threads > n / BATCH_THREAD_MIN) threads = n / BATCH_THREAD_MIN;
+  if (strs->shards || strs->epoch || strs->lockfree || strs->snapshot || strs->log || strs->order_stale)
+    threads = 1;
+  if (threads < 2) return strings_add_batch(strs, texts, lens, n, ids_out);
+
+  memset(&job, 0, sizeof(job));
+
+  job.strs = strs;
+  job.texts = texts;
+  job.lens = lens;
+  job.ids_out = ids_out;
+  job.n = n;
+  job.threads = threads;
+
+  job.hash = malloc(n * sizeof(uint64_t));
+  job.ent = malloc(n * sizeof(string_node *));
+  job.lead = malloc(n * sizeof(unsigned int));
+  job.part = malloc(n * sizeof(unsigned int));
+  job.part_start = malloc((threads + 1) * sizeof(unsigned int));
+  job.offset = calloc(threads * threads, sizeof(unsigned int));
+  w = calloc(threads, sizeof(batch_worker));
+  if (!job.hash || !job.ent || !job.lead || !job.part ||
+      !job.part_start || !job.offset || !w)
+    goto bail;
+
+  for (t = 0; t < threads; t++)
+  {
+    w[t].job = &job;
+    w[t].t = t;
+    w[t].start = (unsigned int)((unsigned long long)n * t / threads);
+    w[t].end = (unsigned int)((unsigned long long)n * (t + 1) / threads);
+  }
+
+    /*
+     *  Hash and look up each range, counting inputs per partition
+     */
+
+  batch_run(w, threads, batch_hash_phase);
+  for (t = 0; t < threads; t++) if (w[t].failed) goto bail;
+
+    /*
+     *  Partition p takes the inputs of range 0, then range 1 and so on,
+     *  which keeps each partition in input order
+     */
+
+  for (p = 0, i = 0; p < threads; p++)
+  {
+    job.part_start[p] = i;
+    for (t = 0; t < threads; t++)
+    {
+      c = job.offset[t * threads + p];
+      job.offset[t * threads + p] = i;
+      i += c;
+    }
+  }
+  job.part_start[threads] = i;
+
+  batch_run(w, threads, batch_scatter_phase);
+
+  batch_run(w, threads, batch_dedupe_phase);
+  for (t = 0; t < threads; t++) if (w[t].failed) goto bail;
+
+  batch_run(w, threads, batch_count_phase);
+
+  for (t = 0, u = 0; t < threads; t++)
+  {
+    w[t].first = u;
+    u += w[t].made;
+  }
+
+    /*
+     *  Everything that can fail is allocated before the table is touched
+     */
+
+  if (u)
+  {
+    if (strs->last_id + u < strs->last_id) goto bail;
+    if (id_index_reserve(strs, strs->last_id + u - 1)) goto bail;
+
+    while ((unsigned long long)(strs->text_index_used + u) * 4 > (unsigned long long)strs->text_index_size * 3)
+      if (text_index_grow(strs)) goto bail;
+  }
+
+  job.origin = malloc(((size_t)u + 1) * sizeof(unsigned int));
+  job.sorted = malloc(((size_t)u + 1) * sizeof(string_node *));
+  if (strs->order != string_order_art)
+    job.spare = malloc(((size_t)u + 1) * sizeof(string_node *));
+  if (!job.origin || !job.sorted || (strs->order != string_order_art && !job.spare))
+    goto bail;
+
+  for (t = 0; t < threads; t++)
+  {
+    if (w[t].made)
+    {
+      w[t].slab = malloc(sizeof(string_slab) + w[t].made * sizeof(string_node));
+      if (!w[t].slab) goto bail;
+    }
+
+    if (w[t].bytes)
+    {
+      w[t].chunk = malloc(sizeof(string_chunk) + w[t].bytes);
+      if (!w[t].chunk) goto bail;
+    }
+  }
+
+    /*
+     *  The blocks go in full, behind the newest block and chunk so the
+     *  space left in those is still used
+     */
+
+  for (t = 0; t < threads; t++)
+  {
+    if ((slab = w[t].slab))
+    {
+      slab->size = slab->used = w[t].made;
+      if (strs->node_slab)
+      {
+        slab->next = strs->node_slab->next;
+        strs->node_slab->next = slab;
+      }
+      else
+      {
+        slab->next = NULL;
+        strs->node_slab = slab;
+      }
+      strs->node_slab_capacity += w[t].made;
+    }
+
+    if ((chunk = w[t].chunk))
+    {
+      chunk->size = w[t].bytes;
+      chunk->used = 0;
+      if (strs->text_arena)
+      {
+        chunk->next = strs->text_arena->next;
+        strs->text_arena->next = chunk;
+      }
+      else
+      {
+        chunk->next = NULL;
+        strs->text_arena = chunk;
+      }
+    }
+  }
+
+  linked = 1;
+
+  job.base = strs->last_id;
+
+  batch_run(w, threads, batch_make_phase);
+
+  strs->last_id += u;
+  strs->id_index_used += u;
+  strs->text_index_used += u;
+  strs->node_slab_used += u;
+
+    /*
+     *  Each range's entries are sorted, merge the runs pairwise
+     */
+
+  if (strs->order != string_order_art)
+  {
+    for (step = 1; step < threads; step *= 2)
+    {
+      for (t = 0, k = 0; t < threads; t += 2 * step, k++)
+      {
+        w[k].src = job.sorted;
+        w[k].dst = job.spare;
+        w[k].lo = w[t].first;
+        w[k].mid = t + step < threads ? w[t + step].first : u;
+        w[k].hi = t + 2 * step < threads ? w[t + 2 * step].first : u;
+      }
+
+      batch_run(w, k, batch_merge_phase);
+
+      swap = job.sorted;
+      job.sorted = job.spare;
+      job.spare = swap;
+    }
+  }
+
+  done = text_order_insert_sorted(strs, job.sorted, u);
+  if (done < u)
+  {
+      /*
+       *  As in strings_add_batch(), entries already in the ordered index
+       *  leave by the normal path, looked up by the caller's text
+       */
+
+    for (j = 0; j < done; j++) job.part[j] = job.origin[job.sorted[j]->value.id - job.base];
+
+    for (j = 0; j < done; j++)
+    {
+      i = job.part[j];
+      strings_remove_n(strs, texts[i], batch_len(&job, i));
+    }
+
+    for (i = u; i-- > 0; )
+      if (strs->id_index[job.base + i]) entry_discard(strs, strs->id_index[job.base + i]);
+
+    goto bail;
+  }
+
+  batch_run(w, threads, batch_finish_phase);
+
+  r = string_found;
+
+bail:
+  if (w)
+  {
+    for (t = 0; !linked && t < threads; t++)
+    {
+      if (w[t].slab) free(w[t].slab);
+      if (w[t].chunk) free(w[t].chunk);
+    }
+    free(w);
+  }
+  if (job.hash) free(job.hash);
+  if (job.ent) free(job.ent);
+  if (job.lead) free(job.lead);
+  if (job.part) free(job.part);
+  if (job.part_start) free(job.part_start);
+  if (job.offset) free(job.offset);
+  if (job.origin) free(job.origin);
+  if (job.sorted) free(job.sorted);
+  if (job.spare) free(job.spare);
+  return r;
+}
+
+  /**
+   *  @fn string_reader *strings_reader_new(strings *strs)
+   *
+   *  @brief registers the calling thread as a reader of read-mostly @p strs
+   *
+   *  The reader belongs to the caller, who frees it with
+   *  strings_reader_free(), before or after strings_free() of @p strs.
+   *
+   *  @param strs - pointer to existing read-mostly @a strings struct
+   *
+   *  @return pointer to new @a string_reader struct, NULL on failure
+   */
+
+string_reader *strings_reader_new(strings *strs)
+{
+  string_reader *reader;
+
+  if (!strs || !strs->epoch) return NULL;
+
+  reader = calloc(1, sizeof(string_reader));
+  if (!reader) return NULL;
+
+  reader->strs = strs;
+
+  pthread_mutex_lock(&strs->epoch->reader_lock);
+  reader->next = strs->epoch->readers;
+  strs->epoch->readers = reader;
+  pthread_mutex_unlock(&strs->epoch->reader_lock);
+
+  return reader;
+}
+
+  /**
+   *  @fn void strings_reader_free(string_reader *reader)
+   *
+   *  @brief unregisters and frees @p reader
+   *
+   *  May be called after strings_free() of the table of @p reader, which
+   *  leaves its readers registered with nothing.
+   *
+   *  @param reader - pointer to existing @a string_reader struct, not
+   *                  between strings_read_begin() and strings_read_end()
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void strings_reader_free(string_reader *reader)
+{
+  string_reader **pr;
+  string_epoch *e;
+
+  if (!reader) return;
+
+  if (!reader->strs)
+  {
+    free(reader);
+    return;
+  }
+
+  e = reader->strs->epoch;
+
+  pthread_mutex_lock(&e->reader_lock);
+  for (pr = &e->readers; *pr; pr = &(*pr)->next)
+  {
+    if (*pr == reader)
+    {
+      *pr = reader->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&e->reader_lock);
+
+  free(reader);
+}
+
+  /**
+   *  @fn void strings_read_begin(string_reader *reader)
+   *
+   *  @brief starts a read of the table of @p reader
+   *
+   *  Nothing unlinked from the table from here on is reused or freed
+   *  before the matching strings_read_end().  Takes no lock.
+   *
+   *  @param reader - pointer to existing @a string_reader struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void strings_read_begin(string_reader *reader)
+{
+  string_epoch *e;
+  unsigned long epoch;
+
+  if (!reader) return;
+
+  e = reader->strs->epoch;
+
+    /*
+     *  If the epoch moved on before this reader was seen in it, a writer
+     *  may have missed the reader, so announce the new one
+     */
+
+  do
+  {
+    epoch = __atomic_load_n(&e->epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&reader->state, epoch << 1 | 1, __ATOMIC_SEQ_CST);
+  } while (__atomic_load_n(&e->epoch, __ATOMIC_SEQ_CST) != epoch);
+}
+
+  /**
+   *  @fn void strings_read_end(string_reader *reader)
+   *
+   *  @brief ends a read started by strings_read_begin()
+   *
+   *  Entries found since then must not be used afterwards.
+   *
+   *  @param reader - pointer to existing @a string_reader struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void strings_read_end(string_reader *reader)
+{
+  if (!reader) return;
+
+  __atomic_store_n(&reader->state, 0, __ATOMIC_RELEASE);
+}
+
+  /**
+   *  @fn string_local *strings_local_new(strings *global)
+   *
+   *  @brief create a new thread-local front interner of @p global
+   *
+   *  The interner belongs to one thread.  Its table keeps no ordered text
+   *  index, which nothing but a merge reads.  @p global must allow
+   *  strings_intern() from every thread that merges into it at once, as a
+   *  concurrent, read-mostly or lock-free table does.
+   *
+   *  @param global - pointer to existing @a strings struct to merge into
+   *
+   *  @return pointer to new @a string_local struct, NULL on failure
+   */
+
+string_local *strings_local_new(strings *global)
+{
+  string_local *local;
+
+  if (!global) return NULL;
+
+  local = calloc(1, sizeof(string_local));
+  if (!local) return NULL;
+
+  local->global = global;
+
+  local->table = local_table_new(global->order);
+  if (!local->table)
+  {
+    free(local);
+    return NULL;
+  }
+
+  return local;
+}
+
+  /**
+   *  @fn void strings_local_free(string_local *local)
+   *
+   *  @brief frees @p local, dropping anything interned since the last merge
+   *
+   *  @param local - pointer to existing @a string_local struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void strings_local_free(string_local *local)
+{
+  if (!local) return;
+
+  strings_free(local->table);
+  free(local);
+}
+
+  /**
+   *  @fn string_result strings_local_intern(string_local *local, const char *text, size_t len, unsigned int *id)
+   *
+   *  @brief interns the @p len bytes at @p text in @p local and reports its local id
+   *
+   *  Touches no shared memory.  Local ids count up from 0 after each
+   *  merge, and strings_local_merge() maps them to ids of the global table.
+   *
+   *  @param local - pointer to existing @a string_local struct
+   *  @param text  - pointer to text to intern
+   *  @param len   - length of @p text in bytes
+   *  @param id    - pointer to receive local id of the entry, may be NULL
+   *
+   *  @return as strings_intern()
+   */
+
+string_result strings_local_intern(string_local *local,
+                                   const char *text,
+                                   size_t len,
+                                   unsigned int *id)
+{
+  if (!local) return string_failed;
+
+  return strings_intern(local->table, text, len, id);
+}
+
+  /**
+   *  @fn unsigned int strings_local_count(string_local *local)
+   *
+   *  @brief returns the number of local ids @p local has handed out since the last merge
+   *
+   *  @param local - pointer to existing @a string_local struct
+   *
+   *  @return number of local ids, the size of the remap of the next merge
+   */
+
+unsigned int strings_local_count(string_local *local)
+{
+  if (!local) return 0;
+
+  return local->table->last_id;
+}
+
+  /**
+   *  @fn string_result strings_local_merge(string_local *local, unsigned int *remap)
+   *
+   *  @brief merges the entries of @p local into its global table and starts it afresh
+   *
+   *  Each local entry is interned into the global table once, adding all
+   *  of its local references to the global ref_cnt in one update.  If a
+   *  merge fails part way, the references of the entries merged so far are
+   *  not counted again by calling it once more.
+   *
+   *  @param local - pointer to existing @a string_local struct
+   *  @param remap - array of strings_local_count() slots to receive the
+   *                 global id of each local id, may be NULL
+   *
+   *  @return @a string_found if all entries were merged, @a string_failed
+   *          if not
+   */
+
+string_result strings_local_merge(string_local *local, unsigned int *remap)
+{
+  strings *table;
+  string_node *sn;
+  unsigned int i, end;
+
+  if (!local) return string_failed;
+
+  table = local->table;
+  end = table->last_id;
+
+  for (i = 0; i < end; i++)
+  {
+    sn = table->id_index[i];
+    if (!sn) continue;
+
+    if (intern_refs(local->global,
+                    sn->value.text,
+                    sn->value.len,
+                    sn->value.ref_cnt,
+                    remap ? &remap[i] : NULL) == string_failed)
+      return string_failed;
+
+    sn->value.ref_cnt = 0;
+  }
+
+  table = local_table_new(local->table->order);
+  if (!table) return string_failed;
+
+  strings_free(local->table);
+  local->table = table;
+
+  return string_found;
+}
+
+  /**
+   *  @fn string_result strings_remove(strings *strs, char *text)
+   *
+   *  @brief removes entry with text key of @p text from @p strs
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - text value of @a string to remove
+   *
+   *  @return @a string_result indicating success or failure
+   */
+
+string_result strings_remove(strings *strs, char *text)
+{
+  if (!strs || !text) return string_failed;
+
+  return strings_remove_n(strs, text, strlen(text));
+}
+
+  /**
+   *  @fn string_result strings_remove_n(strings *strs, const char *text, size_t len)
+   *
+   *  @brief removes entry with text key of the @p len bytes at @p text from @p strs
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text value of @a string to remove
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return @a string_result indicating success or failure
+   */
+
+string_result strings_remove_n(strings *strs, const char *text, size_t len)
+{
+  string_log *log = strs && text ? strs->log : NULL;
+  string *s;
+  unsigned int id = 0, refs = 0;
+  string_result r;
+
+  if (log)
+  {
+    string_log_hold(log, 1);
+    s = strings_find_by_text_n(strs, text, len);
+    if (s)
+    {
+      id = s->id;
+      refs = s->ref_cnt;
+    }
+  }
+
+  r = remove_text(strs, text, len);
+
+  if (r == string_found && log && string_log_append(log, STRING_LOG_REMOVE, id, 0, text, len))
+  {
+      /*
+       *  A remove the log did not take is put back, under the same id
+       */
+
+    if (strs->snapshot && id < strs->snapshot->header->id_end)
+    {
+      string_snapshot_restore(strs->snapshot, id);
+      ++strs->id_index_used;
+    }
+    else intern_at(strs, text, len, id, refs);
+
+    r = string_failed;
+  }
+
+  if (log) string_log_release(log);
+
+  return r;
+}
+
+  /**
+   *  @fn string_result remove_text(strings *strs, const char *text, size_t len)
+   *
+   *  @brief strings_remove_n() without the write-ahead log
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text value of @a string to remove
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return @a string_result indicating success or failure
+   */
+
+static string_result remove_text(strings *strs, const char *text, size_t len)
+{
+  string_node sn;
+  string_node *found = NULL;
+  string_node *moved = NULL;
+  uint64_t hash;
+
+  if (!strs || !text || (strs->snapshot && !strs->layered)) return string_failed;
+
+  if (strs->shards) return shard_remove(strs, text, len);
+  if (strs->epoch) return epoch_remove(strs, text, len);
+  if (strs->lockfree) return lockfree_remove(strs, text, len);
+
+  hash = strings_hash(text, len);
+
+  if (strs->snapshot && (found = string_snapshot_find(strs->snapshot, text, len, hash)))
+  {
+    if (string_snapshot_remove(strs->snapshot, found->value.id)) return string_failed;
+    --strs->id_index_used;
+    return string_found;
+  }
+
+  found = text_index_find(strs, text, len, hash);
+  if (!found) return string_failed;
+
+  memset(&sn, 0, sizeof(string_node));
+  sn.value.text = (char *)text;
+  sn.value.len = len;
+  sn.value.id = found->value.id;
+
+  text_node_set_prefix(&sn, text);
+
+  text_index_delete(strs, found);
+
+  strs->id_index[sn.value.id] = NULL;
+  --strs->id_index_used;
+
+  if (strs->order_stale)
+  {
+    node_slab_release(strs, found);
+    return string_found;
+  }
+
+  switch (strs->order)
+  {
+    case string_order_btree:
+      string_btree_delete(strs->text_btree, found);
+      node_slab_release(strs, found);
+      return string_found;
+
+    case string_order_art:
+      string_art_delete(strs->text_art, found);
+      node_slab_release(strs, found);
+      return string_found;
+
+    default:
+      break;
+  }
+
+  avl_delete(strs->text_root, (avl_node *)&sn);
+
+    /*
+     *  If avl_delete() relocated the in-order successor into the memory of
+     *  @a found, point the other indexes at its new home and release the
+     *  old one.  Text of removed entries stays in the arena until
+     *  strings_free().
+     */
+
+  if (found->value.id != sn.value.id)
+  {
+    moved = found;
+    found = strs->id_index[moved->value.id];
+    strs->id_index[moved->value.id] = moved;
+    text_index_replace(strs, found, moved);
+  }
+
+  node_slab_release(strs, found);
+
+  return string_found;
+}
+
+  /**
+   *  @fn string *strings_find_by_text(strings *strs, char *text)
+   *
+   *  @brief searches @p strs for entry with text value of @p text
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - text value of @a string to remove
+   *
+   *  @return pointer to @a string struct if found, NULL if not
+   */
+
+string *strings_find_by_text(strings *strs, char *text)
+{
+  if (!strs || !text) return NULL;
+
+  return strings_find_by_text_n(strs, text, strlen(text));
+}
+
+  /**
+   *  @fn string *strings_find_by_text_n(strings *strs, const char *text, size_t len)
+   *
+   *  @brief searches @p strs for entry with text value of the @p len bytes at @p text
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text value to search for
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return pointer to @a string struct if found, NULL if not
+   */
+
+string *strings_find_by_text_n(strings *strs, const char *text, size_t len)
+{
+  string_shard *shard;
+  string_link *link;
+  string_node *found;
+  uint64_t hash;
+
+  if (!strs || !text) return NULL;
+
+  hash = strings_hash(text, len);
+
+  if (strs->shards)
+  {
+    shard = shard_of(strs, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    found = text_index_find(shard->table, text, len, hash);
+    pthread_mutex_unlock(&shard->lock);
+
+    return found ? &found->value : NULL;
+  }
+
+  if (strs->snapshot && (found = string_snapshot_find(strs->snapshot, text, len, hash)))
+    return &found->value;
+
+  if (strs->lockfree)
+  {
+    link = lockfree_find(strs, text, len, hash);
+    found = link ? __atomic_load_n(&link->node, __ATOMIC_ACQUIRE) : NULL;
+  }
+  else if (strs->epoch) found = epoch_index_find(strs, text, len, hash);
+  else found = text_index_find(strs, text, len, hash);
+
+  return found ? &found->value : NULL;
+}
+
+  /**
+   *  @fn string *strings_find_by_id(strings *strs, unsigned int id)
+   *
+   *  @brief searches @p strs for entry with id value of @p id
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param id - id value of @a string to remove
+   *
+   *  @return pointer to @a string struct if found, NULL if not
+   */
+
+string *strings_find_by_id(strings *strs, unsigned int id)
+{
+  string_node *found;
+
+  if (!strs) return NULL;
+
+  found = id_index_get(strs, id);
+
+  return found ? &found->value : NULL;
+}
+
+  /**
+   *  @fn string *strings_find_prefix(strings *strs, const char *prefix, size_t len, string_cursor *cursor)
+   *
+   *  @brief returns the next entry of @p strs whose text starts with @p prefix
+   *
+   *  Call repeatedly with the same @p cursor to stream the matches in text
+   *  order.  Each call seeks into the ordered text index just past the
+   *  previous match, so only matching entries are visited, and the table
+   *  may change between calls.
+   *
+   *  @param strs   - pointer to existing @a strings struct
+   *  @param prefix - pointer to prefix text
+   *  @param len    - length of @p prefix in bytes
+   *  @param cursor - pointer to @a string_cursor struct, new or reset for
+   *                  the first call
+   *
+   *  @return pointer to @a string struct of next match, NULL once there are
+   *          no more
+   */
+
+string *strings_find_prefix(strings *strs,
+                            const char *prefix,
+                            size_t len,
+                            string_cursor *cursor)
+{
+  string_node *sn;
+
+  if (!strs || !prefix || !cursor || cursor->done) return NULL;
+
+  if (cursor->started) sn = text_order_seek(strs, cursor->text, cursor->len, 1, 0);
+  else sn = text_order_seek(strs, prefix, len, 1, 1);
+
+  if (!sn || sn->value.len < len || memcmp(sn->value.text, prefix, len)) goto done;
+
+  if (cursor_save(cursor, sn)) goto done;
+
+  return &sn->value;
+
+done:
+  cursor->done = 1;
+  return NULL;
+}
+
+  /**
+   *  @fn unsigned int strings_scan(strings *strs, string_cursor *cursor, unsigned int limit, avl_action action)
+   *
+   *  @brief calls @p action for the next entries of the range scan of @p cursor
+   *
+   *  Resumes where the previous call on @p cursor stopped, so a large range
+   *  can be paged through in bounded slices.  Each entry is found by a seek
+   *  past the one before it, so the table, including the entry passed to
+   *  @p action, may change during and between calls.
+   *
+   *  @param strs   - pointer to existing @a strings struct
+   *  @param cursor - pointer to @a string_cursor struct set up with
+   *                  string_cursor_set_range()
+   *  @param limit  - most entries to visit in this call, 0 for no limit
+   *  @param action - pointer to function to call at each entry
+   *
+   *  @return number of entries visited, the done member of @p cursor is set
+   *          once the range is exhausted
+   */
+
+unsigned int strings_scan(strings *strs,
+                          string_cursor *cursor,
+                          unsigned int limit,
+                          avl_action action)
+{
+  string_node *sn;
+  unsigned int n = 0;
+  int forward;
+
+  if (!strs || !cursor || !action) return 0;
+
+  forward = cursor->direction == string_forward;
+
+  while (!cursor->done && (!limit || n < limit))
+  {
+    if (cursor->started) sn = text_order_seek(strs, cursor->text, cursor->len, forward, 0);
+    else if (forward) sn = text_order_seek(strs, cursor->lower, cursor->lower_len, 1, 1);
+    else sn = text_order_seek(strs, cursor->upper, cursor->upper_len, 0, 0);
+
+    if (!sn ||
+        (forward && cursor->upper && text_compare(sn, cursor->upper, cursor->upper_len) >= 0) ||
+        (!forward && cursor->lower && text_compare(sn, cursor->lower, cursor->lower_len) < 0) ||
+        cursor_save(cursor, sn))
+    {
+      cursor->done = 1;
+      break;
+    }
+
+    action((avl_node *)sn);
+    ++n;
+  }
+
+  return n;
+}
+
+  /**
+   *  @fn uint64_t strings_hash(const char *text, size_t len)
+   *
+   *  @brief computes the hash @a strings uses for the @p len bytes at @p text
+   *
+   *  This is the 64 bit FNV-1a hash.  It is the value cached in the hash
+   *  member of every entry, so side tables keyed by interned strings can
+   *  use string_hash() instead of hashing the text again.
+   *
+   *  @param text - pointer to text to hash
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return hash of @p text
+   */
+
+uint64_t strings_hash(const char *text, size_t len)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  const unsigned char *p = (const unsigned char *)text;
+
+  if (!p) return h;
+
+  while (len--)
+  {
+    h ^= *p++;
+    h *= 0x100000001b3ULL;
+  }
+
+  return h;
 }
 
   /**
    *  @fn void strings_walk(strings *strs, string_key key, avl_action action)
    *
-   *  @brief walks through all entries in @p strs AVL tree
+   *  @brief walks through all entries in @p strs AVL tree
+   *
+   *  Walks through each entry in @p strs, in either text or id order based on value of @p key.
+   *  @p action will be called at each entry.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param key - @a string_key (enum value of id search order)
+   *  @param action - pointer to function to call at each entry found
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void strings_walk(strings *strs, string_key key, avl_action action)
+{
+  if (!strs || !action) return;
+
+  strings_walk_with_context(strs, key, avl_action_adapter, &action);
+}
+
+  /**
+   *  @fn int strings_walk_with_context(strings *strs, string_key key, string_walk_action action, void *ctx)
+   *
+   *  @brief walks through entries in @p strs, passing @p ctx to @p action
+   *
+   *  Like strings_walk(), but all state of the walk can live in @p ctx
+   *  instead of globals, so walks of different tables may run at the same
+   *  time from different threads.  The walk stops at the first non-zero
+   *  value @p action returns.
+   *
+   *  @param strs   - pointer to existing @a strings struct
+   *  @param key    - @a string_key (enum value of id search order)
+   *  @param action - pointer to function to call at each entry found
+   *  @param ctx    - pointer passed to @p action
+   *
+   *  @return 0 if every entry was visited, else the value that stopped it
+   */
+
+int strings_walk_with_context(strings *strs,
+                              string_key key,
+                              string_walk_action action,
+                              void *ctx)
+{
+  string_node *sn;
+  unsigned int i, end;
+  int r;
+
+  if (!strs || !action) return 0;
+
+  switch (key)
+  {
+    case string_id:
+      end = id_index_end(strs);
+      for (i = 0; i < end; i++)
+        if ((sn = id_index_get(strs, i)) && (r = action((avl_node *)sn, ctx))) return r;
+      break;
+
+    case string_text:
+      return text_order_walk(strs, action, ctx);
+  }
+
+  return 0;
+}
+
+  /**
+   *  @fn string_iterator *strings_begin(strings *strs, string_key key)
+   *
+   *  @brief starts an iteration over the entries of @p strs
+   *
+   *  The table may change during the iteration.  Entries added behind the
+   *  iterator's position are not seen, and removed ones are skipped.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param key  - @a string_key (enum value of id search order)
+   *
+   *  @return pointer to new @a string_iterator struct, NULL on failure
+   */
+
+string_iterator *strings_begin(strings *strs, string_key key)
+{
+  string_iterator *it;
+
+  if (!strs) return NULL;
+
+  it = malloc(sizeof(string_iterator));
+  if (!it) return NULL;
+
+  memset(it, 0, sizeof(string_iterator));
+  it->strs = strs;
+  it->key = key;
+
+  return it;
+}
+
+  /**
+   *  @fn string *strings_next(string_iterator *it)
+   *
+   *  @brief advances @p it to the next entry
+   *
+   *  @param it - pointer to existing @a string_iterator struct
+   *
+   *  @return pointer to @a string struct of next entry, NULL at the end
+   */
+
+string *strings_next(string_iterator *it)
+{
+  string_node *sn = NULL;
+  strings *strs;
+
+  if (!it || it->cursor.done) return NULL;
+
+  strs = it->strs;
+
+  switch (it->key)
+  {
+    case string_id:
+      while (it->id < id_index_end(strs) && !(sn = id_index_get(strs, it->id))) ++it->id;
+      if (sn) ++it->id;
+      break;
+
+    case string_text:
+      if (it->cursor.started) sn = text_order_seek(strs, it->cursor.text, it->cursor.len, 1, 0);
+      else sn = text_order_seek(strs, NULL, 0, 1, 1);
+      if (sn && cursor_save(&it->cursor, sn)) sn = NULL;
+      break;
+  }
+
+  if (!sn)
+  {
+    it->cursor.done = 1;
+    return NULL;
+  }
+
+  return &sn->value;
+}
+
+  /**
+   *  @fn void strings_end(string_iterator *it)
+   *
+   *  @brief ends the iteration of @p it, freeing it
+   *
+   *  @param it - pointer to existing @a string_iterator struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void strings_end(string_iterator *it)
+{
+  if (!it) return;
+
+  if (it->cursor.text) free(it->cursor.text);
+
+  free(it);
+}
+
+  /**
+   *  @fn void strings_slab_occupancy(strings *strs, unsigned int *used, unsigned int *capacity)
+   *
+   *  @brief reports how full the entry slab of @p strs is
+   *
+   *  @param strs     - pointer to existing @a strings struct
+   *  @param used     - pointer to receive number of entries in use, may be NULL
+   *  @param capacity - pointer to receive number of entries allocated in
+   *                    slab blocks, may be NULL
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void strings_slab_occupancy(strings *strs, unsigned int *used, unsigned int *capacity)
+{
+  string_shard *shard;
+  unsigned int u = 0, c = 0;
+  unsigned int i;
+
+  if (strs)
+  {
+    u = strs->node_slab_used;
+    c = strs->node_slab_capacity;
+
+    for (i = 0; i < strs->shard_count; i++)
+    {
+      shard = &strs->shards[i];
+
+      pthread_mutex_lock(&shard->lock);
+      u += shard->table->node_slab_used;
+      c += shard->table->node_slab_capacity;
+      pthread_mutex_unlock(&shard->lock);
+    }
+  }
+
+  if (used) *used = u;
+  if (capacity) *capacity = c;
+}
+
+  /**
+   *  @fn char *strings_result_to_str(string_result sr)
+   *
+   *  @brief returns string representation of @p sr
+   *
+   *  @param sr - @a string_result to convert to string
+   *
+   *  @return string representation of @p sr
+   */
+
+char *strings_result_to_str(string_result sr)
+{
+  switch (sr)
+  {
+    case string_found: return "FOUND";
+    case string_not_found: return "NOT FOUND";
+    case string_inserted: return "INSERTED";
+    case string_failed:
+    default:
+      return "FAILED";
+  }
+
+  return "FAILED";
+}
+
+  /**
+   *  @fn string_result strings_str_to_result(char *s)
+   *
+   *  @brief returns @a string_result from string representation
+   *
+   *  @param s - string representation of @a string_result
+   *
+   *  @return @a string_result
+   */
+
+string_result strings_str_to_result(char *s)
+{
+  if (!s) return string_failed;
+
+  if (!strcmp(s, "FOUND")) return string_found;
+  if (!strcmp(s, "NOT FOUND")) return string_not_found;
+  if (!strcmp(s, "INSERTED")) return string_inserted;
+
+  return string_failed;
+}
+
+  /**
+   *  @fn void strings_renumber(strings *strs)
+   *
+   *  @brief renumbers all entries in @p strs
+   *
+   *  Walks entire AVL tree of entires in @p str, changing the id of each entry.
+   *  Rebuilds id_index (dense array index of ids).  Does nothing to a table
+   *  with a write-ahead log, whose records hold the ids it gave out.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void strings_renumber(strings *strs)
+{
+  renumber_ctx ctx;
+  unsigned int size;
+  unsigned int i;
+
+  if (!strs || strs->snapshot || strs->log) return;
+  if (text_order_sync(strs)) return;
+
+  size = ID_INDEX_MIN_SIZE;
+  while (size < strs->id_index_used) size *= 2;
+
+  ctx.id_index = calloc(size, sizeof(string_node *));
+  if (!ctx.id_index) return;
+
+  ctx.new_id = 0;
+
+  text_order_walk(strs, renumber_action, &ctx);
+
+    /*
+     *  The chunks of a concurrent id index already cover every new id,
+     *  ids only ever shrink here
+     */
+
+  if (strs->id_dir)
+  {
+    for (i = 0; i < ID_DIR_SIZE && strs->id_dir[i]; i++)
+      memset(strs->id_dir[i], 0, ID_CHUNK_SIZE * sizeof(string_node *));
+
+    for (i = 0; i < ctx.new_id; i++) id_dir_set(strs, i, ctx.id_index[i]);
+
+    free(ctx.id_index);
+
+    strs->id_index_used = ctx.new_id;
+    strs->last_id = ctx.new_id;
+    return;
+  }
+
+  free(strs->id_index);
+
+  strs->id_index = ctx.id_index;
+  strs->id_index_size = size;
+  strs->id_index_used = ctx.new_id;
+  strs->last_id = ctx.new_id;
+}
+
+  /**
+   *  @fn int strings_save(strings *strs, const char *path)
+   *
+   *  @brief writes @p strs to a snapshot file for strings_open_mapped()
+   *
+   *  The file holds the text of every entry in one blob, the blob offset
+   *  of each id, a prebuilt hash index and the text order, behind a
+   *  versioned header with checksums of itself and of the rest.  It is
+   *  written in the byte order of this machine, and only opens there.  It
+   *  is written beside @p path and renamed over it once synced to disk,
+   *  so @p path always holds a whole snapshot.
+   *
+   *  Ids and reference counts are kept.  @p strs needs to be left to the
+   *  saving thread while it is saved.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param path - pointer to path of file
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+int strings_save(strings *strs, const char *path)
+{
+  return string_snapshot_save(strs, path, NULL, NULL);
+}
+
+  /**
+   *  @fn int strings_verify_mapped(strings *strs)
+   *
+   *  @brief checks the whole snapshot file of @p strs against its checksum
+   *
+   *  strings_open_mapped() only checks the header, so that opening does
+   *  not read the whole file; this reads all of it.
+   *
+   *  @param strs - pointer to @a strings struct from strings_open_mapped()
+   *
+   *  @return 0 if the file is intact, non-zero if not or if @p strs is not
+   *          mapped
+   */
+
+int strings_verify_mapped(strings *strs)
+{
+  if (!strs || !strs->snapshot) return 1;
+
+  return string_snapshot_verify(strs->snapshot);
+}
+
+  /**
+   *  @fn int strings_merge_overlay(strings *strs, const char *path)
+   *
+   *  @brief writes the base and overlay of @p strs to a new base file at
+   *         @p path and reopens @p strs on it
+   *
+   *  The new file is written as by strings_save(), keeping every id, and
+   *  @p strs then serves it with an empty overlay; removed base entries are
+   *  gone from it.  @p path may be the file @p strs was opened from.
+   *  Entries found before the merge are freed with the old base and
+   *  overlay.  A write-ahead log of @p strs gets a checkpoint of the new
+   *  base, synced before the new file replaces the old, and is emptied
+   *  once @p strs is on it.  On failure @p strs is left as it was, though
+   *  @p path may already hold the new base.
+   *
+   *  @param strs - pointer to @a strings struct from strings_open_layered()
+   *  @param path - pointer to path of file
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+int strings_merge_overlay(strings *strs, const char *path)
+{
+  strings *merged;
+  strings swap;
+
+  if (!strs || !strs->layered) return 1;
+
+  if (string_snapshot_save(strs, path, merge_commit, strs)) return 1;
+
+  merged = strings_open_layered(path);
+  if (!merged) return 1;
+
+    /*
+     *  The caller keeps its pointer and its log, the old base and overlay go
+     */
+
+  merged->log = strs->log;
+  strs->log = NULL;
+
+  swap = *strs;
+  *strs = *merged;
+  *merged = swap;
+
+  strings_free(merged);
+
+  if (strs->log) return string_log_reset(strs->log, strs->snapshot->header->header_sum);
+
+  return 0;
+}
+
+  /**
+   *  @fn int strings_log_open(strings *strs, const char *path, unsigned int group)
+   *
+   *  @brief replays the write-ahead log at @p path into @p strs and keeps
+   *         logging the changes to @p strs there
+   *
+   *  Every entry added to @p strs is then recorded in the log with its id
+   *  and references, every reference taken to an entry already there with
+   *  its id, and every entry removed with its id, by strings_add(),
+   *  strings_intern(), strings_remove() and all the calls built on them.
+   *  Records are appended; the file is synced every @p group records, so
+   *  threads adding at once share a sync, and on strings_log_sync(),
+   *  strings_log_close() and strings_free().  A crash loses at most the
+   *  records since the last sync.  A change the log fails to take is
+   *  undone and the call making it fails; once a write or sync has
+   *  failed, every change does.  So that records follow the changes, a
+   *  new entry or a remove waits for the changes in progress and holds
+   *  off new ones.
+   *
+   *  Replaying gives each entry the id and reference count it had, so
+   *  @p strs must start out as the log did: empty for a table built in
+   *  memory, fresh from the file for a layered one.  A log begun on
+   *  another snapshot than the one @p strs was opened from is replayed
+   *  from the checkpoint strings_merge_overlay() wrote of that snapshot,
+   *  in case a crash kept the merge from emptying it.  With no such
+   *  checkpoint the log is not for @p strs and the open fails, unless the
+   *  log holds no records.  For other tables, strings_save() and a new log
+   *  take the place of a long one.
+   *
+   *  @param strs  - pointer to existing @a strings struct
+   *  @param path  - pointer to path of file, created if missing
+   *  @param group - number of records written per sync, 0 for the default
+   *
+   *  @return 0 on success, non-zero on failure, when @p strs may hold part
+   *          of the log
+   */
+
+int strings_log_open(strings *strs, const char *path, unsigned int group)
+{
+  uint64_t base;
+
+  if (!strs || strs->log || (strs->snapshot && !strs->layered)) return 1;
+
+  base = strs->snapshot ? strs->snapshot->header->header_sum : 0;
+
+  strs->log = string_log_open(path, group, base, log_replay_action, strs);
+
+  return !strs->log;
+}
+
+  /**
+   *  @fn int strings_log_sync(strings *strs)
+   *
+   *  @brief syncs every record written to the write-ahead log of @p strs to
+   *         the disk
+   *
+   *  Call at a commit point, before acting on ids added since the last one.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *
+   *  @return 0 if every record so far reached the disk, non-zero if not or
+   *          if @p strs has no log
+   */
+
+int strings_log_sync(strings *strs)
+{
+  if (!strs || !strs->log) return 1;
+
+  return string_log_sync(strs->log);
+}
+
+  /**
+   *  @fn int strings_log_close(strings *strs)
+   *
+   *  @brief syncs and closes the write-ahead log of @p strs, ending logging
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *
+   *  @return 0 if every record reached the disk, non-zero if not or if
+   *          @p strs has no log
+   */
+
+int strings_log_close(strings *strs)
+{
+  int r;
+
+  if (!strs || !strs->log) return 1;
+
+  r = string_log_close(strs->log);
+  strs->log = NULL;
+
+  return r;
+}
+
+  /**
+   *  @fn avl_node *string_node_new()
+   *
+   *  @brief create a new @a string_node struct
+   *
+   *  @par Parameters
+   *  None.
+   *
+   *  @return pointer to new @a avl_node struct
+   */
+
+avl_node *string_node_new(void)
+{
+  string_node *sn;
+
+  sn = malloc(sizeof(string_node));
+  if (sn) memset(sn, 0, sizeof(string_node));
+
+  return (avl_node *)sn;
+}
+
+  /**
+   *  @fn avl_node *string_node_new_with_values(char *text, unsigned int id)
+   *
+   *  @brief create a new @a string_node struct
+   *
+   *  @param text - string containing text value of node
+   *  @param id   - unique indentifier of node
+   *
+   *  @return pointer to new @a avl_node struct
+   */
+
+avl_node *string_node_new_with_values(char *text, unsigned int id)
+{
+  string_node *sn;
+
+  sn = (string_node *)string_node_new();
+  if (!sn) return NULL;
+
+  if (text)
+  {
+    sn->value.text = strdup(text);
+    sn->value.len = strlen(text);
+    sn->value.hash = strings_hash(text, sn->value.len);
+
+    text_node_set_prefix(sn, text);
+  }
+  sn->value.id = id;
+
+  return (avl_node *)sn;
+}
+
+  /**
+   *  @fn void string_node_dup(avl_node *n)
+   *
+   *  @brief creates a deep copy of @p n
+   *
+   *  @param n - pointer to existing @a avl_node that is a @a string_node
+   *
+   *  @return pointer to new @a avl_node struct
+   */
+
+avl_node *string_node_dup(avl_node *n)
+{
+  avl_node *nsn;
+  string_node *sn;
+
+  if (!n) return NULL;
+
+  sn = (string_node *)n;
+
+  nsn = string_node_new_with_values(sn->value.text, sn->value.id);
+
+  return nsn;
+}
+
+  /**
+   *  @fn void string_node_copy_data(avl_node *dst, avl_node *src)
+   *
+   *  @brief copies payload data contained in @p src to @p dst
+   *
+   *  @param dst - pointer to existing @a avl_node that is a @a string_node
+   *  @param src - pointer to existing @a avl_node that is a @a string_node
+   *
+   *  @par Returns
+   *       Nothing.
+   */
+
+void string_node_copy_data(avl_node *dst, avl_node *src)
+{
+  string *sd, *ss;
+
+  if (!dst || !src) return;
+
+  sd = &((string_node *)dst)->value;
+  ss = &((string_node *)src)->value;
+
+  string_copy(sd, ss);
+}
+
+  /**
+   *  @fn void string_node_free(avl_node *n)
+   *
+   *  @brief frees all memory allocated to @p n that is a @a string_node
+   *
+   *  @param n - pointer to existing @a avl_node that is a @a string_node
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+void string_node_free(avl_node *n)
+{
+  string_node *sn;
+
+  if (!n) return;
+
+  sn = (string_node *)n;
+
+  if (sn->value.text && sn->value.text != (char *)sn->key) free(sn->value.text);
+  free(n);
+}
+
+  /**
+   *  @fn int string_node_compare_text(avl_node *a, avl_node *b)
+   *
+   *  @brief compares text of @a string payload of @p a with
+   *  text of @a string payload of @p b
+   *
+   *  Compares bytes up to the shorter length, a string sorts before any
+   *  longer string it is a prefix of.  For NUL free text this is the same
+   *  order as strcmp().
+   *
+   *  @param a - pointer to existing @a avl_node struct
+   *  @param b - pointer to existing @a avl_node struct
+   *
+   *  @return <0 if @p a is lexically less than @p b
+   *  @return >0 if @p a is lexically greater than @p b
+   *  @return 0 if @p a is lexically equal to @p b
+   */
+
+int string_node_compare_text(avl_node *a, avl_node *b)
+{
+  string_node *sna, *snb;
+  char *ta, *tb;
+  size_t la, lb;
+  int cmp = 0;
+
+  if (!a || !b) return 0;
+
+  sna = (string_node *)a;
+  snb = (string_node *)b;
+
+  ta = sna->value.text;
+  tb = snb->value.text;
+
+  if (!ta || !tb) return 0;
+
+  la = sna->value.len;
+  lb = snb->value.len;
+
+  cmp = memcmp(ta, tb, la < lb ? la : lb);
+  if (!cmp) cmp = (la > lb) - (la < lb);
+
+  if (cmp < 0) cmp = -1;
+  else if (cmp > 0) cmp = 1;
+  else cmp = 0;
+
+  return cmp;
+}
+
+  /**
+   *  @fn int string_node_compare_id(avl_node *a, avl_node *b)
+   *
+   *  @brief compares id of @a string payload of @p a with
+   *  id of @a string payload of @p b
+   *
+   *  @param a - pointer to existing @a avl_node struct
+   *  @param b - pointer to existing @a avl_node struct
+   *
+   *  @return <0 if id of @p a is less than id of @p b
+   *  @return >0 if id of @p a is greater than id of @p b
+   *  @return 0 if id of @p a is equal to id of @p b
+   */
+
+int string_node_compare_id(avl_node *a, avl_node *b)
+{
+  string_node *sna, *snb;
+
+  if (!a || !b) return 0;
+
+  sna = (string_node *)a;
+  snb = (string_node *)b;
+
+  if (sna->value.id < snb->value.id) return -1;
+  if (sna->value.id > snb->value.id) return 1;
+  return 0;
+}
+
+  /**
+   *  @fn int renumber_action(avl_node *n, void *ctx)
+   *
+   *  @brief callback function for text_order_walk(), used by strings_renumber()
+   *
+   *  @param n   - pointer to existing @a avl_node struct
+   *  @param ctx - pointer to @a renumber_ctx struct
+   *
+   *  @return 0
+   */
+
+static int renumber_action(avl_node *n, void *ctx)
+{
+  renumber_ctx *rc = (renumber_ctx *)ctx;
+  string_node *sn;
+
+  if (!n) goto exit;
+
+  sn = (string_node *)n;
+
+  sn->value.id = rc->new_id;
+
+  rc->id_index[rc->new_id] = sn;
+
+  ++rc->new_id;
+
+exit:
+  return 0;
+}
+
+  /**
+   *  @fn int duper_action(avl_node *n, void *ctx)
+   *
+   *  @brief callback function for strings_walk_with_context(), used by strings_dup()
+   *
+   *  @param n   - pointer to existing @a avl_node struct
+   *  @param ctx - pointer to @a strings struct being filled
+   *
+   *  @return 0 on success, non-zero to stop the walk on failure
+   */
+
+static int duper_action(avl_node *n, void *ctx)
+{
+  string_node *sn;
+
+  if (!n) return 0;
+
+  sn = (string_node *)n;
+
+  return strings_add_n((strings *)ctx, sn->value.text, sn->value.len) == string_failed;
+}
+
+  /**
+   *  @fn int avl_action_adapter(avl_node *n, void *ctx)
+   *
+   *  @brief callback function for strings_walk_with_context(), used by strings_walk()
+   *
+   *  @param n   - pointer to existing @a avl_node struct
+   *  @param ctx - pointer to the @a avl_action to call
+   *
+   *  @return 0
+   */
+
+static int avl_action_adapter(avl_node *n, void *ctx)
+{
+  (*(avl_action *)ctx)(n);
+
+  return 0;
+}
+
+
+  /**
+   *  @fn char *text_copy(const char *text, size_t len)
+   *
+   *  @brief creates a NUL terminated heap copy of the @p len bytes at @p text
+   *
+   *  @param text - pointer to text to copy
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return pointer to copy of @p text, NULL on failure
+   */
+
+static char *text_copy(const char *text, size_t len)
+{
+  char *t;
+
+  t = malloc(len + 1);
+  if (!t) return NULL;
+
+  memcpy(t, text, len);
+  t[len] = 0;
+
+  return t;
+}
+
+  /**
+   *  @fn string_node *text_index_find(strings *strs, const char *text, size_t len, uint64_t hash)
+   *
+   *  @brief searches hash index of @p strs for entry with text of @p text
+   *
+   *  Lengths are compared before any text bytes are touched.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text value to search for
+   *  @param len  - length of @p text in bytes
+   *  @param hash - hash of @p text
+   *
+   *  @return pointer to @a string_node if found, NULL if not
+   */
+
+static string_node *text_index_find(strings *strs,
+                                    const char *text,
+                                    size_t len,
+                                    uint64_t hash)
+{
+  string_slot *slot;
+  unsigned int mask;
+  unsigned int i;
+
+  if (!strs->text_index) return NULL;
+
+  mask = strs->text_index_size - 1;
+
+  for (i = hash & mask; ; i = (i + 1) & mask)
+  {
+    slot = &strs->text_index[i];
+    if (!slot->node) return NULL;
+    if (slot->hash == hash &&
+        slot->node->value.len == len &&
+        !memcmp(slot->node->value.text, text, len))
+      return slot->node;
+  }
+
+  return NULL;
+}
+
+  /**
+   *  @fn int text_index_insert(strings *strs, string_node *sn)
+   *
+   *  @brief adds @p sn to hash index of @p strs
+   *
+   *  Grows the index when it would become more than 3/4 full.  @p sn must
+   *  not already be in the index.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param sn   - pointer to @a string_node to add, with hash set
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int text_index_insert(strings *strs, string_node *sn)
+{
+  uint64_t hash = sn->value.hash;
+  string_slot *slot;
+  unsigned int mask;
+  unsigned int i;
+
+  if ((strs->text_index_used + 1) * 4 > strs->text_index_size * 3)
+    if (text_index_grow(strs)) return 1;
+
+  mask = strs->text_index_size - 1;
+
+  for (i = hash & mask; ; i = (i + 1) & mask)
+  {
+    slot = &strs->text_index[i];
+    if (!slot->node) break;
+  }
+
+  slot->hash = hash;
+  slot->node = sn;
+
+  ++strs->text_index_used;
+
+  return 0;
+}
+
+  /**
+   *  @fn void text_index_delete(strings *strs, string_node *sn)
+   *
+   *  @brief removes @p sn from hash index of @p strs
+   *
+   *  Uses backward shift deletion, so no tombstones are left behind and
+   *  probe sequences never grow from removals.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param sn   - pointer to @a string_node to remove
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void text_index_delete(strings *strs, string_node *sn)
+{
+  string_slot *slots;
+  unsigned int mask;
+  unsigned int i, j, k;
+
+  if (!strs->text_index) return;
+
+  slots = strs->text_index;
+  mask = strs->text_index_size - 1;
+
+  for (i = sn->value.hash & mask; slots[i].node != sn; i = (i + 1) & mask)
+    if (!slots[i].node) return;
+
+  for (j = i; ; )
+  {
+    j = (j + 1) & mask;
+    if (!slots[j].node) break;
+
+    k = slots[j].hash & mask;
+
+      /*
+       *  Leave slot j alone if its home k lies cyclically within (i, j]
+       */
+
+    if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+
+    slots[i] = slots[j];
+    i = j;
+  }
+
+  slots[i].node = NULL;
+  slots[i].hash = 0;
+
+  --strs->text_index_used;
+}
+
+  /**
+   *  @fn void text_index_replace(strings *strs, string_node *old, string_node *sn)
+   *
+   *  @brief replaces @p old with @p sn in hash index of @p strs
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param old  - pointer to @a string_node currently in index
+   *  @param sn   - pointer to @a string_node to take place of @p old, with
+   *                the same text and hash
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void text_index_replace(strings *strs, string_node *old, string_node *sn)
+{
+  unsigned int mask;
+  unsigned int i;
+
+  if (!strs->text_index || !old) return;
+
+  mask = strs->text_index_size - 1;
+
+  for (i = sn->value.hash & mask; strs->text_index[i].node; i = (i + 1) & mask)
+  {
+    if (strs->text_index[i].node == old)
+    {
+      strs->text_index[i].node = sn;
+      return;
+    }
+  }
+}
+
+  /**
+   *  @fn int text_index_grow(strings *strs)
+   *
+   *  @brief doubles the number of slots in hash index of @p strs
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int text_index_grow(strings *strs)
+{
+  string_slot *old;
+  string_slot *slots;
+  unsigned int old_size;
+  unsigned int size;
+  unsigned int mask;
+  unsigned int i, j;
+
+  old = strs->text_index;
+  old_size = strs->text_index_size;
+
+  size = old_size ? old_size * 2 : TEXT_INDEX_MIN_SIZE;
+  if (size < old_size) return 1;
+
+  slots = calloc(size, sizeof(string_slot));
+  if (!slots) return 1;
+
+  mask = size - 1;
+
+  for (i = 0; i < old_size; i++)
+  {
+    if (!old[i].node) continue;
+
+    for (j = old[i].hash & mask; slots[j].node; j = (j + 1) & mask)
+      ;
+
+    slots[j] = old[i];
+  }
+
+  free(old);
+
+  strs->text_index = slots;
+  strs->text_index_size = size;
+
+  return 0;
+}
+
+  /**
+   *  @fn void text_node_release(avl_node *n)
+   *
+   *  @brief free callback of text AVL tree
+   *
+   *  Does nothing, text tree nodes are entries owned by @a strings and are
+   *  released by strings_remove() and strings_free().
+   *
+   *  @param n - pointer to existing @a avl_node struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void text_node_release(avl_node *n)
+{
+  (void)n;
+}
+
+  /**
+   *  @fn void text_node_move(avl_node *dst, avl_node *src)
+   *
+   *  @brief copy_data callback of text AVL tree
+   *
+   *  Moves the payload of @p src to @p dst without copying the text.
+   *  strings_remove() repairs the hash index afterward.
+   *
+   *  @param dst - pointer to existing @a avl_node that is a @a string_node
+   *  @param src - pointer to existing @a avl_node that is a @a string_node
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void text_node_move(avl_node *dst, avl_node *src)
+{
+  string_node *d, *s;
+
+  if (!dst || !src) return;
+
+  d = (string_node *)dst;
+  s = (string_node *)src;
+
+  d->value = s->value;
+  memcpy(d->key, s->key, sizeof(d->key));
+
+  if (s->value.text == (char *)s->key) d->value.text = (char *)d->key;
+}
+
+  /**
+   *  @fn int text_node_compare(avl_node *a, avl_node *b)
+   *
+   *  @brief cmp callback of text AVL tree
+   *
+   *  Orders like string_node_compare_text(), but first compares the
+   *  inline keys of @p a and @p b, 8 bytes at a time, as big endian
+   *  integers.  Most comparisons during descent are decided there without
+   *  touching the out of line text.
+   *
+   *  @param a - pointer to existing @a avl_node that is a @a string_node
+   *  @param b - pointer to existing @a avl_node that is a @a string_node
+   *
+   *  @return <0, 0 or >0 as for string_node_compare_text()
+   */
+
+static int text_node_compare(avl_node *a, avl_node *b)
+{
+  string_node *sna, *snb;
+  uint64_t pa, pb;
+  size_t la, lb, skip;
+  int cmp;
+
+  sna = (string_node *)a;
+  snb = (string_node *)b;
+
+  pa = prefix_load(sna->key);
+  pb = prefix_load(snb->key);
+
+  if (pa != pb) return pa < pb ? -1 : 1;
+
+  pa = prefix_load(sna->key + 8);
+  pb = prefix_load(snb->key + 8);
+
+  if (pa != pb) return pa < pb ? -1 : 1;
+
+    /*
+     *  Equal zero padded keys mean the first min(16, la, lb) bytes match
+     */
+
+  la = sna->value.len;
+  lb = snb->value.len;
+
+  skip = la < lb ? la : lb;
+  if (skip > sizeof(sna->key)) skip = sizeof(sna->key);
+
+  cmp = memcmp(sna->value.text + skip,
+               snb->value.text + skip,
+               (la < lb ? la : lb) - skip);
+  if (!cmp) cmp = (la > lb) - (la < lb);
+
+  if (cmp < 0) return -1;
+  if (cmp > 0) return 1;
+  return 0;
+}
+
+  /**
+   *  @fn void text_node_set_prefix(string_node *sn, const char *text)
+   *
+   *  @brief fills inline key of @p sn from @p text
+   *
+   *  Copies the first bytes of @p text, zero padded.  When the text is
+   *  shorter than the key the result is the whole text, NUL terminated.
+   *
+   *  @param sn   - pointer to @a string_node with len set
+   *  @param text - pointer to text of @p sn
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void text_node_set_prefix(string_node *sn, const char *text)
+{
+  size_t n;
+
+  n = sn->value.len < sizeof(sn->key) ? sn->value.len : sizeof(sn->key);
+
+  memset(sn->key, 0, sizeof(sn->key));
+  memcpy(sn->key, text, n);
+}
+
+  /**
+   *  @fn uint64_t prefix_load(const unsigned char *p)
+   *
+   *  @brief loads the 8 bytes at @p p as a big endian integer
+   *
+   *  Integer order of the result is the memcmp() order of the bytes.
+   *
+   *  @param p - pointer to 8 bytes
+   *
+   *  @return big endian value of @p p
+   */
+
+static uint64_t prefix_load(const unsigned char *p)
+{
+  return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+         ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+         ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+         ((uint64_t)p[6] << 8)  |  (uint64_t)p[7];
+}
+
+  /**
+   *  @fn int id_index_set(strings *strs, unsigned int id, string_node *sn)
+   *
+   *  @brief stores @p sn in slot @p id of id index of @p strs
+   *
+   *  Grows the index, by doubling, until slot @p id exists.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param id   - id of @p sn
+   *  @param sn   - pointer to @a string_node to store
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int id_index_set(strings *strs, unsigned int id, string_node *sn)
+{
+  if (id_index_reserve(strs, id)) return 1;
+
+  if (!strs->id_index[id]) ++strs->id_index_used;
+
+  strs->id_index[id] = sn;
+
+  return 0;
+}
+
+  /**
+   *  @fn int id_index_reserve(strings *strs, unsigned int id)
+   *
+   *  @brief grows id index of @p strs, by doubling, until slot @p id exists
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param id   - id that must have a slot
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int id_index_reserve(strings *strs, unsigned int id)
+{
+  string_node **slots;
+  unsigned int size;
+
+  if (id < strs->id_index_size) return 0;
+
+  size = strs->id_index_size ? strs->id_index_size : ID_INDEX_MIN_SIZE;
+  while (size <= id)
+  {
+    if (size * 2 < size) return 1;
+    size *= 2;
+  }
+
+  slots = realloc(strs->id_index, size * sizeof(string_node *));
+  if (!slots) return 1;
+
+  memset(slots + strs->id_index_size,
+         0,
+         (size - strs->id_index_size) * sizeof(string_node *));
+
+  strs->id_index = slots;
+  strs->id_index_size = size;
+
+  return 0;
+}
+
+  /**
+   *  @fn char *text_arena_dup(strings *strs, const char *text, size_t len)
+   *
+   *  @brief copies the @p len bytes at @p text, plus a NUL, into text arena of @p strs
+   *
+   *  Text is bump allocated from the newest chunk.  A string too long for
+   *  a standard chunk gets a chunk of its own, linked behind the newest one
+   *  so the space left there is still used.  Copies never move.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text to copy
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return pointer to copy of @p text, NULL on failure
+   */
+
+static char *text_arena_dup(strings *strs, const char *text, size_t len)
+{
+  string_chunk *chunk;
+  size_t need;
+  size_t size;
+  char *t;
+
+  need = len + 1;
+
+  chunk = strs->text_arena;
+
+  if (!chunk || chunk->size - chunk->used < need)
+  {
+    size = need > TEXT_ARENA_CHUNK_SIZE ? need : TEXT_ARENA_CHUNK_SIZE;
+
+    chunk = malloc(sizeof(string_chunk) + size);
+    if (!chunk) return NULL;
+
+    chunk->size = size;
+    chunk->used = 0;
+
+    if (size > TEXT_ARENA_CHUNK_SIZE && strs->text_arena)
+    {
+      chunk->next = strs->text_arena->next;
+      strs->text_arena->next = chunk;
+    }
+    else
+    {
+      chunk->next = strs->text_arena;
+      strs->text_arena = chunk;
+    }
+  }
+
+  t = chunk->text + chunk->used;
+  chunk->used += need;
+
+  memcpy(t, text, len);
+  t[len] = 0;
+
+  return t;
+}
+
+  /**
+   *  @fn string_node *node_slab_alloc(strings *strs)
+   *
+   *  @brief allocates a zeroed entry from entry slab of @p strs
+   *
+   *  Reuses the most recently released entry if there is one, otherwise
+   *  carves the next entry out of the newest block, adding a block of
+   *  NODE_SLAB_SIZE entries when it is exhausted.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *
+   *  @return pointer to new @a string_node, NULL on failure
+   */
+
+static string_node *node_slab_alloc(strings *strs)
+{
+  string_slab *slab;
+  string_node *sn;
+
+  if ((sn = strs->node_free))
+    strs->node_free = (string_node *)sn->left;
+  else
+  {
+    slab = strs->node_slab;
+
+    if (!slab || slab->used == slab->size)
+    {
+      slab = malloc(sizeof(string_slab) + NODE_SLAB_SIZE * sizeof(string_node));
+      if (!slab) return NULL;
+
+      slab->size = NODE_SLAB_SIZE;
+      slab->used = 0;
+      slab->next = strs->node_slab;
+      strs->node_slab = slab;
+      strs->node_slab_capacity += NODE_SLAB_SIZE;
+    }
+
+    sn = &slab->nodes[slab->used++];
+  }
+
+  memset(sn, 0, sizeof(string_node));
+
+  ++strs->node_slab_used;
+
+  return sn;
+}
+
+  /**
+   *  @fn void node_slab_release(strings *strs, string_node *sn)
+   *
+   *  @brief returns @p sn to entry slab of @p strs
+   *
+   *  The entry is pushed on an intrusive free list threaded through its
+   *  left pointer.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param sn   - pointer to @a string_node from node_slab_alloc()
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void node_slab_release(strings *strs, string_node *sn)
+{
+  sn->left = (avl_node *)strs->node_free;
+  strs->node_free = sn;
+
+  --strs->node_slab_used;
+}
+
+  /**
+   *  @fn int text_order_insert(strings *strs, string_node *sn)
+   *
+   *  @brief adds @p sn to the ordered text index of @p strs
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param sn   - pointer to entry to add
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int text_order_insert(strings *strs, string_node *sn)
+{
+  switch (strs->order)
+  {
+    case string_order_btree: return string_btree_insert(strs->text_btree, sn);
+    case string_order_art: return string_art_insert(strs->text_art, sn);
+    case string_order_avl: return avl_insert(strs->text_root, (avl_node *)sn);
+  }
+
+  return 1;
+}
+
+  /**
+   *  @fn int text_order_walk(strings *strs, string_walk_action action, void *ctx)
+   *
+   *  @brief calls @p action for each entry of @p strs in text order
+   *
+   *  @param strs   - pointer to existing @a strings struct
+   *  @param action - pointer to function to call at each entry, returning
+   *                  non-zero to stop the walk
+   *  @param ctx    - pointer passed to @p action
+   *
+   *  @return 0 if every entry was visited, else the value that stopped it
+   */
+
+static int text_order_walk(strings *strs, string_walk_action action, void *ctx)
+{
+  if (strs->snapshot) return layered_walk(strs, action, ctx);
+  if (text_order_sync(strs)) return 0;
+
+  switch (strs->order)
+  {
+    case string_order_btree: return string_btree_walk(strs->text_btree, action, ctx);
+    case string_order_art: return string_art_walk(strs->text_art, action, ctx);
+    case string_order_avl: return text_tree_walk(strs, action, ctx);
+  }
+
+  return 0;
+}
+
+  /**
+   *  @fn int layered_walk(strings *strs, string_walk_action action, void *ctx)
+   *
+   *  @brief text_order_walk() for a mapped @p strs
+   *
+   *  Merges the text order of the snapshot with that of the overlay, which
+   *  is stepped through by seeking past each entry it hands out.
+   *
+   *  @param strs   - pointer to existing mapped @a strings struct
+   *  @param action - pointer to function to call at each entry
+   *  @param ctx    - pointer passed to @p action
+   *
+   *  @return 0 if every entry was visited, else the value that stopped it
+   */
+
+static int layered_walk(strings *strs, string_walk_action action, void *ctx)
+{
+  string_snapshot *ss = strs->snapshot;
+  string_node *sn, *base;
+  unsigned int i;
+  int r;
+
+  sn = overlay_seek(strs, NULL, 0, 1, 1);
+
+  for (i = 0; i < ss->header->count; i++)
+  {
+    base = string_snapshot_at(ss, i);
+    if (!base) continue;
+
+    for ( ; sn && text_compare(sn, base->value.text, base->value.len) < 0;
+          sn = overlay_seek(strs, sn->value.text, sn->value.len, 1, 0))
+      if ((r = action((avl_node *)sn, ctx))) return r;
+
+    if ((r = action((avl_node *)base, ctx))) return r;
+  }
+
+  for ( ; sn; sn = overlay_seek(strs, sn->value.text, sn->value.len, 1, 0))
+    if ((r = action((avl_node *)sn, ctx))) return r;
+
+  return 0;
+}
+
+  /**
+   *  @fn int text_tree_walk(strings *strs, string_walk_action action, void *ctx)
+   *
+   *  @brief text_order_walk() for the AVL tree
+   *
+   *  avl_walk() has no way to pass @p ctx or to stop early, so the tree is
+   *  walked in order here, with an explicit stack of the path.
+   *
+   *  @param strs   - pointer to existing @a strings struct
+   *  @param action - pointer to function to call at each entry
+   *  @param ctx    - pointer passed to @p action
+   *
+   *  @return 0 if every entry was visited, else the value that stopped it
+   */
+
+static int text_tree_walk(strings *strs, string_walk_action action, void *ctx)
+{
+  avl_node *stack[TEXT_TREE_MAX_HEIGHT];
+  avl_node *n;
+  unsigned int depth = 0;
+  int r;
+
+  n = strs->text_root->root;
+
+  while (n || depth)
+  {
+    for ( ; n; n = n->left) stack[depth++] = n;
+
+    n = stack[--depth];
+
+    if ((r = action(n, ctx))) return r;
+
+    n = n->right;
+  }
+
+  return 0;
+}
+
+  /**
+   *  @fn string_node *text_order_seek(strings *strs, const char *text, size_t len, int forward, int inclusive)
+   *
+   *  @brief finds the entry of @p strs nearest to @p text in text order
+   *
+   *  @param strs      - pointer to existing @a strings struct
+   *  @param text      - pointer to text, NULL for the first (or last) entry
+   *  @param len       - length of @p text in bytes
+   *  @param forward   - non-zero for the first entry after @p text, zero for
+   *                     the last entry before it
+   *  @param inclusive - non-zero if an entry equal to @p text qualifies
+   *
+   *  @return pointer to entry, NULL if there is none
+   */
+
+static string_node *text_order_seek(strings *strs,
+                                    const char *text,
+                                    size_t len,
+                                    int forward,
+                                    int inclusive)
+{
+  string_node *sn, *base;
+  int cmp;
+
+  sn = overlay_seek(strs, text, len, forward, inclusive);
+  if (!strs->snapshot) return sn;
+
+  base = string_snapshot_seek(strs->snapshot, text, len, forward, inclusive);
+  if (!sn || !base) return sn ? sn : base;
+
+  cmp = text_compare(sn, base->value.text, base->value.len);
+
+  return (forward ? cmp < 0 : cmp > 0) ? sn : base;
+}
+
+  /**
+   *  @fn string_node *overlay_seek(strings *strs, const char *text, size_t len, int forward, int inclusive)
+   *
+   *  @brief text_order_seek() in the ordered index of @p strs itself, the
+   *         overlay of a mapped table
+   *
+   *  @param strs      - pointer to existing @a strings struct
+   *  @param text      - pointer to text, NULL for the first (or last) entry
+   *  @param len       - length of @p text in bytes
+   *  @param forward   - non-zero for the first entry after @p text, zero for
+   *                     the last entry before it
+   *  @param inclusive - non-zero if an entry equal to @p text qualifies
+   *
+   *  @return pointer to entry, NULL if there is none
+   */
+
+static string_node *overlay_seek(strings *strs,
+                                 const char *text,
+                                 size_t len,
+                                 int forward,
+                                 int inclusive)
+{
+  if (text_order_sync(strs)) return NULL;
+
+  switch (strs->order)
+  {
+    case string_order_btree:
+      return string_btree_seek(strs->text_btree, text, len, forward, inclusive);
+    case string_order_art:
+      return string_art_seek(strs->text_art, text, len, forward, inclusive);
+    case string_order_avl:
+      return text_tree_seek(strs, text, len, forward, inclusive);
+  }
+
+  return NULL;
+}
+
+  /**
+   *  @fn string_node *text_tree_seek(strings *strs, const char *text, size_t len, int forward, int inclusive)
+   *
+   *  @brief text_order_seek() for the AVL tree
+   *
+   *  One descent from the root, remembering the last node passed on the
+   *  side being sought.
+   *
+   *  @param strs      - pointer to existing @a strings struct
+   *  @param text      - pointer to text, NULL for the first (or last) entry
+   *  @param len       - length of @p text in bytes
+   *  @param forward   - non-zero for the first entry after @p text
+   *  @param inclusive - non-zero if an entry equal to @p text qualifies
+   *
+   *  @return pointer to entry, NULL if there is none
+   */
+
+static string_node *text_tree_seek(strings *strs,
+                                   const char *text,
+                                   size_t len,
+                                   int forward,
+                                   int inclusive)
+{
+  string_node probe;
+  avl_node *n;
+  avl_node *best = NULL;
+  int cmp;
+
+  n = strs->text_root->root;
+
+  if (!text)
+  {
+    for ( ; n; n = forward ? n->left : n->right) best = n;
+    return (string_node *)best;
+  }
+
+  memset(&probe, 0, sizeof(probe));
+  probe.value.text = (char *)text;
+  probe.value.len = len;
+  text_node_set_prefix(&probe, text);
+
+  while (n)
+  {
+    cmp = text_node_compare(n, (avl_node *)&probe);
+    if (!cmp && inclusive) return (string_node *)n;
+
+    if (forward)
+    {
+      if (cmp > 0)
+      {
+        best = n;
+        n = n->left;
+      }
+      else n = n->right;
+    }
+    else
+    {
+      if (cmp < 0)
+      {
+        best = n;
+        n = n->right;
+      }
+      else n = n->left;
+    }
+  }
+
+  return (string_node *)best;
+}
+
+  /**
+   *  @fn int cursor_save(string_cursor *cursor, string_node *sn)
+   *
+   *  @brief records @p sn as the last entry returned through @p cursor
+   *
+   *  @param cursor - pointer to existing @a string_cursor struct
+   *  @param sn     - pointer to entry
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int cursor_save(string_cursor *cursor, string_node *sn)
+{
+  size_t size;
+  char *text;
+
+  if (sn->value.len > cursor->size || !cursor->text)
+  {
+    size = cursor->size ? cursor->size : 64;
+    while (size < sn->value.len) size *= 2;
+
+    text = realloc(cursor->text, size);
+    if (!text) return 1;
+
+    cursor->text = text;
+    cursor->size = size;
+  }
+
+  memcpy(cursor->text, sn->value.text, sn->value.len);
+  cursor->len = sn->value.len;
+  cursor->started = 1;
+
+  return 0;
+}
+
+  /**
+   *  @fn int text_compare(string_node *sn, const char *text, size_t len)
+   *
+   *  @brief compares the text of @p sn with @p text
+   *
+   *  @param sn   - pointer to existing entry
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return <0, 0 or >0 as @p sn sorts before, equal to or after @p text
+   */
+
+static int text_compare(string_node *sn, const char *text, size_t len)
+{
+  size_t m;
+  int cmp;
+
+  m = sn->value.len < len ? sn->value.len : len;
+
+  cmp = memcmp(sn->value.text, text, m);
+  if (cmp) return cmp;
+
+  return (sn->value.len > len) - (sn->value.len < len);
+}
+
+  /**
+   *  @fn string_node *entry_new(strings *strs, const char *text, size_t len, uint64_t hash)
+   *
+   *  @brief creates an entry for new text @p text with the next id
+   *
+   *  The entry is added to the id index and the hash index, but not to the
+   *  ordered text index.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text, not in @p strs
+   *  @param len  - length of @p text in bytes
+   *  @param hash - strings_hash() of @p text
+   *
+   *  @return pointer to new entry, NULL on failure
+   */
+
+static string_node *entry_new(strings *strs,
+                              const char *text,
+                              size_t len,
+                              uint64_t hash)
+{
+  string_node *n;
+
+  n = entry_alloc(strs, text, len, hash);
+  if (!n) return NULL;
+
+  n->value.ref_cnt = 1;
+  n->value.id = strs->last_id;
+
+    /*
+     *  The one entry is shared by the hash index, the ordered text index
+     *  and the id index
+     */
+
+  if (id_index_set(strs, n->value.id, n))
+  {
+    node_slab_release(strs, n);
+    return NULL;
+  }
+
+  if (text_index_insert(strs, n))
+  {
+    strs->id_index[n->value.id] = NULL;
+    --strs->id_index_used;
+    node_slab_release(strs, n);
+    return NULL;
+  }
+
+  ++strs->last_id;
+
+  return n;
+}
+
+  /**
+   *  @fn string_node *entry_alloc(strings *strs, const char *text, size_t len, uint64_t hash)
+   *
+   *  @brief allocates an entry holding a copy of @p text from the slab and arena of @p strs
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *  @param hash - strings_hash() of @p text
+   *
+   *  @return pointer to new entry with no id, NULL on failure
+   */
+
+static string_node *entry_alloc(strings *strs,
+                                const char *text,
+                                size_t len,
+                                uint64_t hash)
+{
+  string_node *n;
+
+  n = node_slab_alloc(strs);
+  if (!n) return NULL;
+
+  n->value.len = len;
+  n->value.hash = hash;
+
+  text_node_set_prefix(n, text);
+
+    /*
+     *  Short text lives entirely in the entry's key, longer text in the arena
+     */
+
+  if (len < STRING_NODE_INLINE_SIZE) n->value.text = (char *)n->key;
+  else
+  {
+    n->value.text = text_arena_dup(strs, text, len);
+    if (!n->value.text)
+    {
+      node_slab_release(strs, n);
+      return NULL;
+    }
+  }
+
+  return n;
+}
+
+  /**
+   *  @fn void entry_discard(strings *strs, string_node *sn)
+   *
+   *  @brief undoes entry_new() for @p sn
+   *
+   *  The id is given back if it was the last one handed out.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param sn   - pointer to entry, not in the ordered text index
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void entry_discard(strings *strs, string_node *sn)
+{
+  text_index_delete(strs, sn);
+
+  strs->id_index[sn->value.id] = NULL;
+  --strs->id_index_used;
+
+  if (sn->value.id + 1 == strs->last_id) --strs->last_id;
+
+  node_slab_release(strs, sn);
+}
+
+  /**
+   *  @fn unsigned int text_order_insert_sorted(strings *strs, string_node **sn, unsigned int n)
+   *
+   *  @brief adds @p n new entries, sorted as strings_add_batch() sorts them, to the ordered text index
+   *
+   *  The B+ tree takes the whole batch at once.  The AVL and radix trees
+   *  take the entries one at a time; in text order the AVL tree's descents
+   *  stay in cache, and the radix tree does no comparisons anyway.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param sn   - array of @p n pointers to entries, in text order for
+   *                 all but the radix tree
+   *  @param n    - number of entries
+   *
+   *  @return number of entries added, from the start of @p sn; less than
+   *          @p n on failure
+   */
+
+static unsigned int text_order_insert_sorted(strings *strs, string_node **sn, unsigned int n)
+{
+  unsigned int i;
+
+  if (strs->order == string_order_btree)
+    return string_btree_insert_sorted(strs->text_btree, sn, n) ? 0 : n;
+
+  for (i = 0; i < n; i++)
+    if (text_order_insert(strs, sn[i])) break;
+
+  return i;
+}
+
+  /**
+   *  @fn int batch_item_compare(const void *a, const void *b)
+   *
+   *  @brief qsort() callback ordering @a batch_item structs by text
+   *
+   *  @param a - pointer to @a batch_item struct
+   *  @param b - pointer to @a batch_item struct
+   *
+   *  @return <0, 0 or >0 as @p a sorts before, equal to or after @p b
+   */
+
+static int batch_item_compare(const void *a, const void *b)
+{
+  const batch_item *ia = (const batch_item *)a;
+  const batch_item *ib = (const batch_item *)b;
+  size_t m;
+  int cmp;
+
+  m = ia->len < ib->len ? ia->len : ib->len;
+
+  cmp = memcmp(ia->text, ib->text, m);
+  if (cmp) return cmp;
+
+  return (ia->len > ib->len) - (ia->len < ib->len);
+}
+
+
+  /**
+   *  @fn int batch_node_compare(const void *a, const void *b)
+   *
+   *  @brief qsort() callback ordering pointers to entries by text
+   *
+   *  @param a - pointer to pointer to @a string_node struct
+   *  @param b - pointer to pointer to @a string_node struct
+   *
+   *  @return <0, 0 or >0 as @p a sorts before, equal to or after @p b
+   */
+
+static int batch_node_compare(const void *a, const void *b)
+{
+  return text_node_compare(*(avl_node * const *)a, *(avl_node * const *)b);
+}
+
+  /**
+   *  @fn void batch_run(batch_worker *w, unsigned int threads, void *(*phase)(void *))
+   *
+   *  @brief runs @p phase for each of @p threads workers, one thread each, and waits for all
+   *
+   *  The calling thread runs worker 0.  A worker whose thread cannot be
+   *  started is run by the calling thread too.
+   *
+   *  @param w       - array of @p threads workers
+   *  @param threads - number of workers
+   *  @param phase   - thread function, passed a pointer to its worker
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void batch_run(batch_worker *w, unsigned int threads, void *(*phase)(void *))
+{
+  pthread_t tid[BATCH_THREAD_MAX];
+  int started[BATCH_THREAD_MAX];
+  unsigned int t;
+
+  for (t = 1; t < threads; t++)
+    started[t] = !pthread_create(&tid[t], NULL, phase, &w[t]);
+
+  phase(&w[0]);
+
+  for (t = 1; t < threads; t++)
+  {
+    if (started[t]) pthread_join(tid[t], NULL);
+    else phase(&w[t]);
+  }
+}
+
+  /**
+   *  @fn void *batch_hash_phase(void *arg)
+   *
+   *  @brief hashes the inputs of a range and looks them up in the table
+   *
+   *  Counts the inputs of the range falling in each partition.
+   *
+   *  @param arg - pointer to @a batch_worker struct
+   *
+   *  @return NULL
+   */
+
+static void *batch_hash_phase(void *arg)
+{
+  batch_worker *w = (batch_worker *)arg;
+  batch_job *job = w->job;
+  unsigned int *count;
+  const char *text;
+  size_t len;
+  unsigned int i;
+
+  count = job->offset + w->t * job->threads;
+
+  for (i = w->start; i < w->end; i++)
+  {
+    text = job->texts[i];
+    if (!text)
+    {
+      w->failed = 1;
+      return NULL;
+    }
+
+    len = batch_len(job, i);
+
+    job->hash[i] = strings_hash(text, len);
+    job->ent[i] = text_index_find(job->strs, text, len, job->hash[i]);
+
+    ++count[batch_partition(job, job->hash[i])];
+  }
+
+  return NULL;
+}
+
+  /**
+   *  @fn void *batch_scatter_phase(void *arg)
+   *
+   *  @brief copies the inputs of a range to their partitions
+   *
+   *  @param arg - pointer to @a batch_worker struct
+   *
+   *  @return NULL
+   */
+
+static void *batch_scatter_phase(void *arg)
+{
+  batch_worker *w = (batch_worker *)arg;
+  batch_job *job = w->job;
+  unsigned int *offset;
+  unsigned int i;
+
+  offset = job->offset + w->t * job->threads;
+
+  for (i = w->start; i < w->end; i++)
+    job->part[offset[batch_partition(job, job->hash[i])]++] = i;
+
+  return NULL;
+}
+
+  /**
+   *  @fn void *batch_dedupe_phase(void *arg)
+   *
+   *  @brief finds the first input with the text of each new input of a partition
+   *
+   *  A private hash table of the partition's new texts is used.
+   *
+   *  @param arg - pointer to @a batch_worker struct
+   *
+   *  @return NULL
+   */
+
+static void *batch_dedupe_phase(void *arg)
+{
+  batch_worker *w = (batch_worker *)arg;
+  batch_job *job = w->job;
+  unsigned int *table;
+  unsigned int *part;
+  unsigned int size, mask;
+  unsigned int i, j, k, c, m;
+  uint64_t hash;
+  size_t len;
+
+  part = job->part + job->part_start[w->t];
+  c = job->part_start[w->t + 1] - job->part_start[w->t];
+
+  for (size = 16; size < c * 2 && size * 2 > size; size *= 2)
+    ;
+  mask = size - 1;
+
+    /*
+     *  Slots hold input + 1, 0 is empty
+     */
+
+  table = calloc(size, sizeof(unsigned int));
+  if (!table)
+  {
+    w->failed = 1;
+    return NULL;
+  }
+
+  for (m = 0; m < c; m++)
+  {
+    i = part[m];
+
+    if (job->ent[i])
+    {
+      job->lead[i] = BATCH_HIT;
+      continue;
+    }
+
+    hash = job->hash[i];
+    len = batch_len(job, i);
+
+    for (k = hash & mask; ; k = (k + 1) & mask)
+    {
+      if (!table[k])
+      {
+        table[k] = i + 1;
+        job->lead[i] = i;
+        break;
+      }
+
+      j = table[k] - 1;
+      if (job->hash[j] == hash &&
+          batch_len(job, j) == len &&
+          !memcmp(job->texts[j], job->texts[i], len))
+      {
+        job->lead[i] = j;
+        break;
+      }
+    }
+  }
+
+  free(table);
+
+  return NULL;
+}
+
+  /**
+   *  @fn void *batch_count_phase(void *arg)
+   *
+   *  @brief counts the new entries of a range and the arena bytes they need
+   *
+   *  @param arg - pointer to @a batch_worker struct
+   *
+   *  @return NULL
+   */
+
+static void *batch_count_phase(void *arg)
+{
+  batch_worker *w = (batch_worker *)arg;
+  batch_job *job = w->job;
+  size_t len;
+  unsigned int i;
+
+  w->made = 0;
+  w->bytes = 0;
+
+  for (i = w->start; i < w->end; i++)
+  {
+    if (job->lead[i] != i) continue;
+
+    ++w->made;
+
+    len = batch_len(job, i);
+    if (len >= STRING_NODE_INLINE_SIZE) w->bytes += len + 1;
+  }
+
+  return NULL;
+}
+
+  /**
+   *  @fn void *batch_make_phase(void *arg)
+   *
+   *  @brief makes the new entries of a range and adds them to the id and hash indexes
+   *
+   *  Entries come from the range's own block and chunk and their id index
+   *  slots are the range's own, only the hash index is shared.  The
+   *  range's part of the sorted array is filled and, except for the radix
+   *  tree, sorted.
+   *
+   *  @param arg - pointer to @a batch_worker struct
+   *
+   *  @return NULL
+   */
+
+static void *batch_make_phase(void *arg)
+{
+  batch_worker *w = (batch_worker *)arg;
+  batch_job *job = w->job;
+  strings *strs = job->strs;
+  string_node **sorted;
+  string_node *sn;
+  char *text;
+  size_t len;
+  unsigned int i, k = 0, id;
+
+  sorted = job->sorted + w->first;
+
+  for (i = w->start; i < w->end; i++)
+  {
+    if (job->lead[i] != i) continue;
+
+    sn = &w->slab->nodes[k];
+    memset(sn, 0, sizeof(string_node));
+
+    len = batch_len(job, i);
+
+    sn->value.len = len;
+    sn->value.hash = job->hash[i];
+
+    text_node_set_prefix(sn, job->texts[i]);
+
+    if (len < STRING_NODE_INLINE_SIZE) sn->value.text = (char *)sn->key;
+    else
+    {
+      text = w->chunk->text + w->chunk->used;
+      w->chunk->used += len + 1;
+
+      memcpy(text, job->texts[i], len);
+      text[len] = 0;
+
+      sn->value.text = text;
+    }
+
+    id = job->base + w->first + k;
+
+    sn->value.ref_cnt = 1;
+    sn->value.id = id;
+
+    strs->id_index[id] = sn;
+    text_index_insert_shared(strs, sn);
+
+    job->ent[i] = sn;
+    job->origin[id - job->base] = i;
+    sorted[k++] = sn;
+  }
+
+  if (strs->order != string_order_art && k > 1)
+    qsort(sorted, k, sizeof(string_node *), batch_node_compare);
+
+  return NULL;
+}
+
+  /**
+   *  @fn void *batch_merge_phase(void *arg)
+   *
+   *  @brief merges two adjacent sorted runs of entries
+   *
+   *  @param arg - pointer to @a batch_worker struct
+   *
+   *  @return NULL
+   */
+
+static void *batch_merge_phase(void *arg)
+{
+  batch_worker *w = (batch_worker *)arg;
+  unsigned int a, b, d;
+
+  a = w->lo;
+  b = w->mid;
+  d = w->lo;
+
+  while (a < w->mid && b < w->hi)
+  {
+    if (text_node_compare((avl_node *)w->src[b], (avl_node *)w->src[a]) < 0)
+      w->dst[d++] = w->src[b++];
+    else
+      w->dst[d++] = w->src[a++];
+  }
+
+  while (a < w->mid) w->dst[d++] = w->src[a++];
+  while (b < w->hi) w->dst[d++] = w->src[b++];
+
+  return NULL;
+}
+
+  /**
+   *  @fn void *batch_finish_phase(void *arg)
+   *
+   *  @brief counts the references of the inputs of a partition and reports their ids
+   *
+   *  Every copy of a text is in the same partition, so no two threads
+   *  touch the same entry.
+   *
+   *  @param arg - pointer to @a batch_worker struct
+   *
+   *  @return NULL
+   */
+
+static void *batch_finish_phase(void *arg)
+{
+  batch_worker *w = (batch_worker *)arg;
+  batch_job *job = w->job;
+  unsigned int *part;
+  unsigned int i, l, m, c;
+
+  part = job->part + job->part_start[w->t];
+  c = job->part_start[w->t + 1] - job->part_start[w->t];
+
+  for (m = 0; m < c; m++)
+  {
+    i = part[m];
+    l = job->lead[i];
+
+    if (l == BATCH_HIT) ++job->ent[i]->value.ref_cnt;
+    else if (l != i)
+    {
+      job->ent[i] = job->ent[l];
+      ++job->ent[i]->value.ref_cnt;
+    }
+
+    if (job->ids_out) job->ids_out[i] = job->ent[i]->value.id;
+  }
+
+  return NULL;
+}
+
+  /**
+   *  @fn size_t batch_len(batch_job *job, unsigned int i)
+   *
+   *  @brief length of input @p i of @p job
+   *
+   *  @param job - pointer to @a batch_job struct
+   *  @param i   - input
+   *
+   *  @return length in bytes
+   */
+
+static size_t batch_len(batch_job *job, unsigned int i)
+{
+  return job->lens ? job->lens[i] : strlen(job->texts[i]);
+}
+
+  /**
+   *  @fn unsigned int batch_partition(batch_job *job, uint64_t hash)
+   *
+   *  @brief partition of a text with hash @p hash
+   *
+   *  The high half of the hash is used; hash tables index by the low bits.
+   *
+   *  @param job  - pointer to @a batch_job struct
+   *  @param hash - hash of text
+   *
+   *  @return partition
+   */
+
+static unsigned int batch_partition(batch_job *job, uint64_t hash)
+{
+  return (unsigned int)((hash >> 32) % job->threads);
+}
+
+  /**
+   *  @fn void text_index_insert_shared(strings *strs, string_node *sn)
+   *
+   *  @brief adds @p sn to hash index of @p strs while other threads do the same
+   *
+   *  Slots are claimed by compare and swap.  The index must already be big
+   *  enough and nothing may look it up meanwhile; the caller counts the
+   *  entries into text_index_used afterwards.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param sn   - pointer to @a string_node to add, with hash set
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void text_index_insert_shared(strings *strs, string_node *sn)
+{
+  string_slot *slot;
+  string_node *expected;
+  unsigned int mask;
+  unsigned int i;
+
+  mask = strs->text_index_size - 1;
+
+  for (i = sn->value.hash & mask; ; i = (i + 1) & mask)
+  {
+    slot = &strs->text_index[i];
+    expected = NULL;
+    if (__atomic_compare_exchange_n(&slot->node, &expected, sn, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      break;
+  }
+
+  slot->hash = sn->value.hash;
+}
+
+  /**
+   *  @fn int text_order_new(strings *strs)
+   *
+   *  @brief creates an empty ordered text index of type strs->order for @p strs
+   *
+   *  @param strs - pointer to existing @a strings struct without ordered
+   *                text index
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int text_order_new(strings *strs)
+{
+  switch (strs->order)
+  {
+    case string_order_btree:
+      strs->text_btree = string_btree_new();
+      return !strs->text_btree;
+
+    case string_order_art:
+      strs->text_art = string_art_new();
+      return !strs->text_art;
+
+    case string_order_avl:
+      strs->text_root = avl_new();
+      if (!strs->text_root) return 1;
+
+        /*
+         *  Text tree nodes are owned by @a strs and shared with the hash
+         *  index, so the tree must neither free them nor deep copy them.
+         */
+
+      avl_set_free(strs->text_root, text_node_release);
+      avl_set_cmp(strs->text_root, text_node_compare);
+      avl_set_new(strs->text_root, string_node_new);
+      avl_set_dup(strs->text_root, string_node_dup);
+      avl_set_copy_data(strs->text_root, text_node_move);
+      return 0;
+  }
+
+  return 1;
+}
+
+  /**
+   *  @fn void text_order_free(strings *strs)
+   *
+   *  @brief frees the ordered text index of @p strs, but not its entries
    *
-   *  Walks through each entry in @p strs, in either text or id order based on value of @p key.
-   *  @p action will be called at each entry.
+   *  @param strs - pointer to existing @a strings struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void text_order_free(strings *strs)
+{
+  if (strs->text_root) avl_free(strs->text_root);
+  if (strs->text_btree) string_btree_free(strs->text_btree);
+  if (strs->text_art) string_art_free(strs->text_art);
+
+  strs->text_root = NULL;
+  strs->text_btree = NULL;
+  strs->text_art = NULL;
+}
+
+  /**
+   *  @fn int text_order_sync(strings *strs)
+   *
+   *  @brief rebuilds the ordered text index of @p strs if it is out of date
+   *
+   *  Only concurrent, read-mostly and lock-free tables and the tables of
+   *  thread-local interners let it go out of date.  The entries are
+   *  gathered from the id index, sorted and added to a new index in one
+   *  pass.
    *
    *  @param strs - pointer to existing @a strings struct
-   *  @param key - @a string_key (enum value of id search order)
-   *  @param action - pointer to function to call at each entry found
+   *
+   *  @return 0 if the ordered text index is up to date, non-zero on failure
+   */
+
+static int text_order_sync(strings *strs)
+{
+  string_node **all;
+  string_node *sn;
+  unsigned int i, n = 0, end, size;
+  int r = 1;
+
+  if (!__atomic_load_n(&strs->order_stale, __ATOMIC_ACQUIRE)) return 0;
+
+  size = strs->id_index_used;
+
+  all = malloc(((size_t)size + 1) * sizeof(string_node *));
+  if (!all) return 1;
+
+  end = id_index_end(strs);
+
+  for (i = 0; i < end && n < size; i++)
+  {
+    sn = id_index_get(strs, i);
+    if (!sn) continue;
+
+    sn->left = NULL;
+    sn->right = NULL;
+    sn->height = 0;
+
+    all[n++] = sn;
+  }
+
+  if (strs->order != string_order_art)
+    qsort(all, n, sizeof(string_node *), batch_node_compare);
+
+  text_order_free(strs);
+
+  if (text_order_new(strs)) goto bail;
+  if (text_order_insert_sorted(strs, all, n) < n) goto bail;
+
+  strs->order_stale = 0;
+  r = 0;
+
+bail:
+  free(all);
+  return r;
+}
+
+  /**
+   *  @fn string_node *id_index_get(strings *strs, unsigned int id)
+   *
+   *  @brief returns entry with id @p id of @p strs
+   *
+   *  Takes no lock, also for a concurrent table.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param id   - id of entry
+   *
+   *  @return pointer to entry, NULL if there is none
+   */
+
+static string_node *id_index_get(strings *strs, unsigned int id)
+{
+  string_node **chunk;
+
+  if (strs->snapshot && id < strs->snapshot->header->id_end)
+    return string_snapshot_get(strs->snapshot, id);
+  if (!strs->id_dir) return id < strs->id_index_size ? strs->id_index[id] : NULL;
+
+  chunk = __atomic_load_n(&strs->id_dir[id >> ID_CHUNK_BITS], __ATOMIC_ACQUIRE);
+  if (!chunk) return NULL;
+
+  return __atomic_load_n(&chunk[id & (ID_CHUNK_SIZE - 1)], __ATOMIC_ACQUIRE);
+}
+
+  /**
+   *  @fn unsigned int id_index_end(strings *strs)
+   *
+   *  @brief returns an id above every id in use in @p strs
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *
+   *  @return id to stop a scan of the id index at
+   */
+
+static unsigned int id_index_end(strings *strs)
+{
+  if (strs->snapshot && strs->snapshot->header->id_end > strs->id_index_size)
+    return strs->snapshot->header->id_end;
+  if (!strs->id_dir) return strs->id_index_size;
+
+  return __atomic_load_n(&strs->last_id, __ATOMIC_ACQUIRE);
+}
+
+  /**
+   *  @fn int id_dir_set(strings *strs, unsigned int id, string_node *sn)
+   *
+   *  @brief stores @p sn in slot @p id of the id index of a concurrent or read-mostly @p strs
+   *
+   *  A missing chunk is added by compare and swap; a thread that loses the
+   *  race frees its own and uses the winner's.  The store publishes @p sn
+   *  to id_index_get() in other threads, so @p sn must be complete.
+   *
+   *  @param strs - pointer to existing concurrent or read-mostly @a strings
+   *                struct
+   *  @param id   - id of @p sn
+   *  @param sn   - pointer to entry, NULL to clear the slot
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int id_dir_set(strings *strs, unsigned int id, string_node *sn)
+{
+  string_node ***slot;
+  string_node **chunk;
+  string_node **expected = NULL;
+
+  slot = &strs->id_dir[id >> ID_CHUNK_BITS];
+
+  chunk = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  if (!chunk)
+  {
+    if (!sn) return 0;
+
+    chunk = calloc(ID_CHUNK_SIZE, sizeof(string_node *));
+    if (!chunk) return 1;
+
+    if (!__atomic_compare_exchange_n(slot, &expected, chunk, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      free(chunk);
+      chunk = expected;
+    }
+  }
+
+  __atomic_store_n(&chunk[id & (ID_CHUNK_SIZE - 1)], sn, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+  /**
+   *  @fn string_shard *shard_of(strings *strs, uint64_t hash)
+   *
+   *  @brief returns the shard of a concurrent @p strs holding texts with hash @p hash
+   *
+   *  The high half of the hash picks the shard; hash indexes use the low bits.
+   *
+   *  @param strs - pointer to existing concurrent @a strings struct
+   *  @param hash - hash of text
+   *
+   *  @return pointer to shard
+   */
+
+static string_shard *shard_of(strings *strs, uint64_t hash)
+{
+  return &strs->shards[(unsigned int)(hash >> 32) & (strs->shard_count - 1)];
+}
+
+  /**
+   *  @fn string_result shard_intern(strings *strs, const char *text, size_t len, uint64_t hash, unsigned int refs, unsigned int *id)
+   *
+   *  @brief strings_intern() for a concurrent @p strs
+   *
+   *  Only the lock of the text's shard is held.  The id comes from the
+   *  table's atomic counter.
+   *
+   *  @param strs - pointer to existing concurrent @a strings struct
+   *  @param text - pointer to text to intern
+   *  @param len  - length of @p text in bytes
+   *  @param hash - strings_hash() of @p text
+   *  @param refs - number of references to add to ref_cnt
+   *  @param id   - pointer to receive id of the entry, may be NULL
+   *
+   *  @return as strings_intern()
+   */
+
+static string_result shard_intern(strings *strs,
+                                  const char *text,
+                                  size_t len,
+                                  uint64_t hash,
+                                  unsigned int refs,
+                                  unsigned int *id)
+{
+  string_shard *shard;
+  string_node *n;
+  string_result r = string_failed;
+
+  shard = shard_of(strs, hash);
+
+  pthread_mutex_lock(&shard->lock);
+
+  n = text_index_find(shard->table, text, len, hash);
+  if (n)
+  {
+    n->value.ref_cnt += refs;
+    if (id) *id = n->value.id;
+    r = string_found;
+    goto exit;
+  }
+
+  n = entry_alloc(shard->table, text, len, hash);
+  if (!n) goto exit;
+
+  n->value.ref_cnt = refs;
+  n->value.id = __atomic_fetch_add(&strs->last_id, 1, __ATOMIC_RELAXED);
+
+  if (id_dir_set(strs, n->value.id, n))
+  {
+    node_slab_release(shard->table, n);
+    goto exit;
+  }
+
+    /*
+     *  Once published by id the entry may be in use by a reader, so on
+     *  failure it is left in the slab rather than released
+     */
+
+  if (text_index_insert(shard->table, n))
+  {
+    id_dir_set(strs, n->value.id, NULL);
+    goto exit;
+  }
+
+  __atomic_add_fetch(&strs->id_index_used, 1, __ATOMIC_RELAXED);
+
+  order_mark_stale(strs);
+
+  if (id) *id = n->value.id;
+
+  r = string_inserted;
+
+exit:
+  pthread_mutex_unlock(&shard->lock);
+  return r;
+}
+
+  /**
+   *  @fn string_result shard_remove(strings *strs, const char *text, size_t len)
+   *
+   *  @brief strings_remove_n() for a concurrent @p strs
+   *
+   *  The entry leaves the indexes but stays in the shard's slab, as other
+   *  threads may still be reading it.
+   *
+   *  @param strs - pointer to existing concurrent @a strings struct
+   *  @param text - pointer to text value of @a string to remove
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return @a string_result indicating success or failure
+   */
+
+static string_result shard_remove(strings *strs, const char *text, size_t len)
+{
+  string_shard *shard;
+  string_node *found;
+  uint64_t hash;
+
+  hash = strings_hash(text, len);
+  shard = shard_of(strs, hash);
+
+  pthread_mutex_lock(&shard->lock);
+
+  found = text_index_find(shard->table, text, len, hash);
+  if (found)
+  {
+    text_index_delete(shard->table, found);
+    id_dir_set(strs, found->value.id, NULL);
+
+    __atomic_sub_fetch(&strs->id_index_used, 1, __ATOMIC_RELAXED);
+
+    order_mark_stale(strs);
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return found ? string_found : string_failed;
+}
+
+  /**
+   *  @fn void order_mark_stale(strings *strs)
+   *
+   *  @brief notes that the ordered text index of a concurrent or read-mostly @p strs is out of date
+   *
+   *  A read-mostly table has one writer at a time, so its ordered index is
+   *  freed at once; it would otherwise keep pointers to entries that may
+   *  be reused.
+   *
+   *  @param strs - pointer to existing concurrent or read-mostly @a strings
+   *                struct
+   *
+   *  @par Returns
+   *  Nothing.
+   */
+
+static void order_mark_stale(strings *strs)
+{
+  if (__atomic_load_n(&strs->order_stale, __ATOMIC_RELAXED)) return;
+
+  if (strs->epoch) text_order_free(strs);
+
+  __atomic_store_n(&strs->order_stale, 1, __ATOMIC_RELAXED);
+}
+
+  /**
+   *  @fn string_result epoch_intern(strings *strs, const char *text, size_t len, uint64_t hash, unsigned int refs, unsigned int *id)
+   *
+   *  @brief strings_intern() for a read-mostly @p strs
+   *
+   *  @param strs - pointer to existing read-mostly @a strings struct
+   *  @param text - pointer to text to intern
+   *  @param len  - length of @p text in bytes
+   *  @param hash - strings_hash() of @p text
+   *  @param refs - number of references to add to ref_cnt
+   *  @param id   - pointer to receive id of the entry, may be NULL
+   *
+   *  @return as strings_intern()
+   */
+
+static string_result epoch_intern(strings *strs,
+                                  const char *text,
+                                  size_t len,
+                                  uint64_t hash,
+                                  unsigned int refs,
+                                  unsigned int *id)
+{
+  string_epoch *e = strs->epoch;
+  string_node *n;
+  string_result r = string_failed;
+
+  pthread_mutex_lock(&e->write_lock);
+
+  n = epoch_index_find(strs, text, len, hash);
+  if (n)
+  {
+    n->value.ref_cnt += refs;
+    if (id) *id = n->value.id;
+    r = string_found;
+    goto exit;
+  }
+
+  n = entry_alloc(strs, text, len, hash);
+  if (!n) goto exit;
+
+  n->value.ref_cnt = refs;
+  n->value.id = strs->last_id;
+
+  if (id_dir_set(strs, n->value.id, n))
+  {
+    node_slab_release(strs, n);
+    goto exit;
+  }
+
+  if (epoch_index_insert(strs, n))
+  {
+    id_dir_set(strs, n->value.id, NULL);
+    epoch_retire(strs, n, 1);
+    goto exit;
+  }
+
+  ++strs->last_id;
+  ++strs->id_index_used;
+
+  order_mark_stale(strs);
+
+  if (id) *id = n->value.id;
+
+  r = string_inserted;
+
+exit:
+  pthread_mutex_unlock(&e->write_lock);
+  return r;
+}
+
+  /**
+   *  @fn string_result epoch_remove(strings *strs, const char *text, size_t len)
+   *
+   *  @brief strings_remove_n() for a read-mostly @p strs
+   *
+   *  The entry is unlinked at once and reclaimed once no reader can still
+   *  hold it.
+   *
+   *  @param strs - pointer to existing read-mostly @a strings struct
+   *  @param text - pointer to text value of @a string to remove
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return @a string_result indicating success or failure
+   */
+
+static string_result epoch_remove(strings *strs, const char *text, size_t len)
+{
+  string_epoch *e = strs->epoch;
+  string_node *found;
+
+  pthread_mutex_lock(&e->write_lock);
+
+  found = epoch_index_find(strs, text, len, strings_hash(text, len));
+  if (found)
+  {
+    epoch_index_delete(strs, found);
+    id_dir_set(strs, found->value.id, NULL);
+    --strs->id_index_used;
+
+    order_mark_stale(strs);
+
+    epoch_retire(strs, found, 1);
+    epoch_reclaim(strs);
+  }
+
+  pthread_mutex_unlock(&e->write_lock);
+
+  return found ? string_found : string_failed;
+}
+
+  /**
+   *  @fn string_node *epoch_index_find(strings *strs, const char *text, size_t len, uint64_t hash)
+   *
+   *  @brief text_index_find() for a read-mostly @p strs, safe against a concurrent writer
+   *
+   *  Slots are read with acquire loads, so an entry is seen only once it is
+   *  complete, and removed entries' tombstones are stepped over.  The probe
+   *  is retried if the writer replaced the slot array meanwhile.
+   *
+   *  @param strs - pointer to existing read-mostly @a strings struct
+   *  @param text - pointer to text to look for
+   *  @param len  - length of @p text in bytes
+   *  @param hash - hash of @p text
+   *
+   *  @return pointer to @a string_node if found, NULL if not
+   */
+
+static string_node *epoch_index_find(strings *strs,
+                                     const char *text,
+                                     size_t len,
+                                     uint64_t hash)
+{
+  string_epoch *e = strs->epoch;
+  string_slot *slots;
+  string_node *sn;
+  string_node *found;
+  unsigned int seq, size, mask, i, n;
+
+  do
+  {
+    while ((seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE)) & 1)
+      ;
+
+    slots = __atomic_load_n(&strs->text_index, __ATOMIC_ACQUIRE);
+    size = __atomic_load_n(&strs->text_index_size, __ATOMIC_ACQUIRE);
+
+    found = NULL;
+
+    if (slots)
+    {
+      mask = size - 1;
+
+      for (i = hash & mask, n = 0; n < size; i = (i + 1) & mask, n++)
+      {
+        sn = __atomic_load_n(&slots[i].node, __ATOMIC_ACQUIRE);
+        if (!sn) break;
+        if (sn == TEXT_TOMBSTONE) continue;
+
+        if (__atomic_load_n(&slots[i].hash, __ATOMIC_RELAXED) == hash &&
+            sn->value.len == len &&
+            !memcmp(sn->value.text, text, len))
+        {
+          found = sn;
+          break;
+        }
+      }
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq);
+
+  return found;
+}
+
+  /**
+   *  @fn int epoch_index_insert(strings *strs, string_node *sn)
+   *
+   *  @brief text_index_insert() for a read-mostly @p strs
+   *
+   *  A tombstone on the probe path is reused.  The slot's hash is stored
+   *  before the entry, which is published with a release store.
+   *
+   *  @param strs - pointer to existing read-mostly @a strings struct
+   *  @param sn   - pointer to @a string_node to add, with hash set
+   *
+   *  @return 0 on success, non-zero on failure
+   */
+
+static int epoch_index_insert(strings *strs, string_node *sn)
+{
+  uint64_t hash = sn->value.hash;
+  string_slot *slot;
+  unsigned int mask;
+  unsigned int i;
+
+    /*
+     *  text_index_used counts tombstones too, they lengthen probes as much
+     *  as entries do
+     */
+
+  if ((strs->text_index_used + 1) * 4 > strs->text_index_size * 3)
+    if (epoch_index_grow(strs)) return 1;
+
+  mask = strs->text_index_size - 1;
+
+  for (i = hash & mask; ; i = (i + 1) & mask)
+  {
+    slot = &strs->text_index[i];
+    if (!slot->node || slot->node == TEXT_TOMBSTONE) break;
+  }
+
+  if (!slot->node) ++strs->text_index_used;
+
+  __atomic_store_n(&slot->hash, hash, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->node, sn, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+  /**
+   *  @fn void epoch_index_delete(strings *strs, string_node *sn)
+   *
+   *  @brief text_index_delete() for a read-mostly @p strs
+   *
+   *  Leaves a tombstone, as moving entries back would hide them from a
+   *  reader probing at the same time.
+   *
+   *  @param strs - pointer to existing read-mostly @a strings struct
+   *  @param sn   - pointer to @a string_node to remove
    *
    *  @par Returns
    *  Nothing.
    */
 
-void strings_walk(strings *strs, string_key key, avl_action action)
+static void epoch_index_delete(strings *strs, string_node *sn)
 {
-  avl *tree = NULL;
+  unsigned int mask;
+  unsigned int i;
 
-  if (!strs || !action) return;
+  if (!strs->text_index) return;
 
-  switch (key)
+  mask = strs->text_index_size - 1;
+
+  for (i = sn->value.hash & mask; strs->text_index[i].node; i = (i + 1) & mask)
   {
-    case string_id: tree = strs->id_root; break;
-    case string_text: tree = strs->text_root; break;
+    if (strs->text_index[i].node == sn)
+    {
+      __atomic_store_n(&strs->text_index[i].node, TEXT_TOMBSTONE, __ATOMIC_RELEASE);
+      return;
+    }
   }
-
-  avl_walk(tree, avl_forward_order, action);
 }
 
   /**
-   *  @fn char *strings_result_to_str(string_result sr)
+   *  @fn int epoch_index_grow(strings *strs)
    *
-   *  @brief returns string representation of @p sr
+   *  @brief text_index_grow() for a read-mostly @p strs
    *
-   *  @param sr - @a string_result to convert to string
+   *  Copies the entries, without tombstones, to a new slot array at most
+   *  half full, which may be no bigger than the old one.  The switch is
+   *  bracketed by the sequence count readers check, and the old array is
+   *  retired rather than freed.
    *
-   *  @return string representation of @p sr
+   *  @param strs - pointer to existing read-mostly @a strings struct
+   *
+   *  @return 0 on success, non-zero on failure
    */
 
-char *strings_result_to_str(string_result sr)
+static int epoch_index_grow(strings *strs)
 {
-  switch (sr)
+  string_epoch *e = strs->epoch;
+  string_slot *old;
+  string_slot *slots;
+  string_node *sn;
+  unsigned int old_size;
+  unsigned int size;
+  unsigned int live = 0;
+  unsigned int mask;
+  unsigned int i, j;
+
+  old = strs->text_index;
+  old_size = strs->text_index_size;
+
+  for (i = 0; i < old_size; i++)
+    if (old[i].node && old[i].node != TEXT_TOMBSTONE) ++live;
+
+  for (size = TEXT_INDEX_MIN_SIZE; size < (live + 1) * 2; size *= 2)
+    if (size * 2 < size) return 1;
+
+  slots = calloc(size, sizeof(string_slot));
+  if (!slots) return 1;
+
+  mask = size - 1;
+
+  for (i = 0; i < old_size; i++)
   {
-    case string_found: return "FOUND";
-    case string_not_found: return "NOT FOUND";
-    case string_failed:
-    default:
-      return "FAILED";
+    sn = old[i].node;
+    if (!sn || sn == TEXT_TOMBSTONE) continue;
+
+    for (j = old[i].hash & mask; slots[j].node; j = (j + 1) & mask)
+      ;
+
+    slots[j] = old[i];
   }
 
-  return "FAILED";
+  if (old && epoch_retire(strs, old, 0))
+  {
+    free(slots);
+    return 1;
+  }
+
+  __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  __atomic_store_n(&strs->text_index, slots, __ATOMIC_RELEASE);
+  __atomic_store_n(&strs->text_index_size, size, __ATOMIC_RELEASE);
+
+  __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+
+  strs->text_index_used = live;
+
+  epoch_reclaim(strs);
+
+  return 0;
 }
 
   /**
-   *  @fn string_result strings_str_to_result(char *s)
+   *  @fn int epoch_retire(strings *strs, void *ptr, int node)
    *
-   *  @brief returns @a string_result from string representation
+   *  @brief queues @p ptr, just unlinked from read-mostly @p strs, for reclamation
    *
-   *  @param s - string representation of @a string_result
+   *  If no record can be allocated the memory is simply never reused.
    *
-   *  @return @a string_result
+   *  @param strs - pointer to existing read-mostly @a strings struct
+   *  @param ptr  - pointer to entry or old hash index slot array
+   *  @param node - non-zero if @p ptr is an entry
+   *
+   *  @return 0 on success, non-zero on failure
    */
 
-string_result strings_str_to_result(char *s)
+static int epoch_retire(strings *strs, void *ptr, int node)
 {
-  if (!s) return string_failed;
+  string_epoch *e = strs->epoch;
+  string_retired *retired;
 
-  if (!strcmp(s, "FOUND")) return string_found;
-  if (!strcmp(s, "NOT FOUND")) return string_not_found;
+  retired = malloc(sizeof(string_retired));
+  if (!retired) return 1;
 
-  return string_failed;
-}
+  retired->ptr = ptr;
+  retired->node = node;
+  retired->epoch = e->epoch;
+  retired->next = e->retired;
+
+  e->retired = retired;
 
-static unsigned int _new_id = 0;  /**<  used by strings_renumber()  */
-static avl *_id_root = NULL;     /**<  used by strings_renumber()  */
+  return 0;
+}
 
   /**
-   *  @fn void strings_renumber(strings *strs)
+   *  @fn void epoch_reclaim(strings *strs)
    *
-   *  @brief renumbers all entries in @p strs
+   *  @brief advances the epoch of read-mostly @p strs if it can, and reclaims what readers have moved past
    *
-   *  Walks entire AVL tree of entires in @p str, changing the id of each entry.
-   *  Rebuilds id_root (AVL index of ids)
+   *  The epoch advances once every reader inside a read has seen the
+   *  current one.  Anything retired in epoch e is then unreachable for all
+   *  readers once the epoch reaches e + 2: each reader still reading has
+   *  begun after the epoch passed e + 1, after the item was unlinked.
+   *  Entries go back to the slab, slot arrays are freed.
    *
-   *  @param strs - pointer to existing @a strings struct
+   *  @param strs - pointer to existing read-mostly @a strings struct, with
+   *                the write lock held
    *
    *  @par Returns
    *  Nothing.
    */
 
-void strings_renumber(strings *strs)
+static void epoch_reclaim(strings *strs)
 {
-  if (!strs) return;
+  string_epoch *e = strs->epoch;
+  string_retired **pr;
+  string_retired *retired;
+  string_reader *reader;
+  unsigned long epoch, state;
+
+  epoch = e->epoch;
+
+  pthread_mutex_lock(&e->reader_lock);
+  for (reader = e->readers; reader; reader = reader->next)
+  {
+    state = __atomic_load_n(&reader->state, __ATOMIC_SEQ_CST);
+    if ((state & 1) && (state >> 1) != epoch) break;
+  }
+  pthread_mutex_unlock(&e->reader_lock);
 
-  avl_free(strs->id_root);
-  strs->id_root = NULL;
+  if (!reader) __atomic_store_n(&e->epoch, ++epoch, __ATOMIC_SEQ_CST);
 
-  _new_id = 0;
-  _id_root = avl_new();
-  avl_set_free(_id_root, string_node_free);
-  avl_set_cmp(_id_root, string_node_compare_id);
-  avl_set_new(_id_root, string_node_new);
-  avl_set_dup(_id_root, string_node_dup);
-  avl_set_copy_data(_id_root, string_node_copy_data);
+  for (pr = &e->retired; (retired = *pr); )
+  {
+    if (retired->epoch + 2 > epoch)
+    {
+      pr = &retired->next;
+      continue;
+    }
 
-  avl_free(strs->id_root);
-  strs->id_root = NULL;
+    *pr = retired->next;
 
-  avl_walk(strs->text_root, avl_forward_order, renumber_action);
+    if (retired->node) node_slab_release(strs, (string_node *)retired->ptr);
+    else free(retired->ptr);
 
-  strs->id_root = _id_root;
-  strs->last_id = _new_id;
+    free(retired);
+  }
 }
 
   /**
-   *  @fn avl_node *string_node_new()
+   *  @fn string_result lockfree_intern(strings *strs, const char *text, size_t len, uint64_t hash, unsigned int refs, unsigned int *id)
    *
-   *  @brief create a new @a string_node struct
+   *  @brief strings_intern() for a lock-free @p strs
    *
-   *  @par Parameters
-   *  None.
+   *  The new entry is linked in just behind the last link of the list
+   *  whose key is not above its own.  If that compare-and-swap fails the
+   *  search goes on from the same link, which never moves, so a thread
+   *  that lost the race to another adding the same text finds its entry.
+   *  Only the winner's entry goes into the id index, after it is linked,
+   *  and a loser hands its id back unless a later one was taken.
    *
-   *  @return pointer to new @a avl_node struct
+   *  @param strs - pointer to existing lock-free @a strings struct
+   *  @param text - pointer to text to intern
+   *  @param len  - length of @p text in bytes
+   *  @param hash - strings_hash() of @p text
+   *  @param refs - number of references to add to ref_cnt
+   *  @param id   - pointer to receive id of the entry, may be NULL
+   *
+   *  @return as strings_intern()
    */
 
-avl_node *string_node_new(void)
+static string_result lockfree_intern(strings *strs,
+                                     const char *text,
+                                     size_t len,
+                                     uint64_t hash,
+                                     unsigned int refs,
+                                     unsigned int *id)
 {
-  string_node *sn;
+  string_lockfree *lf = strs->lockfree;
+  string_link *link = NULL;
+  string_link *found;
+  string_link *prev;
+  string_link *next;
+  string_node *entry = NULL;
+  string_node *n;
+  unsigned int size;
+  unsigned int count;
+  unsigned int last;
+
+  size = __atomic_load_n(&lf->size, __ATOMIC_ACQUIRE);
+
+  prev = lockfree_bucket(strs, (unsigned int)hash & (size - 1));
+  if (!prev) return string_failed;
+
+  for (;;)
+  {
+    found = lockfree_search(&prev, &next, text, len, hash);
+    if (found)
+    {
+        /*
+         *  Removed meanwhile, search again past it
+         */
+
+      n = __atomic_load_n(&found->node, __ATOMIC_ACQUIRE);
+      if (!n) continue;
+
+      if (entry)
+      {
+        last = entry->value.id + 1;
+        __atomic_compare_exchange_n(&strs->last_id, &last, entry->value.id, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&strs->node_slab_used, 1, __ATOMIC_RELAXED);
+      }
+
+      __atomic_add_fetch(&n->value.ref_cnt, refs, __ATOMIC_RELAXED);
+      if (id) *id = n->value.id;
+      return string_found;
+    }
+
+    if (!link)
+    {
+      link = lockfree_entry(strs, text, len, hash, refs);
+      if (!link) return string_failed;
+
+        /*
+         *  Once linked the entry may be removed again at any time, so it
+         *  is not reached through the link afterwards
+         */
+
+      entry = link->node;
+    }
+
+    link->next = next;
+
+    if (__atomic_compare_exchange_n(&prev->next, &next, link, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      break;
+  }
 
-  sn = malloc(sizeof(string_node));
-  if (sn) memset(sn, 0, sizeof(string_node));
+    /*
+     *  An entry the id index cannot take is cut from its link again, as
+     *  lockfree_remove() does, unless a remove beat us to it and already
+     *  took it off the counts
+     */
 
-  return (avl_node *)sn;
+  if (id_dir_set(strs, entry->value.id, entry))
+  {
+    n = entry;
+    if (__atomic_compare_exchange_n(&link->node, &n, NULL, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      __atomic_sub_fetch(&strs->node_slab_used, 1, __ATOMIC_RELAXED);
+    else __atomic_add_fetch(&strs->id_index_used, 1, __ATOMIC_RELAXED);
+    return string_failed;
+  }
+
+  __atomic_add_fetch(&strs->id_index_used, 1, __ATOMIC_RELAXED);
+
+  order_mark_stale(strs);
+
+  count = __atomic_add_fetch(&lf->count, 1, __ATOMIC_RELAXED);
+
+  if (count / LF_LOAD > size && size < LF_DIR_SIZE * LF_SEGMENT_SIZE)
+    __atomic_compare_exchange_n(&lf->size, &size, size * 2, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+
+  if (id) *id = entry->value.id;
+
+  return string_inserted;
 }
 
   /**
-   *  @fn avl_node *string_node_new_with_values(char *text, unsigned int id)
+   *  @fn string_result lockfree_remove(strings *strs, const char *text, size_t len)
    *
-   *  @brief create a new @a string_node struct
+   *  @brief strings_remove_n() for a lock-free @p strs
    *
-   *  @param text - string containing text value of node
-   *  @param id   - unique indentifier of node
+   *  The entry is cut from its link with a compare-and-swap, so of threads
+   *  removing the same text only one succeeds.  Link and entry stay
+   *  allocated, as other threads may still be reading them.
    *
-   *  @return pointer to new @a avl_node struct
+   *  @param strs - pointer to existing lock-free @a strings struct
+   *  @param text - pointer to text value of @a string to remove
+   *  @param len  - length of @p text in bytes
+   *
+   *  @return @a string_result indicating success or failure
    */
 
-avl_node *string_node_new_with_values(char *text, unsigned int id)
+static string_result lockfree_remove(strings *strs, const char *text, size_t len)
 {
-  string_node *sn;
+  string_link *link;
+  string_node *n;
+  uint64_t hash;
 
-  sn = (string_node *)string_node_new();
-  if (!sn) return NULL;
+  hash = strings_hash(text, len);
 
-  if (text) sn->value.text = strdup(text);
-  sn->value.id = id;
+  for (;;)
+  {
+    link = lockfree_find(strs, text, len, hash);
+    if (!link) return string_failed;
 
-  return (avl_node *)sn;
+    n = __atomic_load_n(&link->node, __ATOMIC_ACQUIRE);
+    if (n && __atomic_compare_exchange_n(&link->node, &n, NULL, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      break;
+  }
+
+  id_dir_set(strs, n->value.id, NULL);
+
+  __atomic_sub_fetch(&strs->id_index_used, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&strs->node_slab_used, 1, __ATOMIC_RELAXED);
+
+  order_mark_stale(strs);
+
+  return string_found;
 }
 
   /**
-   *  @fn void string_node_dup(avl_node *n)
+   *  @fn string_link *lockfree_find(strings *strs, const char *text, size_t len, uint64_t hash)
    *
-   *  @brief creates a deep copy of @p n
+   *  @brief looks for the @p len bytes at @p text in the hash index of a lock-free @p strs
    *
-   *  @param n - pointer to existing @a avl_node that is a @a string_node
+   *  @param strs - pointer to existing lock-free @a strings struct
+   *  @param text - pointer to text to look for
+   *  @param len  - length of @p text in bytes
+   *  @param hash - strings_hash() of @p text
    *
-   *  @return pointer to new @a avl_node struct
+   *  @return pointer to link of entry if found, NULL if not
    */
 
-avl_node *string_node_dup(avl_node *n)
+static string_link *lockfree_find(strings *strs,
+                                  const char *text,
+                                  size_t len,
+                                  uint64_t hash)
 {
-  avl_node *nsn;
-  string_node *sn;
+  string_link *prev;
+  string_link *next;
+  unsigned int size;
 
-  if (!n) return NULL;
-
-  sn = (string_node *)n;
+  size = __atomic_load_n(&strs->lockfree->size, __ATOMIC_ACQUIRE);
 
-  nsn = string_node_new_with_values(sn->value.text, sn->value.id);
+  prev = lockfree_bucket(strs, (unsigned int)hash & (size - 1));
+  if (!prev) return NULL;
 
-  return nsn;
+  return lockfree_search(&prev, &next, text, len, hash);
 }
 
   /**
-   *  @fn void string_node_copy_data(avl_node *dst, avl_node *src)
+   *  @fn string_link *lockfree_search(string_link **prev, string_link **next, const char *text, size_t len, uint64_t hash)
    *
-   *  @brief copies payload data contained in @p src to @p dst
+   *  @brief walks the split-ordered list from @p prev to the place of the @p len bytes at @p text
    *
-   *  @param dst - pointer to existing @a avl_node that is a @a string_node
-   *  @param src - pointer to existing @a avl_node that is a @a string_node
+   *  Entries whose key ties with the text's are checked on the way; links
+   *  of removed entries are passed over.
    *
-   *  @par Returns
-   *       Nothing.
+   *  @param prev - pointer to link to start after, receives the last link
+   *                whose key is not above the text's
+   *  @param next - pointer to receive the link after @p prev
+   *  @param text - pointer to text to look for
+   *  @param len  - length of @p text in bytes
+   *  @param hash - strings_hash() of @p text
+   *
+   *  @return pointer to link of entry if found, NULL if not
    */
 
-void string_node_copy_data(avl_node *dst, avl_node *src)
+static string_link *lockfree_search(string_link **prev,
+                                    string_link **next,
+                                    const char *text,
+                                    size_t len,
+                                    uint64_t hash)
 {
-  string *sd, *ss;
+  string_link *link;
+  string_node *n;
+  uint64_t key;
 
-  if (!dst || !src) return;
+  key = bit_reverse(hash) | 1;
 
-  sd = &((string_node *)dst)->value;
-  ss = &((string_node *)src)->value;
+  for (link = __atomic_load_n(&(*prev)->next, __ATOMIC_ACQUIRE);
+       link && link->key <= key;
+       link = __atomic_load_n(&link->next, __ATOMIC_ACQUIRE))
+  {
+    if (link->key == key && link->hash == hash)
+    {
+      n = __atomic_load_n(&link->node, __ATOMIC_ACQUIRE);
+      if (n && n->value.len == len && !memcmp(n->value.text, text, len)) return link;
+    }
 
-  string_copy(sd, ss);
+    *prev = link;
+  }
+
+  *next = link;
+
+  return NULL;
 }
 
   /**
-   *  @fn void string_node_free(avl_node *n)
+   *  @fn string_link *lockfree_bucket(strings *strs, unsigned int b)
    *
-   *  @brief frees all memory allocated to @p n that is a @a string_node
+   *  @brief returns the dummy link starting bucket @p b of a lock-free @p strs, adding it if need be
    *
-   *  @param n - pointer to existing @a avl_node that is a @a string_node
+   *  A new bucket is split off its parent, @p b without its top bit: its
+   *  dummy link goes into the parent's part of the list, where the
+   *  bucket's entries already are.  Threads adding the same dummy at once
+   *  settle on one the same way entries do.
    *
-   *  @par Returns
-   *  Nothing.
+   *  @param strs - pointer to existing lock-free @a strings struct
+   *  @param b    - bucket number
+   *
+   *  @return pointer to dummy link, NULL on failure
    */
 
-void string_node_free(avl_node *n)
+static string_link *lockfree_bucket(strings *strs, unsigned int b)
 {
-  string_node *sn;
+  string_link ***slot;
+  string_link **segment;
+  string_link **expected;
+  string_link *dummy;
+  string_link *prev;
+  string_link *next;
+  uint64_t key;
+  unsigned int top;
+
+  slot = &strs->lockfree->buckets[b >> LF_SEGMENT_BITS];
+
+  segment = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  if (!segment)
+  {
+    segment = calloc(LF_SEGMENT_SIZE, sizeof(string_link *));
+    if (!segment) return NULL;
+
+    expected = NULL;
+    if (!__atomic_compare_exchange_n(slot, &expected, segment, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      free(segment);
+      segment = expected;
+    }
+  }
 
-  if (!n) return;
+  dummy = __atomic_load_n(&segment[b & (LF_SEGMENT_SIZE - 1)], __ATOMIC_ACQUIRE);
+  if (dummy) return dummy;
 
-  sn = (string_node *)n;
+  for (top = 1U << 31; !(b & top); top >>= 1)
+    ;
+
+  prev = lockfree_bucket(strs, b & ~top);
+  if (!prev) return NULL;
+
+  dummy = lockfree_alloc(strs, sizeof(string_link));
+  if (!dummy) return NULL;
 
-  --sn->value.ref_cnt;
-  if (!sn->value.ref_cnt)
+  key = bit_reverse(b);
+
+  dummy->key = key;
+  dummy->hash = 0;
+  dummy->node = NULL;
+
+  for (;;)
   {
-    if (sn->value.text) free(sn->value.text);
-    free(n);
+    for (next = __atomic_load_n(&prev->next, __ATOMIC_ACQUIRE);
+         next && next->key < key;
+         next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE))
+      prev = next;
+
+      /*
+       *  Entry keys are odd, so an equal key is another thread's dummy
+       */
+
+    if (next && next->key == key)
+    {
+      dummy = next;
+      break;
+    }
+
+    dummy->next = next;
+
+    if (__atomic_compare_exchange_n(&prev->next, &next, dummy, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      break;
   }
+
+  __atomic_store_n(&segment[b & (LF_SEGMENT_SIZE - 1)], dummy, __ATOMIC_RELEASE);
+
+  return dummy;
 }
 
   /**
-   *  @fn int string_node_compare_text(avl_node *a, avl_node *b)
+   *  @fn string_link *lockfree_entry(strings *strs, const char *text, size_t len, uint64_t hash, unsigned int refs)
    *
-   *  @brief compares text of @a string payload of @p a with
-   *  text of @a string payload of @p b
+   *  @brief allocates a link and entry holding a copy of @p text for a lock-free @p strs
    *
-   *  @param a - pointer to existing @a avl_node struct
-   *  @param b - pointer to existing @a avl_node struct
+   *  Link, entry and text are carved out of the arena together.  The entry
+   *  gets the next id, but goes into the id index only once the link is
+   *  in the list.
    *
-   *  @return <0 if @p a is lexically less than @p b
-   *  @return >0 if @p a is lexically greater than @p b
-   *  @return 0 if @p a is lexically equal to @p b
+   *  @param strs - pointer to existing lock-free @a strings struct
+   *  @param text - pointer to text
+   *  @param len  - length of @p text in bytes
+   *  @param hash - strings_hash() of @p text
+   *  @param refs - initial ref_cnt
+   *
+   *  @return pointer to new link, NULL on failure
    */
 
-int string_node_compare_text(avl_node *a, avl_node *b)
+static string_link *lockfree_entry(strings *strs,
+                                   const char *text,
+                                   size_t len,
+                                   uint64_t hash,
+                                   unsigned int refs)
 {
-  string_node *sna, *snb;
-  char *ta, *tb;
-  int cmp = 0;
+  string_link *link;
+  string_node *n;
+  size_t size;
 
-  if (!a || !b) return 0;
+  size = sizeof(string_link) + sizeof(string_node);
+  if (len >= STRING_NODE_INLINE_SIZE) size += len + 1;
 
-  sna = (string_node *)a;
-  snb = (string_node *)b;
+  link = lockfree_alloc(strs, size);
+  if (!link) return NULL;
 
-  ta = sna->value.text;
-  tb = snb->value.text;
+  n = (string_node *)(link + 1);
 
-  if (!ta || !tb) return 0;
+  memset(n, 0, sizeof(string_node));
 
-  cmp = strcmp(ta, tb);
+  n->value.len = len;
+  n->value.hash = hash;
+  n->value.ref_cnt = refs;
 
-  if (cmp < 0) cmp = -1;
-  else if (cmp > 0) cmp = 1;
-  else cmp = 0;
+  text_node_set_prefix(n, text);
 
-  return cmp;
+  if (len < STRING_NODE_INLINE_SIZE) n->value.text = (char *)n->key;
+  else
+  {
+    n->value.text = (char *)(n + 1);
+    memcpy(n->value.text, text, len);
+    n->value.text[len] = 0;
+  }
+
+  n->value.id = __atomic_fetch_add(&strs->last_id, 1, __ATOMIC_RELAXED);
+
+  __atomic_add_fetch(&strs->node_slab_used, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&strs->node_slab_capacity, 1, __ATOMIC_RELAXED);
+
+  link->key = bit_reverse(hash) | 1;
+  link->hash = hash;
+  link->node = n;
+  link->next = NULL;
+
+  return link;
 }
 
   /**
-   *  @fn int string_node_compare_id(avl_node *a, avl_node *b)
+   *  @fn void *lockfree_alloc(strings *strs, size_t size)
    *
-   *  @brief compares id of @a string payload of @p a with
-   *  id of @a string payload of @p b
+   *  @brief allocates @p size bytes from the arena of a lock-free @p strs
    *
-   *  @param a - pointer to existing @a avl_node struct
-   *  @param b - pointer to existing @a avl_node struct
+   *  Threads bump the newest chunk's use count with an atomic add.  A
+   *  thread that finds it full pushes a fresh chunk with a
+   *  compare-and-swap; if another got there first it frees its own and
+   *  tries that one.  The memory is only released by strings_free().
    *
-   *  @return <0 if id of @p a is less than id of @p b
-   *  @return >0 if id of @p a is greater than id of @p b
-   *  @return 0 if id of @p a is equal to id of @p b
+   *  @param strs - pointer to existing lock-free @a strings struct
+   *  @param size - number of bytes
+   *
+   *  @return pointer to memory aligned for a @a string_node, NULL on failure
    */
 
-int string_node_compare_id(avl_node *a, avl_node *b)
+static void *lockfree_alloc(strings *strs, size_t size)
 {
-  string_node *sna, *snb;
+  string_chunk *chunk;
+  string_chunk *fresh;
+  size_t used;
 
-  if (!a || !b) return 0;
+  size = (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
 
-  sna = (string_node *)a;
-  snb = (string_node *)b;
+  chunk = __atomic_load_n(&strs->text_arena, __ATOMIC_ACQUIRE);
 
-  if (sna->value.id < snb->value.id) return -1;
-  if (sna->value.id > snb->value.id) return 1;
-  return 0;
+  for (;;)
+  {
+    if (chunk && size <= chunk->size)
+    {
+      used = __atomic_fetch_add(&chunk->used, size, __ATOMIC_RELAXED);
+      if (used + size <= chunk->size) return chunk->text + used;
+    }
+
+    fresh = malloc(sizeof(string_chunk) + (size > TEXT_ARENA_CHUNK_SIZE ? size : TEXT_ARENA_CHUNK_SIZE));
+    if (!fresh) return NULL;
+
+    fresh->size = size > TEXT_ARENA_CHUNK_SIZE ? size : TEXT_ARENA_CHUNK_SIZE;
+    fresh->used = size;
+    fresh->next = chunk;
+
+    if (__atomic_compare_exchange_n(&strs->text_arena, &chunk, fresh, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+      return fresh->text;
+
+    free(fresh);
+  }
 }
 
   /**
-   *  @fn void renumber_action(avl_node *n)
+   *  @fn uint64_t bit_reverse(uint64_t x)
    *
-   *  @brief callback function for avl_walk(), used by strings_renumber()
+   *  @brief returns @p x with its bits in reverse order
    *
-   *  @param n - pointer to existing @a avl_node struct
+   *  @param x - value to reverse
    *
-   *  @return 0
+   *  @return bit reversed @p x
    */
 
-static void renumber_action(avl_node *n)
+static uint64_t bit_reverse(uint64_t x)
 {
-  string_node *sn;
-  string *str;
+  x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+  x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+  x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+  x = ((x >> 8) & 0x00ff00ff00ff00ffULL) | ((x & 0x00ff00ff00ff00ffULL) << 8);
+  x = ((x >> 16) & 0x0000ffff0000ffffULL) | ((x & 0x0000ffff0000ffffULL) << 16);
 
-  if (!n) goto exit;
+  return (x >> 32) | (x << 32);
+}
 
-  sn = (string_node *)n;
-  str = &sn->value;
+  /**
+   *  @fn strings *local_table_new(string_order order)
+   *
+   *  @brief creates the table of a thread-local interner
+   *
+   *  The ordered text index is left out of date from the start, so it is
+   *  only built if the table is ever walked.
+   *
+   *  @param order - @a string_order of text index, if one is built
+   *
+   *  @return pointer to new @a strings struct, NULL on failure
+   */
 
-  str->id = _new_id;
+static strings *local_table_new(string_order order)
+{
+  strings *table;
+
+  table = strings_new_with_order(order);
+  if (!table) return NULL;
+
+  text_order_free(table);
+  table->order_stale = 1;
+
+  return table;
+}
+
+  /**
+   *  @fn string_result intern_at(strings *strs, const char *text, size_t len, unsigned int id, unsigned int refs)
+   *
+   *  @brief interns the @p len bytes at @p text in @p strs with id @p id
+   *
+   *  For replaying a log, or putting back a remove it did not take, so no
+   *  other thread may change @p strs.  Ids are handed out from last_id,
+   *  which is pointed at @p id for the one entry.
+   *
+   *  @param strs - pointer to existing @a strings struct
+   *  @param text - pointer to text to intern
+   *  @param len  - length of @p text in bytes
+   *  @param id   - id to give the entry
+   *  @param refs - reference count of a new entry
+   *
+   *  @return @a string_found if the entry already has @p id, @a
+   *          string_inserted if it was added with it, @a string_failed if
+   *          the text or the id belong to another entry
+   */
+
+static string_result intern_at(strings *strs,
+                               const char *text,
+                               size_t len,
+                               unsigned int id,
+                               unsigned int refs)
+{
+  string *s;
+  unsigned int last, got = 0;
+  string_result r;
 
-  sn = (string_node *)string_node_dup((avl_node *)sn);
-  if (!sn) goto exit;
+  s = strings_find_by_text_n(strs, text, len);
+  if (s) return s->id == id ? string_found : string_failed;
 
-  sn->left = sn->right = NULL;
-  sn->height = 0;
+  if (id_index_get(strs, id)) return string_failed;
+  if (strs->snapshot && id < strs->snapshot->header->id_end) return string_failed;
 
-  if (avl_insert(_id_root, (avl_node *)sn)) goto exit;
+  last = strs->last_id;
+  strs->last_id = id;
 
-  ++_new_id;
+  r = intern_text(strs, text, len, refs, &got);
 
-exit:
-  return;
+  strs->last_id = r == string_inserted && id >= last ? id + 1 : last;
+
+  return r == string_inserted && got == id ? r : string_failed;
 }
 
   /**
-   *  @fn void duper_action(avl_node *n)
+   *  @fn int log_replay_action(unsigned int op, unsigned int id, unsigned int refs, const char *text, size_t len, void *ctx)
    *
-   *  @brief callback function for avl_walk(), used by strings_dup()
+   *  @brief applies one record of a write-ahead log to the @a strings at @p ctx
    *
-   *  @param n - pointer to existing @a avl_node struct
+   *  @param op   - STRING_LOG_ADD, STRING_LOG_REF or STRING_LOG_REMOVE
+   *  @param id   - id of entry
+   *  @param refs - references taken by an add or ref
+   *  @param text - pointer to text of entry
+   *  @param len  - length of @p text in bytes
+   *  @param ctx  - pointer to @a strings struct
    *
-   *  @return 0
+   *  @return 0 on success, non-zero if the record does not fit the table
    */
 
-static void duper_action(avl_node *n)
+static int log_replay_action(unsigned int op,
+                             unsigned int id,
+                             unsigned int refs,
+                             const char *text,
+                             size_t len,
+                             void *ctx)
 {
-  string *str;
-  string *nstr;
+  strings *strs = ctx;
+  string *s;
 
-  if (!n) goto exit;
+  switch (op)
+  {
+    case STRING_LOG_ADD:
+      return intern_at(strs, text, len, id, refs) == string_failed;
+
+    case STRING_LOG_REF:
+      s = strings_find_by_text_n(strs, text, len);
+      if (!s || s->id != id) return 1;
+      return intern_text(strs, text, len, refs, NULL) != string_found;
+
+    case STRING_LOG_REMOVE:
+      s = strings_find_by_text_n(strs, text, len);
+      if (!s || s->id != id) return 1;
+      return remove_text(strs, text, len) != string_found;
+  }
 
-  str = (string *)n->value;
-  if (!str) goto exit;
+  return 1;
+}
 
-  nstr = string_dup(str);
-  if (!nstr) goto exit;
+  /**
+   *  @fn int merge_commit(uint64_t stamp, void *ctx)
+   *
+   *  @brief checkpoints the write-ahead log, if any, of the @a strings at
+   *         @p ctx before strings_merge_overlay() replaces its base file
+   *
+   *  @param stamp - header checksum of the new base file
+   *  @param ctx   - pointer to @a strings struct
+   *
+   *  @return 0 on success, non-zero to keep the old base file
+   */
 
-  strings_add(nstrs, nstr);
+static int merge_commit(uint64_t stamp, void *ctx)
+{
+  strings *strs = ctx;
 
-exit:
-  return;
+  return strs->log ? string_log_checkpoint(strs->log, stamp) : 0;
 }
-
@@ -19,12 +19,29 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include "libstrings.h"
 
+#define SNAPSHOT_PATH "test-strings.snapshot"
+#define LOG_PATH "test-strings.log"
+#define RACE_THREADS 4
+#define RACE_TEXTS 512
+
+typedef struct race_job
+{
+  strings *strs;
+  unsigned int ids[RACE_TEXTS];
+  unsigned int stray;
+} race_job;
+
 void print_node(avl_node *n);
+int print_first_node(avl_node *n, void *ctx);
+unsigned int race_lock_free(string_order order);
+void *race_worker(void *ctx);
 
 char *keys[] = {
   "hello",
@@ -44,9 +61,52 @@ int main(int argc, char **argv)
 {
   string *str = NULL;
   strings *strs = NULL;
+  strings *copy = NULL;
+  strings *mapped = NULL;
+  string_cursor *cursor = NULL;
+  string_iterator *it = NULL;
+  string_reader *reader = NULL;
+  string_local *local = NULL;
+  unsigned int local_ids[4];
+  unsigned int remap[4];
+  unsigned int left;
+  static const char *batch[] = { "zebra", "hello", "yak", "zebra" };
+  unsigned int batch_ids[4];
+  unsigned int i;
   char **s;
   string_result sr;
   unsigned int id = 0;
+  unsigned int used, capacity;
+  string_order order = string_order_avl;
+  int concurrent = 0;
+  int read_mostly = 0;
+  int lock_free = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "abclr")) != -1)
+  {
+    switch (opt)
+    {
+      case 'a':
+        order = string_order_art;
+        break;
+      case 'b':
+        order = string_order_btree;
+        break;
+      case 'c':
+        concurrent = 1;
+        break;
+      case 'l':
+        lock_free = 1;
+        break;
+      case 'r':
+        read_mostly = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-a|-b] [-c|-l|-r] [text]\n", argv[0]);
+        return 1;
+    }
+  }
 
   printf("Test:  strings\n");
 
@@ -63,7 +123,10 @@ int main(int argc, char **argv)
 
   printf("string_free(): completed\n");
 
-  strs = strings_new();
+  if (concurrent) strs = strings_new_concurrent(order, 4);
+  else if (lock_free) strs = strings_new_lock_free(order);
+  else if (read_mostly) strs = strings_new_read_mostly(order);
+  else strs = strings_new_with_order(order);
 
   printf("strs=%p\n", strs);
 
@@ -79,16 +142,49 @@ int main(int argc, char **argv)
       ++s;
     }
 
-    printf("number of nodes in text tree = %d\n", strs->text_root->n_nodes);fflush(stdout);
-    printf("number of nodes in id tree = %d\n", strs->id_root->n_nodes);fflush(stdout);
+    sr = strings_add_n(strs, "key=value" + 4, 5);
+    printf("strings_add_n(strs, \"value\", 5)=%s\n", strings_result_to_str(sr));
+
+    sr = strings_add_n(strs, "bin\0key", 7);
+    printf("strings_add_n(strs, \"bin\\0key\", 7)=%s\n", strings_result_to_str(sr));
+
+    str = strings_find_by_text_n(strs, "bin\0key", 7);
+    if (str) printf("strings_find_by_text_n(strs, \"bin\\0key\", 7) returned str->id=%u, str->len=%zu\n",
+                    str->id,
+                    str->len);
+    else printf("strings_find_by_text_n(strs, \"bin\\0key\", 7):  FAILED\n");
 
-    if (argc > 1)
+    str = strings_find_by_text(strs, "bin");
+    printf("strings_find_by_text(strs, \"bin\") returned %s\n", str ? "FOUND" : "NOT FOUND");
+
+    sr = strings_intern(strs, "hello", 5, &id);
+    printf("strings_intern(strs, \"hello\", 5)=%s, id=%u\n", strings_result_to_str(sr), id);
+
+    sr = strings_intern(strs, "goodbye", 7, &id);
+    printf("strings_intern(strs, \"goodbye\", 7)=%s, id=%u\n", strings_result_to_str(sr), id);
+
+    str = strings_find_by_id(strs, id);
+    if (str) printf("string_hash(\"%s\")=%016llx, strings_hash(\"goodbye\", 7)=%016llx\n",
+                    str->text,
+                    (unsigned long long)string_hash(str),
+                    (unsigned long long)strings_hash("goodbye", 7));
+
+    if (strs->text_root) printf("number of nodes in text tree = %d\n", strs->text_root->n_nodes);
+    fflush(stdout);
+    printf("number of entries in id index = %u\n", strs->id_index_used);fflush(stdout);
+    strings_slab_occupancy(strs, &used, &capacity);
+    printf("entry slab occupancy = %u of %u\n", used, capacity);fflush(stdout);
+
+    if (optind < argc)
     {
-      str = strings_find_by_text(strs, argv[1]);
+      reader = strings_reader_new(strs);
+      strings_read_begin(reader);
+
+      str = strings_find_by_text(strs, argv[optind]);
       if (str)
       {
         printf("strings_find_by_text('%s') returned str=%p, str->id=%d, str->text=%s\n",
-               argv[1],
+               argv[optind],
                str,
                str->id,
                str->text);
@@ -100,7 +196,10 @@ int main(int argc, char **argv)
                         str->text);
         else printf("strings_find_by_id():  FAILED\n");
       }
-      else printf("strings_find_by_text('%s'):  FAILED\n", argv[1]);
+      else printf("strings_find_by_text('%s'):  FAILED\n", argv[optind]);
+
+      strings_read_end(reader);
+      strings_reader_free(reader);
     }
 
     printf("strings (by string order):\n");
@@ -109,6 +208,53 @@ int main(int argc, char **argv)
     printf("strings (by id order):\n");
     strings_walk(strs, string_id, print_node);
 
+    cursor = string_cursor_new();
+    if (cursor)
+    {
+      printf("strings_find_prefix(strs, \"h\", 1):\n");
+      while ((str = strings_find_prefix(strs, "h", 1, cursor)))
+        printf("id=%d,text='%s'\n", str->id, str->text);
+
+      string_cursor_set_range(cursor, "a", 1, "t", 1, string_reverse);
+      while (!cursor->done)
+      {
+        printf("strings_scan(strs, [\"a\", \"t\"), reverse, 3):\n");
+        strings_scan(strs, cursor, 3, print_node);
+      }
+
+      string_cursor_free(cursor);
+    }
+
+    copy = strings_dup(strs);
+    if (copy)
+    {
+      printf("strings_dup() copy (by string order, iterator):\n");
+      it = strings_begin(copy, string_text);
+      while ((str = strings_next(it))) printf("id=%d,text='%s'\n", str->id, str->text);
+      strings_end(it);
+      strings_free(copy);
+    }
+
+    sr = strings_add_batch(strs, batch, NULL, 4, batch_ids);
+    printf("strings_add_batch(strs, {\"zebra\", \"hello\", \"yak\", \"zebra\"})=%s\n", strings_result_to_str(sr));
+    if (sr == string_found)
+      for (i = 0; i < 4; i++) printf("id=%u,text='%s'\n", batch_ids[i], batch[i]);
+
+    local = strings_local_new(strs);
+    if (local)
+    {
+      for (i = 0; i < 4; i++) strings_local_intern(local, batch[i], strlen(batch[i]), &local_ids[i]);
+      sr = strings_local_merge(local, remap);
+      printf("strings_local_merge(local, remap)=%s\n", strings_result_to_str(sr));
+      if (sr == string_found)
+        for (i = 0; i < 4; i++) printf("local id=%u,id=%u,text='%s'\n", local_ids[i], remap[local_ids[i]], batch[i]);
+      strings_local_free(local);
+    }
+
+    left = 3;
+    printf("strings_walk_with_context() first %u (by id order):\n", left);
+    strings_walk_with_context(strs, string_id, print_first_node, &left);
+
     sr = strings_remove(strs, "my");
     printf("strings_remove(strs, \"%s\")=%s\n", "my", strings_result_to_str(sr));
     printf("strings (by string order):\n");
@@ -123,6 +269,61 @@ int main(int argc, char **argv)
     printf("strings (by id order):\n");
     strings_walk(strs, string_id, print_node);
 
+    sr = strings_save(strs, SNAPSHOT_PATH) ? string_failed : string_found;
+    printf("strings_save(strs, \"%s\")=%s\n", SNAPSHOT_PATH, strings_result_to_str(sr));
+    mapped = strings_open_mapped(SNAPSHOT_PATH);
+    if (mapped)
+    {
+      printf("strings_open_mapped() (by string order):\n");
+      strings_walk(mapped, string_text, print_node);
+      str = strings_find_by_text(mapped, "Rock");
+      if (str) printf("strings_find_by_text(mapped, \"Rock\") returned str->id=%u\n", str->id);
+      str = strings_find_by_id(mapped, str ? str->id : 0);
+      if (str) printf("strings_find_by_id(mapped, %u) returned str->text='%s'\n", str->id, str->text);
+      printf("strings_verify_mapped(mapped)=%d\n", strings_verify_mapped(mapped));
+      strings_free(mapped);
+    }
+    mapped = strings_open_layered(SNAPSHOT_PATH);
+    if (mapped)
+    {
+      sr = strings_intern(mapped, "overlay", 7, &id);
+      printf("strings_intern(layered, \"overlay\")=%s, id=%u\n", strings_result_to_str(sr), id);
+      sr = strings_remove(mapped, "Rock");
+      printf("strings_remove(layered, \"Rock\")=%s\n", strings_result_to_str(sr));
+      printf("strings_merge_overlay(layered)=%d\n", strings_merge_overlay(mapped, SNAPSHOT_PATH));
+      printf("strings_open_layered() after merge (by string order):\n");
+      strings_walk(mapped, string_text, print_node);
+      strings_free(mapped);
+    }
+    remove(SNAPSHOT_PATH);
+
+    remove(LOG_PATH);
+    mapped = strings_new();
+    if (mapped)
+    {
+      printf("strings_log_open(\"%s\")=%d\n", LOG_PATH, strings_log_open(mapped, LOG_PATH, 0));
+      strings_intern(mapped, "logged", 6, NULL);
+      strings_intern(mapped, "gone", 4, NULL);
+      strings_intern(mapped, "kept", 4, NULL);
+      strings_intern(mapped, "kept", 4, NULL);
+      strings_remove(mapped, "gone");
+      printf("strings (by id order):\n");
+      strings_walk(mapped, string_id, print_node);
+      strings_free(mapped);
+    }
+    mapped = strings_new();
+    if (mapped)
+    {
+      printf("strings_log_open() replayed=%d\n", strings_log_open(mapped, LOG_PATH, 0));
+      printf("strings (by id order):\n");
+      strings_walk(mapped, string_id, print_node);
+      printf("strings_log_close()=%d\n", strings_log_close(mapped));
+      strings_free(mapped);
+    }
+    remove(LOG_PATH);
+
+    printf("race_lock_free(): %u of %u texts with one id\n", race_lock_free(order), RACE_TEXTS);
+
     strings_renumber(strs);
     printf("after strings_renumber()\n");
     printf("strings (by string order):\n");
@@ -157,3 +358,103 @@ exit:
   return;
 }
 
+int print_first_node(avl_node *n, void *ctx)
+{
+  unsigned int *left = (unsigned int *)ctx;
+
+  print_node(n);
+
+  return --*left == 0;
+}
+
+unsigned int race_lock_free(string_order order)
+{
+  strings *strs;
+  race_job *jobs = NULL;
+  pthread_t tids[RACE_THREADS];
+  unsigned int started = 0;
+  unsigned int good = 0;
+  unsigned int used;
+  unsigned int i, t;
+  char text[32];
+  string *str;
+
+  strs = strings_new_lock_free(order);
+  if (!strs) goto exit;
+
+  jobs = calloc(RACE_THREADS, sizeof(race_job));
+  if (!jobs) goto exit;
+
+  for (started = 0; started < RACE_THREADS; started++)
+  {
+    jobs[started].strs = strs;
+    if (pthread_create(&tids[started], NULL, race_worker, &jobs[started])) break;
+  }
+  for (t = 0; t < started; t++) pthread_join(tids[t], NULL);
+
+    /*
+     *  Every thread must have been handed the same id for a text, and
+     *  the table must agree with it both ways
+     */
+
+  for (i = 0; i < RACE_TEXTS; i++)
+  {
+    for (t = 1; t < started; t++)
+      if (jobs[t].ids[i] != jobs[0].ids[i]) break;
+    if (t < started) continue;
+
+    snprintf(text, sizeof(text), "race %u", i);
+    str = strings_find_by_text(strs, text);
+    if (!str || str->id != jobs[0].ids[i]) continue;
+
+    str = strings_find_by_id(strs, jobs[0].ids[i]);
+    if (!str || strcmp(str->text, text)) continue;
+
+    ++good;
+  }
+
+  strings_slab_occupancy(strs, &used, NULL);
+  if (used != RACE_TEXTS) good = 0;
+
+  for (t = 0; t < started; t++)
+    if (jobs[t].stray) good = 0;
+
+exit:
+  free(jobs);
+  if (strs) strings_free(strs);
+
+  return good;
+}
+
+void *race_worker(void *ctx)
+{
+  race_job *job = (race_job *)ctx;
+  char text[32];
+  string *str;
+  string *by_text;
+  unsigned int i, id;
+  int len;
+
+  for (i = 0; i < RACE_TEXTS; i++)
+  {
+    len = snprintf(text, sizeof(text), "race %u", i);
+    if (strings_intern(job->strs, text, len, &job->ids[i]) == string_failed)
+      job->ids[i] = 0;
+
+      /*
+       *  Ids just handed out to other threads must already be the ones
+       *  their texts are found under
+       */
+
+    for (id = job->ids[i] + 1; id <= job->ids[i] + RACE_THREADS; id++)
+    {
+      str = strings_find_by_id(job->strs, id);
+      if (!str) continue;
+
+      by_text = strings_find_by_text_n(job->strs, str->text, str->len);
+      if (!by_text || by_text->id != id) ++job->stray;
+    }
+  }
+
+  return NULL;
+}